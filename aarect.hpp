@@ -65,7 +65,7 @@ struct xz_rect : public hittable {
 
     inline bool bounding_box(const double time0, const double time1, aabb& output_box) const override {
 		constexpr double small = 0.0001;
-		output_box = aabb(point3(x0, k-small, z1), point3(x1, k+small, z1));
+		output_box = aabb(point3(x0, k-small, z0), point3(x1, k+small, z1));
 		return true;
 	}
 
@@ -164,8 +164,9 @@ bool xy_rect::hit_time(const ray&r, const double t_min, const double t_max, hit_
 void xy_rect::hit_info(const ray&r, const double t_min, const double t_max, hit_record& rec) {
     const auto outward_normal = vec3(0, 0, 1);	//the trivial normal vector
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(rec.t);
+    rec.set_uv_footprint(r, 1 / sqrt(area));
 }
 
 
@@ -200,8 +201,9 @@ bool xz_rect::hit_time(const ray&r, const double t_min, const double t_max, hit_
 void xz_rect::hit_info(const ray&r, const double t_min, const double t_max, hit_record& rec) {
     const auto outward_normal = vec3(0, 1, 0);	//the trivial normal vector
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(rec.t);
+    rec.set_uv_footprint(r, 1 / sqrt(area));
 }
 
 
@@ -236,6 +238,7 @@ bool yz_rect::hit_time(const ray&r, const double t_min, const double t_max, hit_
 void yz_rect::hit_info(const ray&r, const double t_min, const double t_max, hit_record& rec) {
     const auto outward_normal = vec3(1, 0, 0);	//the trivial normal vector
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(rec.t);
+    rec.set_uv_footprint(r, 1 / sqrt(area));
 }
@@ -0,0 +1,104 @@
+#include "timing_tests.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+
+/*=====================================================================================================================
+ Checks that rendering does not allocate -- fails (exits with 1) if a render of any of the scenes makes a heap allocation
+  - operator new is replaced for the whole program to count the allocations, so this is its own program (and ctest test)
+    instead of one of the timing tests
+ ===================================================================================================================*/
+
+//the heap allocations made through operator new while counting is on
+// - only does a relaxed load more than malloc when not counting
+struct allocation_counter {
+    static inline std::atomic<bool> counting = false;
+    static inline std::atomic<size_t> count = 0;
+
+    static inline void add() {
+        if (counting.load(std::memory_order_relaxed))
+            count.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+//new[] and the nothrow versions call these, so they are counted as well
+void* operator new(const size_t size) {
+    allocation_counter::add();
+    if (void* const p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+//for types aligned more than malloc aligns (e.g. the alignas(64) bvh nodes)
+void* operator new(const size_t size, const std::align_val_t alignment) {
+    allocation_counter::add();
+    const auto align = static_cast<size_t>(alignment);
+    if (void* const p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* const p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* const p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* const p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* const p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+
+//the heap allocations of renders of scenes using each kind of pdf, with the scene already drawn once (so the lazy parts of
+//the scene, e.g. the nodes of a lazy_bvh and the pages of textures, are already made) -- should be 0 for each
+struct allocation_test {
+    static constexpr size_t image_width = 150, image_height = 100, num_samples = 4;
+
+    //whether none of the renders allocated
+    bool run() {
+        scene environment_scene(aspec1);
+        environment_scene.set_environment(environment_map_test::sun_and_sky());
+        environment_scene.world.add(std::make_shared<sphere>(point3(0, -1000, 0), 1000, std::make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+        environment_scene.world.add(std::make_shared<sphere>(point3(0, 1, 0), 1, std::make_shared<lambertian>(color(0.7, 0.3, 0.2))));
+        environment_scene.set_camera(point3(10, 3, 6), point3(0, 1, 0), 35.0, 0.0);
+
+        size_t total = 0;
+        total += count("cornell box (cosine and hittable pdfs)", cornell_box_scene());
+        total += count("foggy balls (media)", foggy_balls());
+        total += count("two perlin spheres", two_perlin_spheres_scene());
+        total += count("environment map", environment_scene);
+        return total == 0;
+    }
+
+    static size_t count(const char* name, const scene& sc) {
+        timing_test<image_width, image_height, 1, num_samples> test(sc);
+        draw_once(test);
+
+        allocation_counter::count = 0;
+        allocation_counter::counting = true;
+        draw_once(test);
+        allocation_counter::counting = false;
+        std::cout << name << " : " << allocation_counter::count << " heap allocations in a render of "
+                  << image_width * image_height * num_samples << " samples\n";
+        return allocation_counter::count;
+    }
+};
+
+
+int main() {
+    allocation_test test;
+    if (!test.run()) {
+        std::cout << "FAILED -- rendering made heap allocations\n";
+        return 1;
+    }
+    return 0;
+}
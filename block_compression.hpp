@@ -0,0 +1,152 @@
+#ifndef RAYTRACER_BLOCK_COMPRESSION_HPP
+#define RAYTRACER_BLOCK_COMPRESSION_HPP
+
+#include "vec3.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+
+/*=====================================================================================================================
+ BC1 (DXT1) block compression of 8 bit rgb texels -- a 4x4 block of texels in 8 bytes, 1/6 of the 48 bytes it is uncompressed
+  - a block is 2 end point colours in rgb565 and a 2 bit index per texel into the palette made from them: the 2 end points
+    and the 2 colours 1/3 and 2/3 of the way between them
+  - the end points are along the block's principal axis (of its texels' colours), fitted again by least squares to the
+    indices they give
+  - colours are in [0,255]
+ ===================================================================================================================*/
+
+constexpr unsigned bc1_block_size = 8;  //bytes
+
+inline vec3 bc1_unpack565(const unsigned c) {
+    const unsigned r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+    return vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+inline unsigned bc1_pack565(const vec3& c) {
+    const auto quantise = [](const double value, const long max) {
+        return static_cast<unsigned>(std::clamp(std::lround(value * static_cast<double>(max) / 255.0), 0L, max));
+    };
+    return quantise(c.x(), 31) << 11 | quantise(c.y(), 63) << 5 | quantise(c.z(), 31);
+}
+
+//the colour of texel (x, y) of a block, x and y in [0,3]
+inline vec3 bc1_decode(const unsigned char* const block, const unsigned x, const unsigned y) {
+    const unsigned c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+    const unsigned index = block[4 + y] >> 2*x & 3;     //a byte of indices per row
+    if (index == 0) return bc1_unpack565(c0);
+    if (index == 1) return bc1_unpack565(c1);
+
+    //blocks with c0 <= c1 have a palette of 3 colours and black (never written by bc1_encode, but valid)
+    const auto e0 = bc1_unpack565(c0), e1 = bc1_unpack565(c1);
+    if (c0 > c1) return index == 2 ? (2*e0 + e1) / 3 : (e0 + 2*e1) / 3;
+    return index == 2 ? (e0 + e1) / 2 : vec3(0, 0, 0);
+}
+
+
+//the indices of the nearest palette colour to each texel (2 bits each, texel 0 in the lowest bits) and the squared error
+// - c0 > c1, the palette of 4 colours
+inline std::uint32_t bc1_fit(const std::array<vec3, 16>& texels, const unsigned c0, const unsigned c1, double& error) {
+    const auto e0 = bc1_unpack565(c0), e1 = bc1_unpack565(c1);
+    const std::array<vec3, 4> palette = {e0, e1, (2*e0 + e1) / 3, (e0 + 2*e1) / 3};
+
+    std::uint32_t indices = 0;
+    error = 0;
+    for (unsigned i = 0; i < 16; i++) {
+        unsigned best = 0;
+        double best_distance = (texels[i] - palette[0]).length_squared();
+        for (unsigned p = 1; p < 4; p++) {
+            if (const double distance = (texels[i] - palette[p]).length_squared(); distance < best_distance) {
+                best = p;
+                best_distance = distance;
+            }
+        }
+        indices |= best << 2*i;
+        error += best_distance;
+    }
+    return indices;
+}
+
+//the end points as a block with c0 > c1 (so it has a palette of 4 colours), and the squared error of its texels
+inline std::array<unsigned, 3> bc1_block(const std::array<vec3, 16>& texels, const vec3& end0, const vec3& end1, double& error) {
+    unsigned c0 = bc1_pack565(end0), c1 = bc1_pack565(end1);
+    if (c0 < c1) std::swap(c0, c1);
+    if (c0 == c1) {     //the whole block is the colour (index 0 for every texel)
+        error = 0;
+        const auto e = bc1_unpack565(c0);
+        for (const auto& t : texels) error += (t - e).length_squared();
+        return {c0, c1, 0};
+    }
+    return {c0, c1, bc1_fit(texels, c0, c1, error)};
+}
+
+//the 16 texels of a block (3 bytes each, in rows) in the 8 bytes at block
+inline void bc1_encode(const unsigned char* const rgb, unsigned char* const block) {
+    std::array<vec3, 16> texels;
+    vec3 mean(0, 0, 0);
+    for (unsigned i = 0; i < 16; i++) {
+        texels[i] = vec3(rgb[3*i], rgb[3*i + 1], rgb[3*i + 2]);
+        mean += texels[i] / 16;
+    }
+
+    //the principal axis of the colours, by power iteration on their covariance
+    double covariance[3][3] = {};
+    for (const auto& t : texels) {
+        const auto d = t - mean;
+        for (unsigned a = 0; a < 3; a++) {
+            for (unsigned b = 0; b < 3; b++) covariance[a][b] += d[a] * d[b];
+        }
+    }
+    vec3 axis(1, 1, 1);
+    for (int iteration = 0; iteration < 8; iteration++) {
+        const vec3 next(dot(vec3(covariance[0][0], covariance[0][1], covariance[0][2]), axis),
+                        dot(vec3(covariance[1][0], covariance[1][1], covariance[1][2]), axis),
+                        dot(vec3(covariance[2][0], covariance[2][1], covariance[2][2]), axis));
+        const double largest = std::max({std::fabs(next.x()), std::fabs(next.y()), std::fabs(next.z())});
+        if (largest < 1e-9) break;  //the texels are all the same colour (the axis does not matter)
+        axis = next / largest;
+    }
+    axis = unit_vector(axis);
+
+    //the end points are the furthest texels along the axis, moved in a little as the palette rarely needs the extremes
+    double low = std::numeric_limits<double>::infinity(), high = -low;
+    for (const auto& t : texels) {
+        const double along = dot(t - mean, axis);
+        low = std::min(low, along);
+        high = std::max(high, along);
+    }
+    const double inset = (high - low) / 16;
+    double error;
+    auto best = bc1_block(texels, mean + (high - inset)*axis, mean + (low + inset)*axis, error);
+
+    //fitting the end points again by least squares to the indices they gave (each texel is w*end0 + (1-w)*end1)
+    if (best[0] != best[1]) {
+        constexpr double weights[4] = {1.0, 0.0, 2.0/3.0, 1.0/3.0};
+        double aa = 0, bb = 0, ab = 0;
+        vec3 at(0, 0, 0), bt(0, 0, 0);
+        for (unsigned i = 0; i < 16; i++) {
+            const double w = weights[best[2] >> 2*i & 3];
+            aa += w*w;
+            bb += (1 - w)*(1 - w);
+            ab += w*(1 - w);
+            at += w*texels[i];
+            bt += (1 - w)*texels[i];
+        }
+        if (const double determinant = aa*bb - ab*ab; std::fabs(determinant) > 1e-9) {
+            double refined_error;
+            const auto refined = bc1_block(texels, (bb*at - ab*bt) / determinant, (aa*bt - ab*at) / determinant, refined_error);
+            if (refined_error < error) best = refined;
+        }
+    }
+
+    block[0] = best[0] & 0xFF;
+    block[1] = best[0] >> 8;
+    block[2] = best[1] & 0xFF;
+    block[3] = best[1] >> 8;
+    for (unsigned y = 0; y < 4; y++) block[4 + y] = best[2] >> 8*y & 0xFF;
+}
+
+#endif //RAYTRACER_BLOCK_COMPRESSION_HPP
@@ -1,37 +1,88 @@
 #pragma once
 
-#include "hittable_list.hpp"
+#include "hittable.hpp"
 
+//an axis aligned box, hit with a single slab test (see aabb::hit) rather than as 6 rectangles
 struct box : public hittable {
 	const point3 box_min;		//min and max define the corners of the box in the standard way
 	const point3 box_max;
-	hittable_list sides;
+	const std::shared_ptr<material> mp;
 
 	box() = delete;
-	box(const point3& p0, const point3& p1, const std::shared_ptr<material> &ptr);
+	box(const point3& p0, const point3& p1, std::shared_ptr<material> ptr) : box_min(p0), box_max(p1), mp(std::move(ptr)) {}
 
     inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
-		return sides.hit_time(r, t_min, t_max, rec);
+        double t_near, t_far;
+        unsigned near_face, far_face;
+        if (!slab(box_min, box_max, r, t_near, t_far, near_face, far_face))
+            return false;
+
+        //the first face hit in [t_min, t_max] -- the exit if the ray starts inside the box (or t_min is after the entry)
+        if (t_near >= t_min && t_near <= t_max) {
+            rec.t = t_near;
+            rec.primitive_id = near_face;
+        } else if (t_far >= t_min && t_far <= t_max) {
+            rec.t = t_far;
+            rec.primitive_id = far_face;
+        } else {
+            return false;
+        }
+        return true;
 	}
 
-    inline void hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
-        sides.hit_info(r, t_min, t_max, rec);
+    inline void hit_info(const ray& r, [[maybe_unused]] const double t_min, [[maybe_unused]] const double t_max, hit_record& rec) override {
+        face_info(box_min, box_max, rec.primitive_id, r, rec);
+        rec.mat_ptr = mp.get();
     }
 
     inline bool bounding_box(const double time0, const double time1, aabb& output_box) const override {
 		output_box = aabb(box_min, box_max);    //the trivial bounding box
 		return true;
 	}
-};
 
-box::box(const point3& p0, const point3& p1, const std::shared_ptr<material> &ptr) : box_min(p0), box_max(p1) {
-    sides.reserve(6);   //not really needed -- might minorly improve computations time
-	sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr));
-	sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr));
-
-	sides.add(make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr));
-	sides.add(make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr));
-	
-	sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr));
-	sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
-}
+	//finds when the ray enters (t_near) and leaves (t_far) the box, and the faces it does so through
+	// - a face is 2*axis for the side at box_min and 2*axis + 1 for the side at box_max
+	// - returns false if the ray misses the box (the times can be negative, i.e. before the ray's origin)
+	static inline bool slab(const point3& lo, const point3& hi, const ray& r, double& t_near, double& t_far, unsigned& near_face, unsigned& far_face) {
+	    t_near = -infinity;
+	    t_far = infinity;
+	    near_face = far_face = 0;
+	    for (unsigned axis = 0; axis < 3; axis++) {
+	        const double invD = 1.0 / r.dir[axis];
+	        double t0 = (lo[axis] - r.orig[axis]) * invD;
+	        double t1 = (hi[axis] - r.orig[axis]) * invD;
+	        unsigned face0 = 2*axis, face1 = 2*axis + 1;
+	        if (invD < 0.0) {
+	            std::swap(t0, t1);
+	            std::swap(face0, face1);
+	        }
+
+	        if (t0 > t_near) {
+	            t_near = t0;
+	            near_face = face0;
+	        }
+	        if (t1 < t_far) {
+	            t_far = t1;
+	            far_face = face1;
+	        }
+	    }
+	    return t_near <= t_far;
+	}
+
+	//the point, normal and uv of a hit on a face (see slab)
+	// - the uv coords are the same as for the rectangle on that side (xy_rect, xz_rect or yz_rect)
+	static inline void face_info(const point3& lo, const point3& hi, const unsigned face, const ray& r, hit_record& rec) {
+	    rec.p = r.at(rec.t);
+	    const unsigned axis = face / 2;
+	    vec3 outward_normal(0, 0, 0);
+	    outward_normal[axis] = (face & 1) ? 1 : -1;
+	    rec.set_face_normal(r, outward_normal);
+
+	    //the 2 axes the face lies in
+	    const unsigned a = axis == 0 ? 1 : 0;
+	    const unsigned b = axis == 2 ? 1 : 2;
+	    rec.u = (rec.p[a] - lo[a]) / (hi[a] - lo[a]);
+	    rec.v = (rec.p[b] - lo[b]) / (hi[b] - lo[b]);
+	    rec.set_uv_footprint(r, 1 / sqrt((hi[a] - lo[a]) * (hi[b] - lo[b])));
+	}
+};
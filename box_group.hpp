@@ -0,0 +1,138 @@
+#ifndef RAYTRACER_BOX_GROUP_HPP
+#define RAYTRACER_BOX_GROUP_HPP
+
+#include "box.hpp"
+#include "hittable_list.hpp"
+#include "indexed_bvh.hpp"
+#include "box_packet.hpp"
+
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+
+/*=====================================================================================================================
+ Many axis aligned boxes as a single hittable (e.g. the ground of rt_week)
+  - the corners and material ids of the boxes are stored in arrays instead of as a hittable per box
+  - materials are shared by index, so boxes with the same material only store it once
+  - the bvh refers to the boxes by index, and the boxes are stored in the order of the leaves
+  - each leaf of the bvh holds its boxes in a box_packet, which is intersected with SIMD
+  - the face hit is found again in hit_info (with box::slab) for the one box hit
+ ===================================================================================================================*/
+struct box_group : public hittable {
+    std::vector<point3> box_mins;
+    std::vector<point3> box_maxs;
+    std::vector<unsigned> material_ids;
+    std::vector<std::shared_ptr<material>> materials;
+
+    box_group() = delete;
+    //boxes should only hold box objects -- anything else is left out
+    explicit box_group(const hittable_list& boxes, const bvh_settings& settings = {});
+
+
+    inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+        rec.t = t_max;
+        unsigned closest;
+        if (!group->hit(r, t_min, rec, closest))
+            return false;
+
+        rec.primitive_id = closest;
+        return true;
+    }
+
+    void hit_info(const ray& r, double t_min, double t_max, hit_record& rec) override;
+
+    inline bool bounding_box([[maybe_unused]] const double time0, [[maybe_unused]] const double time1, aabb& output_box) const override {
+        output_box = group->box;
+        return true;
+    }
+
+    [[nodiscard]] inline size_t num_boxes() const {
+        return box_mins.size();
+    }
+
+    //used by the bvh
+    static constexpr unsigned leaf_size = box_packet::width;
+    using leaf_block = box_packet;
+
+    [[nodiscard]] box_packet make_leaf_block(unsigned first, unsigned count) const;
+
+    inline bool hit_leaf_block(const box_packet& packet, const ray& r, const double t_min, hit_record& rec, unsigned& closest) const {
+        double t;
+        const int lane = packet.hit(r, t_min, rec.t, t);
+        if (lane < 0)
+            return false;
+
+        rec.t = t;
+        closest = packet.first + lane;
+        return true;
+    }
+
+    void reorder_primitives(unsigned first, const std::vector<unsigned>& ids);
+
+private:
+    std::unique_ptr<indexed_bvh<box_group>> group;
+
+    //permutes one of the arrays in the same way as reorder_primitives
+    template <typename T>
+    static inline void reorder(std::vector<T>& values, const unsigned first, const std::vector<unsigned>& ids) {
+        const std::vector<T> old(values.begin() + first, values.begin() + first + ids.size());
+        for (unsigned k = 0; k < ids.size(); k++) {
+            values[first + k] = old[ids[k] - first];
+        }
+    }
+};
+
+
+box_group::box_group(const hittable_list& boxes, const bvh_settings& settings) {
+    std::unordered_map<const material*, unsigned> material_index;
+    std::vector<bvh_primitive> prims;
+
+    for (const auto& object : boxes.objects) {
+        const auto b = std::dynamic_pointer_cast<box>(object);
+        if (!b) {
+            std::cerr << "box_group given an object that is not a box -- it is left out" << std::endl;
+            continue;
+        }
+
+        const auto [it, is_new] = material_index.try_emplace(b->mp.get(), static_cast<unsigned>(materials.size()));
+        if (is_new) materials.push_back(b->mp);
+
+        prims.push_back({aabb(b->box_min, b->box_max), static_cast<unsigned>(box_mins.size())});
+        box_mins.push_back(b->box_min);
+        box_maxs.push_back(b->box_max);
+        material_ids.push_back(it->second);
+    }
+
+    group = std::make_unique<indexed_bvh<box_group>>(*this, prims, 0, settings);
+}
+
+box_packet box_group::make_leaf_block(const unsigned first, const unsigned count) const {
+    box_packet packet;
+    packet.first = first;
+    packet.count = count;
+    for (unsigned i = 0; i < count; i++) {
+        packet.set_box(i, box_mins[first + i], box_maxs[first + i]);
+    }
+    return packet;
+}
+
+void box_group::hit_info(const ray& r, [[maybe_unused]] const double t_min, [[maybe_unused]] const double t_max, hit_record& rec) {
+    const unsigned b = rec.primitive_id;
+    double t_near, t_far;
+    unsigned near_face, far_face;
+    box::slab(box_mins[b], box_maxs[b], r, t_near, t_far, near_face, far_face);
+
+    //rec.t is either the entry or the exit
+    const unsigned face = std::abs(t_near - rec.t) <= std::abs(t_far - rec.t) ? near_face : far_face;
+    box::face_info(box_mins[b], box_maxs[b], face, r, rec);
+    rec.mat_ptr = materials[material_ids[b]].get();
+}
+
+void box_group::reorder_primitives(const unsigned first, const std::vector<unsigned>& ids) {
+    reorder(box_mins, first, ids);
+    reorder(box_maxs, first, ids);
+    reorder(material_ids, first, ids);
+}
+
+#endif //RAYTRACER_BOX_GROUP_HPP
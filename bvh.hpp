@@ -7,52 +7,115 @@
 
 #include "hittable_list.hpp"
 #include "bvh_node.hpp"
+#include "helpful.hpp"
 
-//could probably be made to be 32_bytes
-struct bvh_info {
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+
+//the order the nodes are stored in memory
+// - depth_first : a node's first child is immediately after it (the original layout)
+// - breadth_first : the tree is cut into small treelets, and the nodes of each treelet are stored together in breadth first order
+//                   so the nodes near the top of a treelet (that almost every ray visits) share cache lines
+// - van_emde_boas : the tree is recursively split in half by height, and the top half is stored before the bottom halves
+//                   this is cache-oblivious, so subtrees of every size are stored close together
+//https://en.wikipedia.org/wiki/Van_Emde_Boas_layout
+enum class bvh_layout {depth_first, breadth_first, van_emde_boas};
+
+//aligned so each node takes exactly 1 cache line -- prefetching a node then brings in the entire node
+struct alignas(64) bvh_info {
     aabb box{};
     union { //one is for leaf nodes and one is for interior nodes
         unsigned primitives_offset; //for leaf nodes
-        unsigned second_child_offset;   //first child is immediately next to parent
-                                        //https://pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/BVH%20linearization.svg
+        unsigned first_child_offset;    //for interior nodes
     };
-    unsigned axis = 4;  //should error out if called and not set
+    unsigned second_child_offset = 0;   //only used for interior nodes
+                                        //children are not necessarily next to the parent (depends on the bvh_layout)
+    unsigned char axis = 4;  //should error out if called and not set
     bool is_leaf{};
+    unsigned short num_primitives{};    //for leaf nodes -- the primitives are [primitives_offset, primitives_offset + num_primitives)
 
 };
+static_assert(sizeof(bvh_info) == 64, "bvh_info should be exactly 1 cache line");
 
 struct bvh : public hittable {
     std::vector<std::shared_ptr<hittable>> objs;  //filled in the order they appear when constructing the tree
     std::vector<bvh_info> node_info;
 
-    bvh(const hittable_list& list, double time0, double time1);
+    static constexpr unsigned treelet_depth = 4;    //the number of levels in each treelet for bvh_layout::breadth_first
+                                                    // - 15 nodes (~1KB) per treelet
+    static constexpr size_t traversal_stack_size = 64;  //the nodes traverse can put off (1 per level of the tree)
+
+    //eager_depth is the number of levels of the tree built immediately
+    // - below this, subtrees are only built the first time a ray enters them (see lazy_bvh)
+    // - for huge scenes where only some of the geometry is seen this saves a lot of startup time and memory
+    bvh(const hittable_list& list, double time0, double time1, bvh_layout layout = bvh_layout::depth_first,
+        unsigned eager_depth = bvh_node::full_depth);
+    bvh(const std::vector<std::shared_ptr<hittable>>& list, double time0, double time1, bvh_layout layout = bvh_layout::depth_first,
+        unsigned eager_depth = bvh_node::full_depth);
 
     bool hit_time(const ray& r, double t_min, double t_max, hit_record& rec) override {
-        bool did_hit = false;
         size_t closest_hit;
+        rec.t = t_max;
+        const bool did_hit = traverse(node_info, r, t_min, rec,
+            [&](const bvh_info& leaf) {
+                bool hit_leaf = false;
+                for (unsigned i = leaf.primitives_offset; i < leaf.primitives_offset + leaf.num_primitives; i++) {
+                    if (objs[i]->hit_time(r, t_min, rec.t, rec)) {
+                        hit_leaf = true;
+                        closest_hit = i;
+                    }
+                }
+                return hit_leaf;
+            },
+            [&](const bvh_info& leaf) {
+                prefetch(objs[leaf.primitives_offset].get());
+                prefetch(objs[leaf.primitives_offset + leaf.num_primitives - 1].get());
+            });
+
+        if (did_hit) {
+            //update rec with the closest hit
+            objs[closest_hit]->hit_info(r, t_min, rec.t, rec);
+        }
+
+        return did_hit;
+    }
+    inline void hit_info(const ray&, double, double, hit_record&) override {
+        //not needed
+    }
+
+    inline bool bounding_box([[maybe_unused]] double time0, [[maybe_unused]] double time1, aabb& output_box) const override {
+        output_box = node_info[0].box;  //node_info 0 is the source node
+        return true;
+    }
+
+    [[nodiscard]] inline size_t memory_usage() const {
+        return node_info.size() * sizeof(bvh_info) + objs.size() * sizeof(std::shared_ptr<hittable>);
+    }
+
+    //walks a flattened tree front to back
+    // - rec.t must be set to t_max, and is lowered as primitives are hit
+    // - hit_leaf(leaf) tests the primitives in a leaf (using rec.t as t_max) and returns whether any were hit
+    // - prefetch_leaf(leaf) starts loading the primitives of a leaf while its bounding box is being tested
+    // shared by every bvh whose nodes are bvh_info, whatever the primitives are
+    template <typename HitLeaf, typename PrefetchLeaf>
+    static inline bool traverse(const std::vector<bvh_info>& node_info, const ray& r, const double t_min, hit_record& rec,
+                                HitLeaf&& hit_leaf, PrefetchLeaf&& prefetch_leaf) {
+        bool did_hit = false;
         size_t current_index = 0;
-        constexpr size_t nodes_to_visit_size = 64;
-        std::array<unsigned, nodes_to_visit_size> nodes_to_visit;
+        std::array<unsigned, traversal_stack_size> nodes_to_visit;
         unsigned visiting_index = 0;
-        rec.t = t_max;
         while (true) {
             const auto curr_node = &node_info[current_index];
+            if (curr_node->is_leaf) {   //start loading the primitives while the bounding box is being tested
+                prefetch_leaf(*curr_node);
+            }
             //TODO : update aabb.hit to give the hit time on the other side of the box so t_max can be updated
             if (curr_node->box.hit(r, t_min, rec.t)) {  //if hit the bounding box
                 if (curr_node->is_leaf) {   //if at a leaf node
-                    if (objs[curr_node->primitives_offset]->hit_time(r, t_min, rec.t, rec)) { //if hit left object
+                    if (hit_leaf(*curr_node)) {
                         did_hit = true;
-                        closest_hit = curr_node->primitives_offset;
-                        //checking hitting with right object
-                        if (objs[curr_node->primitives_offset + 1]->hit_time(r, t_min, rec.t, rec)) {
-                            closest_hit = curr_node->primitives_offset+1;
-                        }
-                    } else {    //else didn't hit left object
-                        //checking hitting with right object
-                        if (objs[curr_node->primitives_offset + 1]->hit_time(r, t_min, rec.t, rec)) {
-                            did_hit = true;
-                            closest_hit = curr_node->primitives_offset+1;
-                        }
                     }
 
                     if (visiting_index == 0) break;
@@ -60,15 +123,17 @@ struct bvh : public hittable {
                 } else {    //else not at a leaf node
                     //picking what direction to travel down first
                     if (r.dir[curr_node->axis] < 0) {    //right to left
-                        nodes_to_visit[visiting_index++] = current_index + 1;
+                        nodes_to_visit[visiting_index++] = curr_node->first_child_offset;
                         current_index = curr_node->second_child_offset;
                     } else {    //else check collisions left to right
                         nodes_to_visit[visiting_index++] = curr_node->second_child_offset;
-                        current_index++;
+                        current_index = curr_node->first_child_offset;
                     }
+                    //the node that was put off will be needed soon
+                    prefetch(&node_info[nodes_to_visit[visiting_index - 1]]);
 #ifndef NDEBUG
                     //error checking
-                    if (visiting_index >= nodes_to_visit_size) {
+                    if (visiting_index >= traversal_stack_size) {
                         std::cerr << "trying to access nodes_to_visit out of range\n";
                     }
 #endif
@@ -80,49 +145,236 @@ struct bvh : public hittable {
 
         }   //end while
 
-        if (did_hit) {
-            //update rec with the closest hit
-            objs[closest_hit]->hit_info(r, t_min, rec.t, rec);
+        return did_hit;
+    }
+
+    //stores the tree rooted at node in node_info in the order given by layout
+    // - add_leaf(leaf, info) is called for every leaf in the order they are stored, and sets primitives_offset and num_primitives
+    template <typename AddLeaf>
+    static void flatten_nodes(const bvh_node* node, bvh_layout layout, std::vector<bvh_info>& node_info, AddLeaf&& add_leaf);
+
+private:
+    static void depth_first_order(const bvh_node* node, std::vector<const bvh_node*>& order);
+    static void breadth_first_order(const bvh_node* node, std::vector<const bvh_node*>& order);
+    static void van_emde_boas_order(const bvh_node* node, unsigned height, std::vector<const bvh_node*>& order);
+    static unsigned tree_height(const bvh_node* node);
+};
+
+
+//a subtree of a bvh that is only built the first time a ray enters its bounding box
+// - safe to be hit from multiple threads at once, the first thread to need the subtree builds it and the others wait
+struct lazy_bvh : public hittable {
+    aabb box;
+    const double time0, time1;
+    const bvh_layout layout;
+    const unsigned eager_depth;     //the built subtree is itself only built to this depth
+
+    //statistics over every lazy_bvh -- used to see how much of the trees were ever built
+    static inline std::atomic<size_t> num_subtrees = 0;
+    static inline std::atomic<size_t> num_built = 0;
+    static inline std::atomic<size_t> num_nodes_built = 0;
+
+    lazy_bvh() = delete;
+    lazy_bvh(std::vector<std::shared_ptr<hittable>> objects, const double _time0, const double _time1, const bvh_layout _layout, const unsigned _eager_depth)
+        : time0(_time0), time1(_time1), layout(_layout), eager_depth(_eager_depth), objs(std::move(objects)) {
+        objs[0]->bounding_box(time0, time1, box);
+        aabb temp_box;
+        for (const auto& o : objs) {
+            o->bounding_box(time0, time1, temp_box);
+            box = surrounding_box(box, temp_box);
         }
+        ++num_subtrees;
+    }
 
-        return did_hit;
+    inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+        //testing the box first so the subtree is only built if a ray actually enters it
+        if (!box.hit(r, t_min, t_max))
+            return false;
+        return get_tree()->hit_time(r, t_min, t_max, rec);  //also sets the hit info
     }
-    inline void hit_info(const ray& r, double t_min, double t_max, hit_record& rec) override {
-        //not needed
+
+    inline void hit_info(const ray&, double, double, hit_record&) override {
+        //not needed -- set in hit_time by the subtree
     }
 
-    inline bool bounding_box(double time0, double time1, aabb& output_box) const override {
-        output_box = node_info[0].box;  //node_info 0 is the source node
+    inline bool bounding_box([[maybe_unused]] const double _time0, [[maybe_unused]] const double _time1, aabb& output_box) const override {
+        output_box = box;
         return true;
     }
+
+    [[nodiscard]] inline bool is_built() const {
+        return tree.load(std::memory_order_acquire) != nullptr;
+    }
+
+    static void print_stats(std::ostream& out) {
+        if (num_subtrees == 0) return;
+        out << "lazy bvh : built " << num_built << " of " << num_subtrees << " deferred subtrees ("
+            << 100.0 * static_cast<double>(num_built) / static_cast<double>(num_subtrees) << "%) with "
+            << num_nodes_built << " nodes\n";
+    }
+
 private:
-    void flatten_tree(const std::shared_ptr<bvh_node>& node);
+    std::vector<std::shared_ptr<hittable>> objs;    //the unbuilt primitive range -- cleared once built
+    std::unique_ptr<bvh> built_tree;
+    std::atomic<bvh*> tree = nullptr;
+    std::mutex build_mutex;
+
+    inline bvh* get_tree() {
+        const auto t = tree.load(std::memory_order_acquire);
+        if (t != nullptr) [[likely]]
+            return t;
+
+        const std::lock_guard<std::mutex> lock(build_mutex);
+        if (built_tree == nullptr) {    //another thread could have built it while waiting for the lock
+            built_tree = std::make_unique<bvh>(objs, time0, time1, layout, eager_depth);
+            objs.clear();
+            objs.shrink_to_fit();
+            ++num_built;
+            num_nodes_built += built_tree->node_info.size();
+            tree.store(built_tree.get(), std::memory_order_release);
+        }
+        return built_tree.get();
+    }
 };
 
-bvh::bvh(const hittable_list& list, double time0, double time1) {
+
+bvh::bvh(const hittable_list& list, const double time0, const double time1, const bvh_layout layout, const unsigned eager_depth)
+    : bvh(list.objects, time0, time1, layout, eager_depth) {}
+
+bvh::bvh(const std::vector<std::shared_ptr<hittable>>& list, const double time0, const double time1, const bvh_layout layout, const unsigned eager_depth) {
     //first construct the bvh_tree through bvh_nodes
-    const auto source_node = std::make_shared<bvh_node>(list, time0, time1);
-    flatten_tree(source_node);
+    const auto source_node = bvh_node::build(bvh_node::primitives_of(list, time0, time1), eager_depth);
+
+    const auto objects_of = [&list](const std::vector<bvh_primitive>& prims) {
+        std::vector<std::shared_ptr<hittable>> objects;
+        objects.reserve(prims.size());
+        for (const auto& p : prims) {
+            objects.push_back(list[p.id]);
+        }
+        return objects;
+    };
+
+    //the primitives are stored in the same order as the leaves so leaves that are close in memory have primitives that are
+    // close in memory
+    flatten_nodes(source_node.get(), layout, node_info, [&](const bvh_node* n, bvh_info& leaf) {
+        leaf.primitives_offset = objs.size();
+        if (n->is_deferred) {
+            objs.push_back(std::make_shared<lazy_bvh>(objects_of(n->deferred_left), time0, time1, layout, eager_depth));
+            objs.push_back(std::make_shared<lazy_bvh>(objects_of(n->deferred_right), time0, time1, layout, eager_depth));
+        } else {
+            for (const auto id : n->ids) {
+                objs.push_back(list[id]);
+            }
+        }
+        leaf.num_primitives = objs.size() - leaf.primitives_offset;
+    });
+}
+
+template <typename AddLeaf>
+void bvh::flatten_nodes(const bvh_node* node, const bvh_layout layout, std::vector<bvh_info>& node_info, AddLeaf&& add_leaf) {
+    //finding the order the nodes are to be stored in
+    std::vector<const bvh_node*> order;
+    switch (layout) {
+        case bvh_layout::depth_first:
+            depth_first_order(node, order);
+            break;
+        case bvh_layout::breadth_first:
+            breadth_first_order(node, order);
+            break;
+        case bvh_layout::van_emde_boas:
+            van_emde_boas_order(node, tree_height(node), order);
+            break;
+    }
+
+    std::unordered_map<const bvh_node*, unsigned> index;    //where each node ends up in node_info
+    index.reserve(order.size());
+    for (unsigned i = 0; i < order.size(); i++) {
+        index[order[i]] = i;
+    }
+
+    node_info.resize(order.size());
+    for (unsigned i = 0; i < order.size(); i++) {
+        const auto n = order[i];
+        auto &curr_node = node_info[i];
+        curr_node.box = n->box;
+        curr_node.axis = n->split_axis;
+        curr_node.is_leaf = n->is_leaf;
+
+        if (n->is_leaf) {
+            add_leaf(n, curr_node);
+        } else {
+            curr_node.first_child_offset = index[n->left_node.get()];
+            curr_node.second_child_offset = index[n->right_node.get()];
+        }
+    }
+}
+
+void bvh::depth_first_order(const bvh_node* node, std::vector<const bvh_node*>& order) {
+    order.push_back(node);
+    if (!node->is_leaf) {
+        depth_first_order(node->left_node.get(), order);
+        depth_first_order(node->right_node.get(), order);
+    }
+}
+
+void bvh::breadth_first_order(const bvh_node* node, std::vector<const bvh_node*>& order) {
+    std::deque<const bvh_node*> treelet_roots{node};
+
+    while (!treelet_roots.empty()) {
+        //storing the current treelet level by level
+        std::vector<const bvh_node*> level{treelet_roots.front()};
+        treelet_roots.pop_front();
+
+        for (unsigned depth = 0; depth < treelet_depth && !level.empty(); depth++) {
+            std::vector<const bvh_node*> next_level;
+            for (const auto n : level) {
+                order.push_back(n);
+                if (n->is_leaf) continue;
+
+                if (depth + 1 < treelet_depth) {  //children are still in the current treelet
+                    next_level.push_back(n->left_node.get());
+                    next_level.push_back(n->right_node.get());
+                } else {    //children start new treelets
+                    treelet_roots.push_back(n->left_node.get());
+                    treelet_roots.push_back(n->right_node.get());
+                }
+            }
+            level = std::move(next_level);
+        }
+    }
 }
 
-void bvh::flatten_tree(const std::shared_ptr<bvh_node>& node) {
+void bvh::van_emde_boas_order(const bvh_node* node, const unsigned height, std::vector<const bvh_node*>& order) {
+    if (height <= 1 || node->is_leaf) {
+        order.push_back(node);
+        return;
+    }
 
-    node_info.emplace_back();
-    const auto curr_node = node_info.end() - 1;
-    curr_node->box = node->box;
-    curr_node->axis = node->split_axis;
-    curr_node->is_leaf = node->is_leaf;
+    //the top half of the tree is stored first
+    const unsigned top_height = height / 2;
+    const unsigned bottom_height = height - top_height;
+    van_emde_boas_order(node, top_height, order);
 
-    if (node->is_leaf) {
-        objs.push_back(node->left_obj);
-        objs.push_back(node->right_obj);
-        curr_node->primitives_offset = objs.size() - 2;
-    } else {
-        const auto up_to = node_info.size() - 1;
-        flatten_tree(node->left_node);
-        node_info[up_to].second_child_offset = node_info.size();
-        flatten_tree(node->right_node);
+    //then each of the subtrees hanging off the bottom of the top half
+    std::vector<const bvh_node*> level{node};
+    for (unsigned depth = 0; depth < top_height; depth++) {
+        std::vector<const bvh_node*> next_level;
+        for (const auto n : level) {
+            if (n->is_leaf) continue;   //already stored as part of the top half
+            next_level.push_back(n->left_node.get());
+            next_level.push_back(n->right_node.get());
+        }
+        level = std::move(next_level);
+    }
+
+    for (const auto n : level) {
+        van_emde_boas_order(n, bottom_height, order);
     }
 }
 
+unsigned bvh::tree_height(const bvh_node* node) {
+    if (node->is_leaf) return 1;
+    return 1 + std::max(tree_height(node->left_node.get()), tree_height(node->right_node.get()));
+}
+
 #endif //RAYTRACER_BVH_HPP
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <algorithm>
+#include <limits>
 
 /* ====================================================================================================================
 This can be made better (i.e. TODO)
@@ -26,22 +27,46 @@ This can be made better (i.e. TODO)
    -- still need to check collision of other nodes because bounding boxes can overlap (more generally the projection of the bounding box
      onto any axis can - and almost certainly will - overlap)
  ===============================================================================================================*/
+//what the tree is built from
+// - only the box of each primitive and an id to find it again are needed, so the same builder works for hittables
+//   (id is the index in the list) and for primitives that are not hittables (e.g. the id of a triangle in a mesh)
+struct bvh_primitive {
+    aabb box;
+    unsigned id;
+};
+
 struct bvh_node {
-    std::shared_ptr<hittable> left_obj;	//left and right nodes on the tree
-    std::shared_ptr<hittable> right_obj;
+    std::vector<unsigned> ids;	//ids of the primitives in a leaf (sorted along split_axis)
 
     std::shared_ptr<bvh_node> left_node;	//left and right nodes on the tree
     std::shared_ptr<bvh_node> right_node;
 
-    bool is_leaf = false;   //says whether the obj vars are set or the node vars
+    bool is_leaf = false;   //says whether ids is set or the node vars
+
+    //set when the tree was cut off at eager_depth
+    // - the node is then a leaf whose 2 children have not been built (only the primitives that go into them are known)
+    bool is_deferred = false;
+    std::vector<bvh_primitive> deferred_left, deferred_right;
 
 	aabb box{};			//the box for the current node
 	unsigned split_axis{}; //the axis that the objects were split along
 	                    // - second box is always along the positive axis of the first box
 
+	static constexpr unsigned full_depth = std::numeric_limits<unsigned>::max();
+	static constexpr size_t parallel_build_size = 4096;	//the fewest primitives in a subtree built as its own task
+	static constexpr size_t min_top_level_size = 8;	//the fewest objects scene::build_top_level_bvh puts in a bvh (a linear scan is faster for fewer)
+
 	bvh_node() = default;
-	bvh_node(const hittable_list& list, double time0, double time1) : bvh_node(list.objects, time0, time1) {}
-    bvh_node(const std::vector<std::shared_ptr<hittable>>& src_objects, double time0, double time1);
+	//eager_depth is the number of levels to build before the remaining subtrees are left deferred
+	//max_leaf_size is the most primitives put in a leaf -- larger for primitives that are intersected a few at a time with SIMD
+    explicit bvh_node(const std::vector<bvh_primitive>& src_primitives, unsigned eager_depth = full_depth, unsigned max_leaf_size = 2);
+
+    //builds the tree as the constructor does, but with the subtrees of large nodes built in parallel (as OpenMP tasks)
+    static std::shared_ptr<bvh_node> build(const std::vector<bvh_primitive>& src_primitives, unsigned eager_depth = full_depth,
+                                           unsigned max_leaf_size = 2);
+
+    //the primitives for a list of hittables -- the id of each is its index in the list
+    static std::vector<bvh_primitive> primitives_of(const std::vector<std::shared_ptr<hittable>>& objects, double time0, double time1);
 
     /*inline bool hit_time(const ray& r, double t_min, double t_max, hit_record& rec) override{
         if (!box.hit(r, t_min, t_max)) return false;	//if it didn't hit the large bounding box
@@ -93,41 +118,35 @@ struct bvh_node {
 };
 
 
-inline bool box_compare(const std::shared_ptr<hittable>& a, const std::shared_ptr<hittable>& b, const int axis) {
-	aabb box_a;
-	aabb box_b;
-
-	if (!a->bounding_box(0,0,box_a) || !b->bounding_box(0,0,box_b))
-		std::cerr << "No bounding box in bvh_node constructor.\n";
-
-	return box_a.mid_point()[axis] < box_b.mid_point()[axis];
+inline bool primitive_compare(const bvh_primitive& a, const bvh_primitive& b, const int axis) {
+	return a.box.mid_point()[axis] < b.box.mid_point()[axis];
 }
 
-inline bool box_x_compare (const std::shared_ptr<hittable> &a, const std::shared_ptr<hittable> &b) {
-	return box_compare(a, b, 0);
+inline bool primitive_x_compare (const bvh_primitive &a, const bvh_primitive &b) {
+	return primitive_compare(a, b, 0);
 }
 
 
-inline bool box_y_compare (const std::shared_ptr<hittable> &a, const std::shared_ptr<hittable> &b) {
-	return box_compare(a, b, 1);
+inline bool primitive_y_compare (const bvh_primitive &a, const bvh_primitive &b) {
+	return primitive_compare(a, b, 1);
 }
 
 
-inline bool box_z_compare (const std::shared_ptr<hittable> &a, const std::shared_ptr<hittable> &b) {
-	return box_compare(a, b, 2);
+inline bool primitive_z_compare (const bvh_primitive &a, const bvh_primitive &b) {
+	return primitive_compare(a, b, 2);
 }
 
 struct bucket_info {
     //unsigned count = 0;
     aabb bounds = aabb(vec3(0,0,0), vec3(0,0,0));
-    std::vector<std::shared_ptr<hittable>> objs;
+    std::vector<bvh_primitive> prims;
 
     [[nodiscard]] inline size_t count() const {
-        return objs.size();
+        return prims.size();
     }
 
-    inline void add_obj(const std::shared_ptr<hittable> &object) {
-        objs.push_back(object);
+    inline void add_prim(const bvh_primitive &prim) {
+        prims.push_back(prim);
     }
 
     inline void set_bounds(const aabb& b) {
@@ -140,88 +159,94 @@ struct bucket_info {
 };
 
 struct cost_info {
-    std::vector<std::shared_ptr<hittable>> objs0, objs1;
+    std::vector<bvh_primitive> prims0, prims1;
     aabb b0, b1;
     double cost;
 
     template <typename T>
-    void add_hittables_0(const T& objs) {
-        for (const auto& o : objs) {
-            objs0.push_back(o);
+    void add_primitives_0(const T& prims) {
+        for (const auto& p : prims) {
+            prims0.push_back(p);
         }
     }
 
     template <typename T>
-    void add_hittables_1(const T& objs) {
-        for (const auto& o : objs) {
-            objs1.push_back(o);
+    void add_primitives_1(const T& prims) {
+        for (const auto& p : prims) {
+            prims1.push_back(p);
         }
     }
 };
 
 
+std::shared_ptr<bvh_node> bvh_node::build(const std::vector<bvh_primitive>& src_primitives, const unsigned eager_depth, const unsigned max_leaf_size) {
+    std::shared_ptr<bvh_node> node;
+    #pragma omp parallel default(none) shared(node, src_primitives, eager_depth, max_leaf_size)
+    #pragma omp single
+    node = std::make_shared<bvh_node>(src_primitives, eager_depth, max_leaf_size);
+    return node;
+}
 
-bvh_node::bvh_node(const std::vector<std::shared_ptr<hittable>>& src_objects, const double time0, const double time1) {
-    const auto num_objs = src_objects.size();
+std::vector<bvh_primitive> bvh_node::primitives_of(const std::vector<std::shared_ptr<hittable>>& objects, const double time0, const double time1) {
+    std::vector<bvh_primitive> prims(objects.size());
+    for (unsigned i = 0; i < objects.size(); i++) {
+        if (!objects[i]->bounding_box(time0, time1, prims[i].box))
+            std::cerr << "No bounding box in bvh_node constructor.\n";
+        prims[i].id = i;
+    }
+    return prims;
+}
 
 
-    //if <=4, use basic splitting
-    // else use SAH
-    if (num_objs <= 4) {    //used to be 4
-        auto objs_0 = src_objects;
+bvh_node::bvh_node(const std::vector<bvh_primitive>& src_primitives, const unsigned eager_depth, const unsigned max_leaf_size) {
+    const auto num_prims = src_primitives.size();
 
-        std::vector<aabb> boxes_0;
-        boxes_0.resize(num_objs);
 
-        for (size_t i = 0; i < num_objs; i++) {
-            objs_0[i]->bounding_box(0, 0, boxes_0[i]);
-        }
+    //if <=max_leaf_size, make a leaf
+    //if <=4, use basic splitting
+    // else use SAH
+    if (num_prims <= std::max(4u, max_leaf_size)) {    //used to be 4
+        auto prims_0 = src_primitives;
 
-        box = boxes_0[0];
-        for (size_t i = 1; i < num_objs; i++) {
-            box = surrounding_box(box, boxes_0[i]);
+        box = prims_0[0].box;
+        for (size_t i = 1; i < num_prims; i++) {
+            box = surrounding_box(box, prims_0[i].box);
         }
 
         //splitting the boxes along the longest side
         split_axis = box.longest_axis();
 
         const auto comparator = (split_axis == 0)
-                                ? box_x_compare    //used to sort boxes into close and far to a given axis
-                                : (split_axis == 1) ? box_y_compare
-                                             : box_z_compare;
-        if (num_objs == 1) {		//only 1 object on node
-            //put the object in both left and right
-            left_obj = right_obj = objs_0[0];
-            is_leaf = true;
-        } else if (num_objs == 2) {	//2 objects on node
+                                ? primitive_x_compare    //used to sort boxes into close and far to a given axis
+                                : (split_axis == 1) ? primitive_y_compare
+                                             : primitive_z_compare;
+        if (num_prims == 2 && max_leaf_size >= 2) {	//2 objects on node
 
-            if (comparator(objs_0[0], objs_0[1])) {	//if the first object is closer to the random axis than the second object
-                left_obj = objs_0[0];
-                right_obj = objs_0[1];
+            if (comparator(prims_0[0], prims_0[1])) {	//if the first object is closer to the random axis than the second object
+                ids = {prims_0[0].id, prims_0[1].id};
             } else {
-                left_obj = objs_0[1];
-                right_obj = objs_0[0];
+                ids = {prims_0[1].id, prims_0[0].id};
             }
             is_leaf = true;
 
         } else {
-            std::sort(objs_0.begin(),  objs_0.end(), comparator);
-
-            const auto mid = static_cast<size_t>(num_objs /2);
-            std::vector<std::shared_ptr<hittable>> objs_left, objs_right;
-            objs_left.resize(mid);
-            objs_right.resize(num_objs-mid);
+            std::sort(prims_0.begin(),  prims_0.end(), comparator);
 
-            for (size_t i = 0; i < mid; i++) {
-                objs_left[i] = objs_0[i];
-            }
-            for (size_t i = mid; i < num_objs; i++) {
-                objs_right[i-mid] = objs_0[i];
+            if (num_prims <= max_leaf_size) {   //all of the objects fit in 1 leaf
+                for (const auto& p : prims_0) {
+                    ids.push_back(p.id);
+                }
+                is_leaf = true;
+                return;
             }
 
+            const auto mid = static_cast<size_t>(num_prims /2);
+            const std::vector<bvh_primitive> prims_left(prims_0.begin(), prims_0.begin() + mid);
+            const std::vector<bvh_primitive> prims_right(prims_0.begin() + mid, prims_0.end());
+
             is_leaf = false;
-            left_node = make_shared<bvh_node>(objs_left, time0, time1);
-            right_node = make_shared<bvh_node>(objs_right, time0, time1);
+            left_node = make_shared<bvh_node>(prims_left, eager_depth - 1, max_leaf_size);
+            right_node = make_shared<bvh_node>(prims_right, eager_depth - 1, max_leaf_size);
         }
 
      } else {
@@ -233,30 +258,24 @@ bvh_node::bvh_node(const std::vector<std::shared_ptr<hittable>>& src_objects, co
 
          for (unsigned dim = 0; dim < 3; ++dim) {
              const auto comparator = (dim == 0)
-                                     ? box_x_compare    //used to sort boxes into close and far to a given axis
-                                     : (dim == 1) ? box_y_compare
-                                                  : box_z_compare;
+                                     ? primitive_x_compare    //used to sort boxes into close and far to a given axis
+                                     : (dim == 1) ? primitive_y_compare
+                                                  : primitive_z_compare;
              constexpr size_t num_buckets = 12;   //find a good number (TODO)
              // - also allow to just have every obj in its own buffer (TODO)
-             auto objs_0 = src_objects;
-             std::sort(objs_0.begin(), objs_0.end(), comparator);
-             std::vector<aabb> boxes_0;
-             boxes_0.resize(num_objs);
-
-             for (size_t i = 0; i < num_objs; i++) {
-                 objs_0[i]->bounding_box(0, 0, boxes_0[i]);
-             }
+             auto prims_0 = src_primitives;
+             std::sort(prims_0.begin(), prims_0.end(), comparator);
 
-             const double min = boxes_0[0].mid_point()[dim];
-             const double max = boxes_0[num_objs - 1].mid_point()[dim];
+             const double min = prims_0[0].box.mid_point()[dim];
+             const double max = prims_0[num_prims - 1].box.mid_point()[dim];
              const double range = max - min;
 
              //setting buckets
              // - finding the number of objects in each bucket
              // - finding the bounds for the objects in the bucket
              std::array<bucket_info, num_buckets> buckets;
-             for (size_t i = 0; i < num_objs; i++) {
-                 const double mid_point = boxes_0[i].mid_point()[dim];
+             for (size_t i = 0; i < num_prims; i++) {
+                 const double mid_point = prims_0[i].box.mid_point()[dim];
                  if (range == 0) {
                      continue;//2 objects with same bounding box is not supported
                      //std::cout << "need to pick another axis\n";
@@ -274,8 +293,8 @@ bvh_node::bvh_node(const std::vector<std::shared_ptr<hittable>>& src_objects, co
                                          static_cast<size_t>(num_buckets - 1));//gives an index in the buckets array
                                                                      //b = num_buckets - 1 happens at the endpoints
  #endif
-                 buckets[b].add_obj(objs_0[i]);
-                 buckets[b].set_bounds(boxes_0[i]);
+                 buckets[b].add_prim(prims_0[i]);
+                 buckets[b].set_bounds(prims_0[i].box);
              }
 
              //computing the cost of each reasonable combination of buckets (i.e. all on the left or right of some point)
@@ -285,17 +304,17 @@ bvh_node::bvh_node(const std::vector<std::shared_ptr<hittable>>& src_objects, co
                  cost[i].b1 = buckets[i + 1].bounds;
                  unsigned counter0 = buckets[0].count(), counter1 = buckets[i + 1].count();
 
-                 cost[i].add_hittables_0(buckets[0].objs);
-                 cost[i].add_hittables_1(buckets[i + 1].objs);
+                 cost[i].add_primitives_0(buckets[0].prims);
+                 cost[i].add_primitives_1(buckets[i + 1].prims);
 
                  for (size_t j = 1; j <= i; j++) {
                      cost[i].b0 = surrounding_box(cost[i].b0, buckets[j].bounds);
-                     cost[i].add_hittables_0(buckets[j].objs);
+                     cost[i].add_primitives_0(buckets[j].prims);
                      counter0 += buckets[j].count();
                  }
                  for (size_t j = i + 2; j < num_buckets; j++) {
                      cost[i].b1 = surrounding_box(cost[i].b1, buckets[j].bounds);
-                     cost[i].add_hittables_1(buckets[j].objs);
+                     cost[i].add_primitives_1(buckets[j].prims);
                      counter1 += buckets[j].count();
                  }
 
@@ -309,7 +328,7 @@ bvh_node::bvh_node(const std::vector<std::shared_ptr<hittable>>& src_objects, co
              double minCost = infinity;
              int minCost_id = -1;
              for (size_t i = 0; i < cost.size(); i++) {
-                 if (cost[i].objs0.empty() || cost[i].objs1.empty()) {//is possible not the have any hittalbes in bucket
+                 if (cost[i].prims0.empty() || cost[i].prims1.empty()) {//is possible not the have any hittalbes in bucket
                      continue;
                  }
                  if (cost[i].cost < minCost) {
@@ -326,39 +345,63 @@ bvh_node::bvh_node(const std::vector<std::shared_ptr<hittable>>& src_objects, co
 
              //finding the best axis
              if (cost[minCost_id].cost < min_cost) {
-                 c = cost[minCost_id];
+                 min_cost = cost[minCost_id].cost;
+                 c = std::move(cost[minCost_id]);
                  best_dim = static_cast<int>(dim);
              }
          }
- #ifndef NDEBUG
          if (best_dim == -1) {
-             std::cerr << "could not find dimension to split axis objects\n";
+             //every object has the same mid point so there is no split SAH can make
+             // - splitting the objects in half instead
+             best_dim = 0;
+             const auto mid = static_cast<size_t>(num_prims / 2);
+             c.prims0.assign(src_primitives.begin(), src_primitives.begin() + mid);
+             c.prims1.assign(src_primitives.begin() + mid, src_primitives.end());
+             c.b0 = c.prims0[0].box;
+             c.b1 = c.prims1[0].box;
+             for (const auto& p : c.prims0) {
+                 c.b0 = surrounding_box(c.b0, p.box);
+             }
+             for (const auto& p : c.prims1) {
+                 c.b1 = surrounding_box(c.b1, p.box);
+             }
          }
- #endif
 
          box = surrounding_box(c.b0, c.b1);
          split_axis = best_dim;
 
 #ifndef NDEBUG
-        if (c.objs0.empty()) {
+        if (c.prims0.empty()) {
                  std::cerr << "creation of bvh gave 0 objects in left hittable\n";
-                 std::cerr << "\tthe right hittable got " << c.objs1.size() << " hittables\n";
+                 std::cerr << "\tthe right hittable got " << c.prims1.size() << " hittables\n";
              }
 #endif
 
 
 #ifndef NDEBUG
-        if (c.objs1.empty()) {
+        if (c.prims1.empty()) {
                  std::cerr << "creation of bvh gave 0 objects in right hittable\n";
-                 std::cerr << "\tthe left hittable got " << c.objs0.size() << " hittables\n";
+                 std::cerr << "\tthe left hittable got " << c.prims0.size() << " hittables\n";
              }
 #endif
 
 
+        if (eager_depth == 0) {
+            //leaving the children to be built when they are first needed
+            is_leaf = true;
+            is_deferred = true;
+            deferred_left = std::move(c.prims0);
+            deferred_right = std::move(c.prims1);
+            return;
+        }
+
         is_leaf = false;
          //setting the left and right objects
-         left_node = std::make_shared<bvh_node>(c.objs0, time0, time1);
-         right_node = std::make_shared<bvh_node>(c.objs1, time0, time1);
+         // - the left subtree is a task when it is large enough to be worth it (it is built straight away when not in bvh_node::build)
+         #pragma omp task default(none) shared(c) firstprivate(eager_depth, max_leaf_size) if(c.prims0.size() >= parallel_build_size)
+         left_node = std::make_shared<bvh_node>(c.prims0, eager_depth - 1, max_leaf_size);
+         right_node = std::make_shared<bvh_node>(c.prims1, eager_depth - 1, max_leaf_size);
+         #pragma omp taskwait
 
 
      }
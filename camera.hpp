@@ -42,11 +42,24 @@ class camera {
 			vertical(focus_dist * 2.0 * tan(degrees_to_radians(vfov)/2) * cross(unit_vector(lookfrom - lookat), unit_vector(cross(vup, unit_vector(lookfrom - lookat)))) ),
 			llc_m_o(- horizontal/2 - vertical/2 - focus_dist*unit_vector(lookfrom - lookat)){}
 
-	[[nodiscard]] inline ray get_ray(const double s, const double t) {
+	//spread is the angle the ray's cone widens by (see ray::footprint), e.g. pixel_spread for a ray through a pixel
+	[[nodiscard]] inline ray get_ray(const double s, const double t, const double spread = 0) {
 		//uses the thin lens approximation to generate depth of field
 		const vec3 rd = lens_radius * halton_random_in_unit_disk(halton_counter);	//randomness is required to get blur (i.e. depth of field)
 		const vec3 offset = u * rd.x() + v*rd.y();		//offset for where the light is coming from
 
-		return ray(origin + offset, llc_m_o + s*horizontal + t*vertical - offset, random_halton_1D(time0, time1, halton_counter2));	//random time to simulate motion blur
+		ray r(origin + offset, llc_m_o + s*horizontal + t*vertical - offset, random_halton_1D(time0, time1, halton_counter2));	//random time to simulate motion blur
+		r.cone_spread = spread;
+		return r;
+	}
+
+	//the shutter open/close times -- the rays' times are between them
+	[[nodiscard]] inline double shutter_open() const { return time0; }
+	[[nodiscard]] inline double shutter_close() const { return time1; }
+
+	//the angle a pixel covers when the image is image_height pixels high
+	// - the viewport is vertical.length() high at focus_dist (= -dot(llc_m_o, w)) from the camera
+	[[nodiscard]] inline double pixel_spread(const size_t image_height) const {
+		return vertical.length() / (-dot(llc_m_o, w) * static_cast<double>(image_height));
 	}
 };
@@ -0,0 +1,362 @@
+#ifndef RAYTRACER_COMPRESSED_BVH_HPP
+#define RAYTRACER_COMPRESSED_BVH_HPP
+
+#include "bvh.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+
+#ifdef __SSE4_1__
+#include <immintrin.h>
+#endif
+
+/*=====================================================================================================================
+ A bvh where every node has (up to) 4 children, and the bounding boxes of the children are stored as 8 bit offsets
+ relative to the box of the node itself
+  - https://research.nvidia.com/publication/2017-07_efficient-incoherent-ray-traversal-gpus-through-compressed-wide-bvhs
+  - a node is 64 bytes (1 cache line) and replaces ~3 of the 64 byte bvh_info nodes, so the tree is ~3-4x smaller
+  - the child boxes are rounded outwards when compressed, so they always contain the real boxes
+  - the 4 child boxes are decoded and tested against the ray at the same time using SSE (when available)
+  - the ray is tested against the boxes in single precision (the boxes are conservative so this only ever causes extra box hits)
+ ===================================================================================================================*/
+struct alignas(64) compressed_bvh_info {
+    float origin[3];        //minimum corner of the node's box
+    float scale[3];         //size of a single quantisation step along each axis
+    std::uint8_t lo[3][4];  //lo[axis][child] -- the min corner of each child is origin + lo*scale
+    std::uint8_t hi[3][4];  //the max corner of each child is origin + hi*scale
+    std::uint32_t child[4]; //the index of the child node, or a leaf (see make_leaf)
+
+    static constexpr std::uint32_t leaf_flag = 1u << 31;
+    static constexpr std::uint32_t empty = 0xFFFFFFFF;  //node has less than 4 children
+
+    //leaves are leaf_flag | num_primitives << count_shift | primitives_offset
+    static constexpr std::uint32_t count_shift = 27;
+    static constexpr std::uint32_t offset_mask = (1u << count_shift) - 1;
+
+    static inline std::uint32_t make_leaf(const std::uint32_t primitives_offset, const std::uint32_t num_primitives) {
+        return leaf_flag | (num_primitives << count_shift) | primitives_offset;
+    }
+    static inline std::uint32_t leaf_offset(const std::uint32_t c) {
+        return c & offset_mask;
+    }
+    static inline std::uint32_t leaf_count(const std::uint32_t c) {
+        return (c & ~leaf_flag) >> count_shift;
+    }
+};
+static_assert(sizeof(compressed_bvh_info) == 64, "compressed_bvh_info should be exactly 1 cache line");
+
+
+struct compressed_bvh : public hittable {
+    std::vector<std::shared_ptr<hittable>> objs;  //filled in the order they appear when constructing the tree
+                                                  // - a leaf's primitives are a run of objs, see leaf_offset and leaf_count
+    std::vector<compressed_bvh_info> node_info;
+    aabb box;
+
+    static constexpr size_t traversal_stack_size = 128; //the children traverse can put off -- up to 4 per level
+
+    //as for bvh, the subtrees below eager_depth are built when first hit (these subtrees are built as a standard bvh)
+    compressed_bvh(const hittable_list& list, double time0, double time1, unsigned eager_depth = bvh_node::full_depth);
+
+    bool hit_time(const ray& r, double t_min, double t_max, hit_record& rec) override {
+        size_t closest_hit;
+        rec.t = t_max;
+        const bool did_hit = traverse(node_info, r, t_min, rec,
+            [&](const std::uint32_t leaf) {
+                bool hit_leaf = false;
+                const auto offset = compressed_bvh_info::leaf_offset(leaf);
+                for (auto i = offset; i < offset + compressed_bvh_info::leaf_count(leaf); i++) {
+                    if (objs[i]->hit_time(r, t_min, rec.t, rec)) {
+                        hit_leaf = true;
+                        closest_hit = i;
+                    }
+                }
+                return hit_leaf;
+            },
+            [&](const std::uint32_t leaf) {
+                prefetch(objs[compressed_bvh_info::leaf_offset(leaf)].get());
+            });
+
+        if (did_hit) {
+            //update rec with the closest hit
+            objs[closest_hit]->hit_info(r, t_min, rec.t, rec);
+        }
+
+        return did_hit;
+    }
+
+    inline void hit_info(const ray&, double, double, hit_record&) override {
+        //not needed
+    }
+
+    inline bool bounding_box([[maybe_unused]] double time0, [[maybe_unused]] double time1, aabb& output_box) const override {
+        output_box = box;
+        return true;
+    }
+
+    [[nodiscard]] inline size_t memory_usage() const {
+        return node_info.size() * sizeof(compressed_bvh_info) + objs.size() * sizeof(std::shared_ptr<hittable>);
+    }
+
+    //walks a compressed tree, closest children first
+    // - the same as bvh::traverse, but leaves are given as their entry in compressed_bvh_info::child
+    template <typename HitLeaf, typename PrefetchLeaf>
+    static bool traverse(const std::vector<compressed_bvh_info>& node_info, const ray& r, double t_min, hit_record& rec,
+                         HitLeaf&& hit_leaf, PrefetchLeaf&& prefetch_leaf);
+
+    //collapses the binary tree rooted at node into node_info[index] and its descendants
+    // - add_leaf(leaf) is called for every leaf and returns its entry in compressed_bvh_info::child (see make_leaf)
+    template <typename AddLeaf>
+    static void build_nodes(const bvh_node* node, size_t index, std::vector<compressed_bvh_info>& node_info, AddLeaf&& add_leaf);
+
+private:
+    static void quantise_axis(double parent_min, double parent_max, const std::vector<aabb>& boxes, unsigned axis, compressed_bvh_info& info);
+
+    //finds which of the 4 children the ray hits, and the time it enters each of them
+    static inline unsigned intersect_children(const compressed_bvh_info& node, const float origin[3], const float inv_dir[3],
+                                              float t_min, float t_max, float t_near[4]);
+};
+
+
+compressed_bvh::compressed_bvh(const hittable_list& list, const double time0, const double time1, const unsigned eager_depth) {
+    const auto source_node = bvh_node::build(bvh_node::primitives_of(list.objects, time0, time1), eager_depth);
+    box = source_node->box;
+
+    const auto objects_of = [&list](const std::vector<bvh_primitive>& prims) {
+        std::vector<std::shared_ptr<hittable>> objects;
+        objects.reserve(prims.size());
+        for (const auto& p : prims) {
+            objects.push_back(list.objects[p.id]);
+        }
+        return objects;
+    };
+
+    node_info.emplace_back();
+    build_nodes(source_node.get(), 0, node_info, [&](const bvh_node* n) {
+        const auto offset = static_cast<std::uint32_t>(objs.size());
+        if (n->is_deferred) {
+            objs.push_back(std::make_shared<lazy_bvh>(objects_of(n->deferred_left), time0, time1, bvh_layout::depth_first, eager_depth));
+            objs.push_back(std::make_shared<lazy_bvh>(objects_of(n->deferred_right), time0, time1, bvh_layout::depth_first, eager_depth));
+        } else {
+            for (const auto id : n->ids) {
+                objs.push_back(list.objects[id]);
+            }
+        }
+        return compressed_bvh_info::make_leaf(offset, objs.size() - offset);
+    });
+}
+
+template <typename AddLeaf>
+void compressed_bvh::build_nodes(const bvh_node* node, const size_t index, std::vector<compressed_bvh_info>& node_info, AddLeaf&& add_leaf) {
+    //collapsing the binary tree into a 4-wide tree
+    // - repeatedly opening up the largest interior child until there are 4 children (or only leaves are left)
+    std::vector<const bvh_node*> children;
+    if (node->is_leaf) {    //only happens if the entire tree is a single leaf
+        children.push_back(node);
+    } else {
+        children.push_back(node->left_node.get());
+        children.push_back(node->right_node.get());
+    }
+
+    while (children.size() < 4) {
+        int largest = -1;
+        double largest_area = -1;
+        for (size_t i = 0; i < children.size(); i++) {
+            if (!children[i]->is_leaf && children[i]->box.surface_area() > largest_area) {
+                largest_area = children[i]->box.surface_area();
+                largest = static_cast<int>(i);
+            }
+        }
+        if (largest == -1) break;   //all children are leaves
+
+        const auto opened = children[largest];
+        children[largest] = opened->left_node.get();
+        children.insert(children.begin() + largest + 1, opened->right_node.get());
+    }
+
+    compressed_bvh_info info{};
+    std::vector<aabb> boxes;
+    for (const auto c : children) {
+        boxes.push_back(c->box);
+    }
+    for (unsigned axis = 0; axis < 3; axis++) {
+        quantise_axis(node->box.min()[axis], node->box.max()[axis], boxes, axis, info);
+    }
+
+    std::vector<std::pair<const bvh_node*, size_t>> to_build;  //children that are interior nodes
+    for (size_t i = 0; i < 4; i++) {
+        if (i >= children.size()) {
+            info.child[i] = compressed_bvh_info::empty;
+            continue;
+        }
+
+        const auto c = children[i];
+        if (c->is_leaf) {
+            info.child[i] = add_leaf(c);
+        } else {
+            //siblings are stored next to each other
+            info.child[i] = static_cast<std::uint32_t>(node_info.size());
+            to_build.emplace_back(c, node_info.size());
+            node_info.emplace_back();
+        }
+    }
+    node_info[index] = info;
+
+    for (const auto& [c, i] : to_build) {
+        build_nodes(c, i, node_info, add_leaf);
+    }
+}
+
+void compressed_bvh::quantise_axis(const double parent_min, const double parent_max, const std::vector<aabb>& boxes, const unsigned axis,
+                                   compressed_bvh_info& info) {
+    //origin and scale are rounded so that origin <= parent_min and origin + 255*scale >= parent_max
+    auto origin = static_cast<float>(parent_min);
+    if (origin > parent_min) origin = std::nextafter(origin, -FLT_MAX);
+
+    auto scale = std::max(static_cast<float>((parent_max - origin) / 255.0), FLT_MIN);
+    while (origin + 255.0f * scale < parent_max) scale = std::nextafter(scale, FLT_MAX);
+
+    info.origin[axis] = origin;
+    info.scale[axis] = scale;
+
+    for (size_t i = 0; i < 4; i++) {
+        if (i >= boxes.size()) {    //empty children are never hit anyway
+            info.lo[axis][i] = 255;
+            info.hi[axis][i] = 0;
+            continue;
+        }
+
+        //rounding outwards so the quantised box contains the real box
+        auto lo = static_cast<int>(std::clamp(std::floor((boxes[i].min()[axis] - origin) / scale), 0.0, 255.0));
+        auto hi = static_cast<int>(std::clamp(std::ceil((boxes[i].max()[axis] - origin) / scale), 0.0, 255.0));
+        while (lo > 0 && origin + static_cast<float>(lo) * scale > boxes[i].min()[axis]) lo--;
+        while (hi < 255 && origin + static_cast<float>(hi) * scale < boxes[i].max()[axis]) hi++;
+
+        info.lo[axis][i] = static_cast<std::uint8_t>(lo);
+        info.hi[axis][i] = static_cast<std::uint8_t>(hi);
+    }
+}
+
+
+inline unsigned compressed_bvh::intersect_children(const compressed_bvh_info& node, const float origin[3], const float inv_dir[3],
+                                                   const float t_min, const float t_max, float t_near[4]) {
+    //slightly enlarging the exit time so rounding in single precision cannot cause a box to be missed
+    constexpr float t_far_scale = 1.0f + 1e-5f;
+#ifdef __SSE4_1__
+    __m128 t_n = _mm_set1_ps(t_min);
+    __m128 t_f = _mm_set1_ps(t_max);
+
+    for (unsigned axis = 0; axis < 3; axis++) {
+        //decoding the 4 boxes along the current axis
+        std::int32_t lo_bytes, hi_bytes;
+        std::memcpy(&lo_bytes, node.lo[axis], 4);
+        std::memcpy(&hi_bytes, node.hi[axis], 4);
+        const __m128 lo_q = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(lo_bytes)));
+        const __m128 hi_q = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(hi_bytes)));
+
+        const __m128 o = _mm_set1_ps(node.origin[axis]);
+        const __m128 s = _mm_set1_ps(node.scale[axis]);
+        const __m128 lo = _mm_add_ps(o, _mm_mul_ps(lo_q, s));
+        const __m128 hi = _mm_add_ps(o, _mm_mul_ps(hi_q, s));
+
+        //same slab test as aabb::hit
+        const __m128 ray_o = _mm_set1_ps(origin[axis]);
+        const __m128 inv_d = _mm_set1_ps(inv_dir[axis]);
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, ray_o), inv_d);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, ray_o), inv_d);
+
+        t_n = _mm_max_ps(t_n, _mm_min_ps(t0, t1));
+        t_f = _mm_min_ps(t_f, _mm_max_ps(t0, t1));
+    }
+
+    _mm_storeu_ps(t_near, t_n);
+    const auto hit = _mm_cmple_ps(t_n, _mm_mul_ps(t_f, _mm_set1_ps(t_far_scale)));
+    return static_cast<unsigned>(_mm_movemask_ps(hit));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < 4; i++) {
+        float t_n = t_min, t_f = t_max;
+        for (unsigned axis = 0; axis < 3; axis++) {
+            const float lo = node.origin[axis] + static_cast<float>(node.lo[axis][i]) * node.scale[axis];
+            const float hi = node.origin[axis] + static_cast<float>(node.hi[axis][i]) * node.scale[axis];
+            const float t0 = (lo - origin[axis]) * inv_dir[axis];
+            const float t1 = (hi - origin[axis]) * inv_dir[axis];
+            t_n = std::max(t_n, std::min(t0, t1));
+            t_f = std::min(t_f, std::max(t0, t1));
+        }
+        t_near[i] = t_n;
+        if (t_n <= t_f * t_far_scale) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+
+template <typename HitLeaf, typename PrefetchLeaf>
+bool compressed_bvh::traverse(const std::vector<compressed_bvh_info>& node_info, const ray& r, const double t_min, hit_record& rec,
+                              HitLeaf&& hit_leaf, PrefetchLeaf&& prefetch_leaf) {
+    float origin[3], inv_dir[3];
+    for (unsigned axis = 0; axis < 3; axis++) {
+        origin[axis] = static_cast<float>(r.orig[axis]);
+        inv_dir[axis] = 1.0f / static_cast<float>(r.dir[axis]);
+    }
+
+    struct stack_entry {
+        std::uint32_t child;
+        float t_near;   //the time the ray enters the child's box -- can skip the child if something closer has already been hit
+    };
+    std::array<stack_entry, traversal_stack_size> to_visit;
+    unsigned visiting_index = 0;
+    to_visit[visiting_index++] = {0, static_cast<float>(t_min)};
+
+    bool did_hit = false;
+
+    while (visiting_index > 0) {
+        const auto curr = to_visit[--visiting_index];
+        if (curr.t_near > rec.t + 1e-5 * std::abs(rec.t)) continue;
+
+        if (curr.child & compressed_bvh_info::leaf_flag) {
+            if (hit_leaf(curr.child)) {
+                did_hit = true;
+            }
+            continue;
+        }
+
+        const auto& node = node_info[curr.child];
+        float t_near[4];
+        unsigned mask = intersect_children(node, origin, inv_dir, static_cast<float>(t_min), static_cast<float>(rec.t), t_near);
+
+        //sorting the hit children so the closest is visited first (i.e. pushed last)
+        std::array<unsigned, 4> hit_children;
+        unsigned num_hit = 0;
+        for (unsigned i = 0; i < 4; i++) {
+            if ((mask & (1u << i)) && node.child[i] != compressed_bvh_info::empty) {
+                unsigned j = num_hit++;
+                while (j > 0 && t_near[hit_children[j - 1]] < t_near[i]) {
+                    hit_children[j] = hit_children[j - 1];
+                    j--;
+                }
+                hit_children[j] = i;
+            }
+        }
+
+        for (unsigned i = 0; i < num_hit; i++) {
+            const auto c = hit_children[i];
+            if (node.child[c] & compressed_bvh_info::leaf_flag) {
+                prefetch_leaf(node.child[c]);
+            } else {
+                prefetch(&node_info[node.child[c]]);
+            }
+            to_visit[visiting_index++] = {node.child[c], t_near[c]};
+        }
+#ifndef NDEBUG
+        if (visiting_index + 4 >= traversal_stack_size) {
+            std::cerr << "trying to access to_visit out of range in compressed_bvh\n";
+        }
+#endif
+    }
+
+    return did_hit;
+}
+
+#endif //RAYTRACER_COMPRESSED_BVH_HPP
@@ -77,7 +77,7 @@ void constant_medium::hit_info(const ray& r, const double t_min, const double t_
     rec.p = r.at(rec.t);
     rec.normal = vec3(1,0,0);	//arbitrary
     rec.front_face = true;		//arbitrary
-    rec.mat_ptr = phase_function;
+    rec.mat_ptr = phase_function.get();
 }
 
 
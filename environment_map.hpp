@@ -0,0 +1,164 @@
+#ifndef RAYTRACER_ENVIRONMENT_MAP_HPP
+#define RAYTRACER_ENVIRONMENT_MAP_HPP
+
+#include "helpful.hpp"
+#include "probability.hpp"
+#include "stb_image_ne.hpp"
+#include "vec3.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================================================================
+ The light coming from far away in every direction (a sky, a room around the scene), as a high dynamic range image
+  - the image is latitude-longitude: across is the angle around the y axis and down is from +y to -y, the same u and v as
+    sphere::get_sphere_uv with the top row of the image up
+  - colours are linear and not clamped (e.g. a .hdr file), a direction gets the colour of the texel it is in
+  - random picks directions in proportion to the brightness of their texels, so the few bright texels of a sun are found
+    far more often than by sampling materials -- pdf_value is its density over solid angle
+  - the rows are picked from the total of each row (the marginal distribution) then a texel from the texels of the row (the
+    conditional distribution), each by inverting its cumulative distribution
+ ===================================================================================================================*/
+class environment_map {
+public:
+    environment_map() = delete;
+
+    //a .hdr file (or any image stb_image reads), its colours times scale
+    explicit environment_map(const std::string& file_name, double scale = 1.0);
+
+    //width by height texels, in rows from the top
+    environment_map(int width, int height, std::vector<color> texels);
+
+    [[nodiscard]] color value(const vec3& direction) const {
+        const auto [column, row] = texel_of(direction);
+        return texels[row * width + column];
+    }
+
+    [[nodiscard]] double pdf_value(const vec3& direction) const;
+    [[nodiscard]] vec3 random() const;
+
+    [[nodiscard]] int image_width() const {return width;}
+    [[nodiscard]] int image_height() const {return height;}
+
+private:
+    int width = 0, height = 0;
+    std::vector<color> texels;
+
+    //cumulative distributions, each starting at 0 and ending at 1
+    std::vector<double> row_cdf;        //height + 1 of them
+    std::vector<double> column_cdf;     //width + 1 per row
+    std::vector<double> texel_density;  //of each texel's (u, v) over the unit square
+
+    void build_distribution();
+
+    [[nodiscard]] std::pair<int, int> texel_of(const vec3& direction) const;
+
+    //a point in [0, count) picked by the cumulative distribution, from r in [0, 1)
+    static double sample(const double* cdf, size_t count, double r);
+};
+
+
+environment_map::environment_map(const std::string& file_name, const double scale) {
+    int components_per_pixel = 3;
+    float* data = stbi_loadf(file_name.c_str(), &width, &height, &components_per_pixel, 3);   //reading the data from disk
+
+    if (!data) {	//file not read -- black, so the scene still renders
+        std::cerr << "ERROR: Could not load environment map file '" << file_name << "'.\n";
+        width = height = 1;
+        texels.assign(1, color(0, 0, 0));
+    }
+    else {
+        texels.resize(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < texels.size(); i++) texels[i] = scale * color(data[3*i], data[3*i + 1], data[3*i + 2]);
+        stbi_image_free(data);
+    }
+    build_distribution();
+}
+
+environment_map::environment_map(const int _width, const int _height, std::vector<color> _texels)
+        : width(_width), height(_height), texels(std::move(_texels)) {
+    build_distribution();
+}
+
+void environment_map::build_distribution() {
+    //each texel is weighted by its brightness and the solid angle it covers (which goes as sin theta)
+    std::vector<double> weights(texels.size());
+    double total = 0;
+    for (int row = 0; row < height; row++) {
+        const double sin_theta = std::sin(pi * (row + 0.5) / height);
+        for (int column = 0; column < width; column++) {
+            const auto& c = texels[row * width + column];
+            const double luminance = 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+            weights[row * width + column] = std::max(luminance, 0.0) * sin_theta;
+            total += weights[row * width + column];
+        }
+    }
+    if (total <= 0) {   //all black -- uniform over the sphere instead, so random and pdf_value still agree
+        for (int row = 0; row < height; row++) {
+            std::fill_n(weights.begin() + row * width, width, std::sin(pi * (row + 0.5) / height));
+        }
+    }
+
+    row_cdf.assign(height + 1, 0.0);
+    column_cdf.assign(static_cast<size_t>(width + 1) * height, 0.0);
+    texel_density.assign(texels.size(), 0.0);
+    for (int row = 0; row < height; row++) {
+        double* const columns = &column_cdf[static_cast<size_t>(row) * (width + 1)];
+        for (int column = 0; column < width; column++) columns[column + 1] = columns[column] + weights[row * width + column];
+        row_cdf[row + 1] = row_cdf[row] + columns[width];
+    }
+    const double sum = row_cdf[height];
+    for (int row = 0; row < height; row++) {
+        double* const columns = &column_cdf[static_cast<size_t>(row) * (width + 1)];
+        const double row_total = columns[width];
+        for (int column = 0; column <= width; column++) {
+            columns[column] = row_total > 0 ? columns[column] / row_total : static_cast<double>(column) / width;
+        }
+        for (int column = 0; column < width; column++) {
+            texel_density[row * width + column] = weights[row * width + column] / sum * width * height;
+        }
+    }
+    for (auto& c : row_cdf) c /= sum;
+}
+
+std::pair<int, int> environment_map::texel_of(const vec3& direction) const {
+    const auto d = unit_vector(direction);
+    const auto theta = std::acos(std::clamp(-d.y(), -1.0, 1.0));
+    const auto phi = std::atan2(-d.z(), d.x()) + pi;
+    const auto column = std::clamp(static_cast<int>(phi / two_pi * width), 0, width - 1);
+    const auto row = std::clamp(static_cast<int>((1 - theta / pi) * height), 0, height - 1);
+    return {column, row};
+}
+
+double environment_map::pdf_value(const vec3& direction) const {
+    const auto [column, row] = texel_of(direction);
+    const double sin_theta = std::sqrt(std::max(0.0, 1 - unit_vector(direction).y() * unit_vector(direction).y()));
+    if (sin_theta <= 0) return 0;
+
+    //(u, v) covers the sphere as phi = 2 pi u and theta = pi v, so a solid angle of 2 pi^2 sin theta du dv
+    return texel_density[row * width + column] / (2 * pi * pi * sin_theta);
+}
+
+vec3 environment_map::random() const {
+    const double y = sample(row_cdf.data(), height, random_double());
+    const auto row = std::min(static_cast<int>(y), height - 1);
+    const double x = sample(&column_cdf[static_cast<size_t>(row) * (width + 1)], width, random_double());
+
+    //back from (u, v) to a direction, the inverse of texel_of
+    const double phi = two_pi * x / width, theta = pi * (1 - y / height);
+    const double sin_theta = std::sin(theta);
+    return vec3(-sin_theta * std::cos(phi), -std::cos(theta), sin_theta * std::sin(phi));
+}
+
+double environment_map::sample(const double* const cdf, const size_t count, const double r) {
+    //the last entry at or below r, skipping entries of no weight
+    const auto i = std::min(static_cast<size_t>(std::upper_bound(cdf, cdf + count + 1, r) - cdf), count) - 1;
+    const double width = cdf[i + 1] - cdf[i];
+    return static_cast<double>(i) + (width > 0 ? (r - cdf[i]) / width : 0.5);
+}
+
+#endif //RAYTRACER_ENVIRONMENT_MAP_HPP
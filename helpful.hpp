@@ -14,6 +14,14 @@ inline double degrees_to_radians(double degrees) {
 	return degrees * pi / 180.0;
 }
 
+//hint to the cpu to start bringing the cache line containing addr into cache
+// - only a hint, so is safe to call on any address (including nullptr)
+inline void prefetch(const void* addr) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(addr);
+#endif
+}
+
 template<typename T>
 inline double mean(const T& vals) {
     return std::accumulate(vals.begin(), vals.end(), 0.0) / vals.size();
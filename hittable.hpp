@@ -8,11 +8,13 @@ struct material;
 struct hit_record {
 	point3 p;	//point where hit
 	vec3 normal;	//normal at hit point
-	std::shared_ptr<material> mat_ptr;
+	material* mat_ptr = nullptr;	//not owned -- the object hit keeps its material, so copying hits is free
 	double t;	//time point was hit
 	bool front_face;	//did the hit happen on the front or back of the face
 	double u;	//uv coords for textures
 	double v;
+	unsigned primitive_id;	//which part of an object was hit (e.g. the triangle of a mesh) -- set in hit_time to be used by hit_info
+	double uv_footprint = 0;	//the width of the ray's cone at the hit in uv coords, for filtering textures (0 for no filtering)
 
 	inline void set_face_normal(const ray& r, const vec3& outward_normal) { //function to set normal and front_face
 		front_face = dot(r.direction(), outward_normal) < 0;	//if the ray direction points against the normal, the ray collided with the front
@@ -20,6 +22,12 @@ struct hit_record {
 									//if the ray collides with the front, the normal is fine
 									//if the ray collides with the back, the normal needs to be flipped
 	}
+
+	//uv_per_length is how fast the uv coords change with distance along the surface at the hit (e.g. 1/width for a rectangle)
+	// - the cone is not stretched for rays at a grazing angle, so textures are not blurred there
+	inline void set_uv_footprint(const ray& r, const double uv_per_length) {
+		uv_footprint = r.has_cone() ? r.footprint(t) * uv_per_length : 0;
+	}
 };
 
 //hitting needs to be updated
@@ -48,7 +56,8 @@ struct translate : public hittable {
 	translate(std::shared_ptr<hittable> p, const vec3& displacement) : ptr(std::move(p)), offset(displacement) {}
 
 	inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
-		const ray moved_r(r.origin() - offset, r.direction(), r.time());	//moving object by offset is same as translating axes by -offset
+		ray moved_r = r;	//keeps the time and cone of r
+		moved_r.orig = r.orig - offset;	//moving object by offset is same as translating axes by -offset
 		
 		if(!ptr->hit_time(moved_r, t_min, t_max, rec))	//if ray doesn't hits object in new axes
 			return false;
@@ -57,10 +66,10 @@ struct translate : public hittable {
 	}
 
     inline void hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
-        const ray moved_r(r.origin() - offset, r.direction(), r.time());	//moving object by offset is same as translating axes by -offset
+        ray moved_r = r;
+        moved_r.orig = r.orig - offset;	//moving object by offset is same as translating axes by -offset
         ptr->hit_info(moved_r, t_min, t_max, rec);
-        rec.p += offset;
-        rec.set_face_normal(moved_r, rec.normal);
+        rec.p += offset;    //the normal (and so front_face) is unchanged by a translation
 	}
 
 	inline bool bounding_box(const double time0, const double time1, aabb& output_box) const override {
@@ -90,6 +99,9 @@ struct rotate_y : public hittable {
 		output_box = bbox;
 		return hasbox;
 	}
+
+private:
+	[[nodiscard]] ray rotated_ray(const ray& r) const;
 };
 
 rotate_y::rotate_y(std::shared_ptr<hittable> p, const double angle) : ptr(std::move(p)), sin_theta(sin(degrees_to_radians(angle))), cos_theta(cos(degrees_to_radians(angle))) {
@@ -124,23 +136,12 @@ rotate_y::rotate_y(std::shared_ptr<hittable> p, const double angle) : ptr(std::m
 }
 
 bool rotate_y::hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) {
-	auto origin = r.origin();
-	auto direction = r.direction();
-	
-	//rotation of ray using Euler angles
-	// - changing basis is the same as rotation
-	origin[0] = cos_theta*r.origin()[0] - sin_theta*r.origin()[2];
-	origin[2] = sin_theta*r.origin()[0] + cos_theta*r.origin()[2];
-
-	direction[0] = cos_theta*r.direction()[0] - sin_theta*r.direction()[2];
-	direction[2] = sin_theta*r.direction()[0] + cos_theta*r.direction()[2];
-
-	const ray rotated_r(origin, direction, r.time());	//where the ray is coming from in the new frame
-
-	if (!ptr->hit_time(rotated_r, t_min, t_max, rec))	//if the ray doesn't hit in the new frame
-		return false;				//also sets rec
+	//the point and normal are only rotated in hit_info, once the hit is known to be the closest
+	return ptr->hit_time(rotated_ray(r), t_min, t_max, rec);
+}
 
-    ptr->hit_info(rotated_r, t_min, t_max, rec);
+void rotate_y::hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) {
+    ptr->hit_info(rotated_ray(r), t_min, t_max, rec);
 	auto p = rec.p; //temporary variable
 	auto normal = rec.normal;
 
@@ -152,13 +153,21 @@ bool rotate_y::hit_time(const ray& r, const double t_min, const double t_max, hi
 	normal[2] = -sin_theta*rec.normal[0] + cos_theta*rec.normal[2];
 
 	rec.p = p;
-	rec.set_face_normal(rotated_r, normal);
-
-	return true;
+	rec.normal = normal;	//a rotation doesn't change which side of the surface the ray is on, so front_face is unchanged
 }
 
-void rotate_y::hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) {
-    //inefficent to do any computations here
+ray rotate_y::rotated_ray(const ray& r) const {
+	ray rotated = r;	//keeps the time and cone of r (a rotation does not change the cone)
+
+	//rotation of ray using Euler angles
+	// - changing basis is the same as rotation
+	rotated.orig[0] = cos_theta*r.origin()[0] - sin_theta*r.origin()[2];
+	rotated.orig[2] = sin_theta*r.origin()[0] + cos_theta*r.origin()[2];
+
+	rotated.dir[0] = cos_theta*r.direction()[0] - sin_theta*r.direction()[2];
+	rotated.dir[2] = sin_theta*r.direction()[0] + cos_theta*r.direction()[2];
+
+	return rotated;	//where the ray is coming from in the new frame
 }
 
 
@@ -0,0 +1,324 @@
+#ifndef RAYTRACER_INDEXED_BVH_HPP
+#define RAYTRACER_INDEXED_BVH_HPP
+
+#include "bvh.hpp"
+#include "compressed_bvh.hpp"
+
+//standard : the binary bvh with double precision boxes (bvh)
+//compressed : 4-wide nodes with 8 bit child boxes (compressed_bvh) -- ~3-4x less memory for a little more work decoding the boxes
+enum class bvh_format {standard, compressed};
+
+//how the bvh for a mesh is built
+struct bvh_settings {
+    bvh_format format = bvh_format::standard;
+    bvh_layout layout = bvh_layout::depth_first;    //the order the nodes are stored in memory (only used by the standard format)
+    unsigned eager_depth = bvh_node::full_depth;    //the number of levels to build before rendering starts
+};
+
+//the nodes of a fully built indexed_bvh, so the tree can be saved and made again without building it (see mesh_file.hpp)
+// - the primitives must be stored in the order they were left in by the build
+struct stored_bvh {
+    bvh_settings settings;
+    aabb box;
+    std::vector<bvh_info> nodes;                        //bvh_format::standard
+    std::vector<compressed_bvh_info> compressed_nodes;  //bvh_format::compressed
+};
+
+
+/*=====================================================================================================================
+ A bvh over primitives that are not hittables (e.g. the triangles of a mesh)
+  - the primitives are only referred to by their index, so there is no pointer (or virtual call) per primitive
+  - the primitives are put in the same order as the leaves, so every leaf covers a contiguous range of them
+  - leaves refer to a leaf_block made by the primitives for that range, so leaves can be intersected with SIMD
+  - uses the same nodes (and traversal) as bvh and compressed_bvh, picked by bvh_settings::format
+  - subtrees below bvh_settings::eager_depth are built the first time a ray enters them (as for lazy_bvh)
+
+ Primitives must provide
+  - static constexpr unsigned leaf_size
+        the most primitives in a leaf
+  - leaf_block
+        whatever is needed to intersect the primitives of a leaf together (e.g. their data packed for SIMD)
+  - leaf_block make_leaf_block(unsigned first, unsigned count) const
+        called for the primitives [first, first + count) of each leaf (after they have been reordered)
+  - bool hit_leaf_block(const leaf_block& block, const ray& r, double t_min, hit_record& rec, unsigned& closest) const
+        tests the primitives of a leaf using rec.t as t_max, and lowers rec.t and sets closest to the closest primitive hit
+  - void reorder_primitives(unsigned first, const std::vector<unsigned>& ids)
+        moves primitive ids[k] to first + k (ids is a permutation of [first, first + ids.size()) )
+ ===================================================================================================================*/
+template <typename Primitives>
+struct indexed_bvh {
+    aabb box;
+
+    indexed_bvh() = delete;
+    //prims are the primitives in [first, first + prims.size()), the ids of prims are their current index
+    // - the primitives are reordered when the tree is built
+    indexed_bvh(Primitives& primitives, const std::vector<bvh_primitive>& prims, unsigned first, const bvh_settings& _settings);
+    //a tree that was built before -- only the leaf blocks are made
+    indexed_bvh(Primitives& primitives, stored_bvh stored);
+
+    //finds the closest primitive hit (closest) and lowers rec.t to its hit time
+    // - rec.t must be set to t_max
+    inline bool hit(const ray& r, double t_min, hit_record& rec, unsigned& closest) const;
+
+    //the memory used by the nodes and leaf blocks (including any subtrees that have been built)
+    [[nodiscard]] size_t memory_usage() const;
+
+    //false if any subtrees were deferred (bvh_settings::eager_depth), these trees can not be stored
+    [[nodiscard]] inline bool is_fully_built() const {
+        return subtrees.empty();
+    }
+
+    [[nodiscard]] stored_bvh store() const;
+
+    //whether stored is a tree that can be made again over num_primitives primitives (e.g. one read from a file)
+    // - every node is below the root once, the leaves hold 1 to leaf_size primitives and together hold all of them,
+    //   and the tree is shallow enough to be traversed
+    static bool is_valid(const stored_bvh& stored, size_t num_primitives);
+
+private:
+    struct lazy_subtree;
+
+    Primitives& primitives;
+    const bvh_settings settings;
+    std::vector<bvh_info> node_info;                        //bvh_format::standard
+    std::vector<compressed_bvh_info> compressed_node_info;  //bvh_format::compressed
+    std::vector<typename Primitives::leaf_block> blocks;    //leaves refer to these
+    std::vector<std::unique_ptr<lazy_subtree>> subtrees;    //leaves with no primitives refer to these instead
+
+    //tests the block of a leaf, or the subtree when num_primitives is 0
+    inline bool hit_leaf(unsigned offset, unsigned num_primitives, const ray& r, double t_min, hit_record& rec, unsigned& closest) const;
+};
+
+
+//a deferred subtree of an indexed_bvh -- the primitives have their final range, but the order in that range is not set yet
+template <typename Primitives>
+struct indexed_bvh<Primitives>::lazy_subtree {
+    const unsigned first;
+
+    lazy_subtree(std::vector<bvh_primitive> _prims, const unsigned _first) : first(_first), prims(std::move(_prims)) {
+        ++lazy_bvh::num_subtrees;
+    }
+
+    inline const indexed_bvh* get_tree(Primitives& primitives, const bvh_settings& settings) {
+        const auto t = tree.load(std::memory_order_acquire);
+        if (t != nullptr) [[likely]]
+            return t;
+
+        const std::lock_guard<std::mutex> lock(build_mutex);
+        if (built_tree == nullptr) {    //another thread could have built it while waiting for the lock
+            built_tree = std::make_unique<indexed_bvh>(primitives, prims, first, settings);
+            prims.clear();
+            prims.shrink_to_fit();
+            ++lazy_bvh::num_built;
+            lazy_bvh::num_nodes_built += built_tree->node_info.size() + built_tree->compressed_node_info.size();
+            tree.store(built_tree.get(), std::memory_order_release);
+        }
+        return built_tree.get();
+    }
+
+    [[nodiscard]] inline const indexed_bvh* built() const {
+        return tree.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<bvh_primitive> prims;
+    std::unique_ptr<indexed_bvh> built_tree;
+    std::atomic<indexed_bvh*> tree = nullptr;
+    std::mutex build_mutex;
+};
+
+
+template <typename Primitives>
+indexed_bvh<Primitives>::indexed_bvh(Primitives& _primitives, const std::vector<bvh_primitive>& prims, const unsigned first,
+                                     const bvh_settings& _settings) : primitives(_primitives), settings(_settings) {
+    const auto source_node = bvh_node::build(prims, settings.eager_depth, Primitives::leaf_size);
+    box = source_node->box;
+
+    //ids[k] is the primitive that ends up at first + k
+    std::vector<unsigned> ids;
+    ids.reserve(prims.size());
+    std::vector<std::pair<unsigned, unsigned>> leaf_ranges;   //the primitives of each leaf -- made into blocks once reordered
+
+    //gives a leaf the next range of primitives
+    // - a deferred leaf gets the range for its whole subtree, which is put in order when the subtree is built
+    const auto add_leaf = [&](const bvh_node* n, std::uint32_t& offset) -> std::uint32_t {
+        if (n->is_deferred) {
+            std::vector<bvh_primitive> deferred;
+            deferred.reserve(n->deferred_left.size() + n->deferred_right.size());
+            const auto subtree_first = first + static_cast<unsigned>(ids.size());
+            for (const auto& list : {&n->deferred_left, &n->deferred_right}) {
+                for (const auto& p : *list) {
+                    deferred.push_back({p.box, first + static_cast<unsigned>(ids.size())});
+                    ids.push_back(p.id);
+                }
+            }
+            offset = static_cast<std::uint32_t>(subtrees.size());
+            subtrees.push_back(std::make_unique<lazy_subtree>(std::move(deferred), subtree_first));
+            return 0;
+        }
+
+        offset = static_cast<std::uint32_t>(leaf_ranges.size());
+        leaf_ranges.emplace_back(first + static_cast<unsigned>(ids.size()), n->ids.size());
+        ids.insert(ids.end(), n->ids.begin(), n->ids.end());
+        return n->ids.size();
+    };
+
+    if (settings.format == bvh_format::compressed) {
+        compressed_node_info.emplace_back();
+        compressed_bvh::build_nodes(source_node.get(), 0, compressed_node_info, [&](const bvh_node* n) {
+            std::uint32_t offset;
+            const auto count = add_leaf(n, offset);
+            return compressed_bvh_info::make_leaf(offset, count);
+        });
+    } else {
+        bvh::flatten_nodes(source_node.get(), settings.layout, node_info, [&](const bvh_node* n, bvh_info& leaf) {
+            std::uint32_t offset;
+            leaf.num_primitives = add_leaf(n, offset);
+            leaf.primitives_offset = offset;
+        });
+    }
+
+    primitives.reorder_primitives(first, ids);
+
+    blocks.resize(leaf_ranges.size());
+    #pragma omp parallel for default(none) shared(leaf_ranges)
+    for (size_t i = 0; i < leaf_ranges.size(); i++) {
+        blocks[i] = primitives.make_leaf_block(leaf_ranges[i].first, leaf_ranges[i].second);
+    }
+}
+
+template <typename Primitives>
+indexed_bvh<Primitives>::indexed_bvh(Primitives& _primitives, stored_bvh stored) : box(stored.box), primitives(_primitives),
+        settings(stored.settings), node_info(std::move(stored.nodes)), compressed_node_info(std::move(stored.compressed_nodes)) {
+    //the leaves were given their ranges in the same order as their blocks, so the ranges follow on from each other
+    std::vector<unsigned> counts;
+    const auto add_leaf = [&](const unsigned offset, const unsigned count) {
+        if (counts.size() <= offset) counts.resize(offset + 1);
+        counts[offset] = count;
+    };
+
+    for (const auto& n : node_info) {
+        if (n.is_leaf) add_leaf(n.primitives_offset, n.num_primitives);
+    }
+    for (const auto& n : compressed_node_info) {
+        for (const auto c : n.child) {
+            if (c != compressed_bvh_info::empty && (c & compressed_bvh_info::leaf_flag))
+                add_leaf(compressed_bvh_info::leaf_offset(c), compressed_bvh_info::leaf_count(c));
+        }
+    }
+
+    std::vector<unsigned> leaf_firsts(counts.size(), 0);
+    for (size_t i = 1; i < counts.size(); i++) {
+        leaf_firsts[i] = leaf_firsts[i - 1] + counts[i - 1];
+    }
+
+    blocks.resize(counts.size());
+    #pragma omp parallel for default(none) shared(counts, leaf_firsts)
+    for (size_t i = 0; i < counts.size(); i++) {
+        blocks[i] = primitives.make_leaf_block(leaf_firsts[i], counts[i]);
+    }
+}
+
+template <typename Primitives>
+bool indexed_bvh<Primitives>::is_valid(const stored_bvh& stored, const size_t num_primitives) {
+    const bool compressed = stored.settings.format == bvh_format::compressed;
+    const size_t num_nodes = compressed ? stored.compressed_nodes.size() : stored.nodes.size();
+    if (num_nodes == 0 || num_nodes > std::numeric_limits<std::uint32_t>::max()) return false;
+
+    //the counts of the leaves by their offset (0 for offsets not used yet)
+    std::vector<unsigned> counts;
+    size_t total = 0;
+    const auto add_leaf = [&](const std::uint32_t offset, const std::uint32_t count) {
+        if (count < 1 || count > Primitives::leaf_size || offset >= num_primitives) return false;
+        if (counts.size() <= offset) counts.resize(static_cast<size_t>(offset) + 1, 0);
+        if (counts[offset] != 0) return false;
+        counts[offset] = count;
+        total += count;
+        return true;
+    };
+
+    //walking down from the root, so every node is seen once and its depth is known
+    std::vector<std::uint8_t> seen(num_nodes, 0);
+    std::vector<std::pair<std::uint32_t, size_t>> to_visit = {{0, 1}};  //(node, depth)
+    seen[0] = 1;
+    const auto add_child = [&](const std::uint32_t child, const size_t depth) {
+        if (child >= num_nodes || seen[child]) return false;
+        seen[child] = 1;
+        to_visit.emplace_back(child, depth);
+        return true;
+    };
+    while (!to_visit.empty()) {
+        const auto [index, depth] = to_visit.back();
+        to_visit.pop_back();
+
+        if (compressed) {
+            if (4 * depth >= compressed_bvh::traversal_stack_size) return false;
+            for (const auto c : stored.compressed_nodes[index].child) {
+                if (c == compressed_bvh_info::empty) continue;
+                const bool ok = (c & compressed_bvh_info::leaf_flag) ? add_leaf(compressed_bvh_info::leaf_offset(c), compressed_bvh_info::leaf_count(c))
+                                                                     : add_child(c, depth + 1);
+                if (!ok) return false;
+            }
+        } else {
+            if (depth >= bvh::traversal_stack_size) return false;
+            const auto& n = stored.nodes[index];
+            const bool ok = n.is_leaf ? add_leaf(n.primitives_offset, n.num_primitives)
+                                      : add_child(n.first_child_offset, depth + 1) && add_child(n.second_child_offset, depth + 1);
+            if (!ok) return false;
+        }
+    }
+
+    //the blocks follow on from each other, so every offset up to the last has to be used
+    return total == num_primitives && std::find(counts.begin(), counts.end(), 0u) == counts.end();
+}
+
+template <typename Primitives>
+stored_bvh indexed_bvh<Primitives>::store() const {
+    return {settings, box, node_info, compressed_node_info};
+}
+
+template <typename Primitives>
+inline bool indexed_bvh<Primitives>::hit(const ray& r, const double t_min, hit_record& rec, unsigned& closest) const {
+    if (settings.format == bvh_format::compressed) {
+        return compressed_bvh::traverse(compressed_node_info, r, t_min, rec,
+            [&](const std::uint32_t leaf) {
+                return hit_leaf(compressed_bvh_info::leaf_offset(leaf), compressed_bvh_info::leaf_count(leaf), r, t_min, rec, closest);
+            },
+            [&](const std::uint32_t leaf) {
+                if (compressed_bvh_info::leaf_count(leaf) != 0)
+                    prefetch(&blocks[compressed_bvh_info::leaf_offset(leaf)]);
+            });
+    }
+
+    return bvh::traverse(node_info, r, t_min, rec,
+        [&](const bvh_info& leaf) {
+            return hit_leaf(leaf.primitives_offset, leaf.num_primitives, r, t_min, rec, closest);
+        },
+        [&](const bvh_info& leaf) {
+            if (leaf.num_primitives != 0)
+                prefetch(&blocks[leaf.primitives_offset]);
+        });
+}
+
+template <typename Primitives>
+inline bool indexed_bvh<Primitives>::hit_leaf(const unsigned offset, const unsigned num_primitives, const ray& r, const double t_min,
+                                              hit_record& rec, unsigned& closest) const {
+    if (num_primitives == 0) {
+        return subtrees[offset]->get_tree(primitives, settings)->hit(r, t_min, rec, closest);
+    }
+
+    return primitives.hit_leaf_block(blocks[offset], r, t_min, rec, closest);
+}
+
+template <typename Primitives>
+size_t indexed_bvh<Primitives>::memory_usage() const {
+    size_t memory = node_info.size() * sizeof(bvh_info) + compressed_node_info.size() * sizeof(compressed_bvh_info) +
+                    blocks.size() * sizeof(typename Primitives::leaf_block);
+    for (const auto& s : subtrees) {
+        memory += sizeof(lazy_subtree);
+        if (const auto t = s->built()) memory += t->memory_usage();
+    }
+    return memory;
+}
+
+#endif //RAYTRACER_INDEXED_BVH_HPP
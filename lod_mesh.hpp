@@ -0,0 +1,430 @@
+#ifndef RAYTRACER_LOD_MESH_HPP
+#define RAYTRACER_LOD_MESH_HPP
+
+#include "triangle_mesh.hpp"
+#include "box.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+
+
+/*=====================================================================================================================
+ A mesh with levels of detail -- a chain of simplified copies of the mesh, each with about ratio times the triangles of the last
+  - the levels are made by collapsing edges (simplify_mesh), cheapest first by the quadric error metric of Garland and Heckbert
+  - an edge collapses onto one of its ends, so every level only uses vertices of the full mesh (with their normals and uvs)
+  - each ray picks a level from its footprint (see ray::footprint) where it enters the mesh: the coarsest level whose edges
+    are no longer than the footprint (times detail), so a distant mesh is hit with far fewer triangles
+  - between 2 levels the choice is stochastic (on a hash of the ray) in proportion to how close the footprint is to each,
+    so a mesh does not pop from one level to the next as it moves away, the levels are blended over the samples of a pixel
+  - a ray with no cone (footprint 0) always hits the full mesh
+ ===================================================================================================================*/
+
+struct lod_settings {
+    unsigned max_levels = 4;        //the number of simplified levels (as well as the full mesh)
+    double ratio = 0.25;            //the fraction of the triangles of a level kept in the next
+    size_t min_triangles = 64;      //no level has fewer triangles than this
+    double detail = 1;              //larger values pick finer levels
+};
+
+
+//a symmetric 4x4 matrix (the upper triangle) -- the sum of the squared distances from a point to a set of weighted planes
+struct quadric {
+    double q[10]{};     //xx, xy, xz, xw, yy, yz, yw, zz, zw, ww
+
+    quadric() = default;
+    //the plane dot(n, p) + d = 0 (n is a unit vector)
+    quadric(const vec3& n, const double d, const double weight) {
+        const double p[4] = {n.x(), n.y(), n.z(), d};
+        unsigned k = 0;
+        for (unsigned i = 0; i < 4; i++) {
+            for (unsigned j = i; j < 4; j++) q[k++] = weight * p[i] * p[j];
+        }
+    }
+
+    inline quadric& operator += (const quadric& other) {
+        for (unsigned k = 0; k < 10; k++) q[k] += other.q[k];
+        return *this;
+    }
+
+    [[nodiscard]] inline double error(const vec3& p) const {
+        const double x = p.x(), y = p.y(), z = p.z();
+        return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y + q[7]*z*z + 2*q[8]*z + q[9];
+    }
+};
+
+
+//the triangles left after simplifying a mesh
+struct simplified_triangles {
+    std::vector<unsigned> indices;      //3 per triangle, vertices of the original mesh
+    std::vector<unsigned> original;     //the triangle of the original mesh each triangle came from (for its material)
+};
+
+//simplifies the mesh (3 doubles per position, 3 indices per triangle), giving a copy each time it has at most targets[k] triangles
+// - targets must be decreasing, simplification stops early if no more edges can be collapsed (fewer copies are returned)
+// - vertices at the same position are treated as one (so seams in the uvs or normals do not split the mesh), each corner of a
+//   triangle keeps a vertex on its own side of a seam where it can
+// - the edges of open borders are kept in place by extra planes in the quadrics
+inline std::vector<simplified_triangles> simplify_mesh(const std::vector<double>& positions, const std::vector<unsigned>& indices,
+                                                       const std::vector<size_t>& targets) {
+    const size_t num_vertices = positions.size() / 3, num_tris = indices.size() / 3;
+    const auto position = [&](const unsigned v) {
+        return vec3(positions[3*v], positions[3*v + 1], positions[3*v + 2]);
+    };
+
+    //welding -- point[v] is the same for vertices at the same position
+    std::vector<unsigned> order(num_vertices), point(num_vertices);
+    std::iota(order.begin(), order.end(), 0);
+    const auto less = [&](const unsigned a, const unsigned b) {
+        return std::lexicographical_compare(positions.begin() + 3*a, positions.begin() + 3*a + 3, positions.begin() + 3*b, positions.begin() + 3*b + 3);
+    };
+    std::sort(order.begin(), order.end(), less);
+    unsigned num_points = 0;
+    for (size_t i = 0; i < num_vertices; i++) {
+        if (i > 0 && less(order[i - 1], order[i])) num_points++;
+        point[order[i]] = num_points;
+    }
+    if (num_vertices > 0) num_points++;
+
+    std::vector<vec3> point_position(num_points);
+    for (unsigned v = 0; v < num_vertices; v++) point_position[point[v]] = position(v);
+
+    std::vector<unsigned> corners(indices);     //the vertex at each corner, changes as edges collapse
+    std::vector<bool> tri_removed(num_tris, false), point_removed(num_points, false);
+    std::vector<std::vector<unsigned>> point_tris(num_points);  //the triangles around each point (can include removed triangles)
+    std::vector<quadric> quadrics(num_points);
+    std::unordered_map<std::uint64_t, unsigned> edge_count;
+    const auto edge_key = [](const unsigned a, const unsigned b) {
+        return (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+    };
+    const auto corner_point = [&](const unsigned tri, const unsigned j) {
+        return point[corners[3*tri + j]];
+    };
+    const auto face_normal = [&](const vec3& p0, const vec3& p1, const vec3& p2) {
+        return cross(p1 - p0, p2 - p0);
+    };
+
+    size_t tris_left = 0;
+    for (unsigned t = 0; t < num_tris; t++) {
+        const unsigned a = corner_point(t, 0), b = corner_point(t, 1), c = corner_point(t, 2);
+        if (a == b || b == c || a == c) {   //already degenerate
+            tri_removed[t] = true;
+            continue;
+        }
+        tris_left++;
+        for (const unsigned p : {a, b, c}) point_tris[p].push_back(t);
+        edge_count[edge_key(a, b)]++;
+        edge_count[edge_key(b, c)]++;
+        edge_count[edge_key(c, a)]++;
+
+        //the plane of the triangle, weighted by its area
+        const vec3 n = face_normal(point_position[a], point_position[b], point_position[c]);
+        const double length = n.length();
+        if (length > 0) {
+            const quadric plane(n / length, -dot(n / length, point_position[a]), length / 2);
+            for (const unsigned p : {a, b, c}) quadrics[p] += plane;
+        }
+    }
+
+    //a border edge (in only 1 triangle) gets a plane through it at right angles to the triangle, so its ends stay on the border
+    constexpr double border_weight = 100;
+    for (unsigned t = 0; t < num_tris; t++) {
+        if (tri_removed[t]) continue;
+        const unsigned p[3] = {corner_point(t, 0), corner_point(t, 1), corner_point(t, 2)};
+        const vec3 n = face_normal(point_position[p[0]], point_position[p[1]], point_position[p[2]]);
+        for (unsigned j = 0; j < 3; j++) {
+            const unsigned a = p[j], b = p[(j + 1) % 3];
+            if (edge_count[edge_key(a, b)] != 1) continue;
+            const vec3 edge = point_position[b] - point_position[a];
+            const vec3 border_normal = cross(edge, n);
+            const double length = border_normal.length();
+            if (length <= 0) continue;
+            const quadric plane(border_normal / length, -dot(border_normal / length, point_position[a]), border_weight * edge.length_squared());
+            quadrics[a] += plane;
+            quadrics[b] += plane;
+        }
+    }
+
+    //the collapses, cheapest first -- a collapse is out of date if either end has changed since it was found (its stamp)
+    struct collapse {
+        double cost;
+        unsigned from, to;
+        unsigned from_stamp, to_stamp;
+        bool operator > (const collapse& other) const {return cost > other.cost;}
+    };
+    std::vector<unsigned> stamps(num_points, 0);
+    std::priority_queue<collapse, std::vector<collapse>, std::greater<>> queue;
+    const auto add_collapse = [&](const unsigned a, const unsigned b) {
+        quadric q = quadrics[a];
+        q += quadrics[b];
+        const double cost_ab = q.error(point_position[b]), cost_ba = q.error(point_position[a]);
+        if (cost_ab <= cost_ba) {
+            queue.push({cost_ab, a, b, stamps[a], stamps[b]});
+        } else {
+            queue.push({cost_ba, b, a, stamps[b], stamps[a]});
+        }
+    };
+    for (const auto& [key, count] : edge_count) {
+        add_collapse(static_cast<unsigned>(key >> 32), static_cast<unsigned>(key & 0xffffffffu));
+    }
+
+    //whether from can be moved onto to without folding the mesh over
+    std::vector<unsigned> from_neighbours, to_neighbours;
+    const auto can_collapse = [&](const unsigned from, const unsigned to) {
+        unsigned shared = 0;
+        from_neighbours.clear();
+        to_neighbours.clear();
+        for (const auto t : point_tris[from]) {
+            if (tri_removed[t]) continue;
+            unsigned p[3] = {corner_point(t, 0), corner_point(t, 1), corner_point(t, 2)};
+            for (const unsigned q : p) {
+                if (q != from) from_neighbours.push_back(q);
+            }
+            if (p[0] == to || p[1] == to || p[2] == to) {
+                shared++;
+                continue;
+            }
+
+            //the triangle would flip over (or become a line)
+            const vec3 before = face_normal(point_position[p[0]], point_position[p[1]], point_position[p[2]]);
+            for (auto& q : p) {
+                if (q == from) q = to;
+            }
+            const vec3 after = face_normal(point_position[p[0]], point_position[p[1]], point_position[p[2]]);
+            if (dot(before, after) <= 0) return false;
+        }
+        if (shared == 0) return false;  //the edge is gone
+
+        //the link condition -- the ends can only share the neighbours opposite the edge in the triangles around it,
+        //otherwise the collapse pinches the surface
+        for (const auto t : point_tris[to]) {
+            if (tri_removed[t]) continue;
+            for (unsigned j = 0; j < 3; j++) to_neighbours.push_back(corner_point(t, j));
+        }
+        std::sort(from_neighbours.begin(), from_neighbours.end());
+        from_neighbours.erase(std::unique(from_neighbours.begin(), from_neighbours.end()), from_neighbours.end());
+        std::sort(to_neighbours.begin(), to_neighbours.end());
+        to_neighbours.erase(std::unique(to_neighbours.begin(), to_neighbours.end()), to_neighbours.end());
+        unsigned common = 0;
+        for (const auto q : from_neighbours) {
+            if (q != to && std::binary_search(to_neighbours.begin(), to_neighbours.end(), q)) common++;
+        }
+        return common <= shared;
+    };
+
+    const auto snapshot = [&]() {
+        simplified_triangles level;
+        level.indices.reserve(3 * tris_left);
+        level.original.reserve(tris_left);
+        for (unsigned t = 0; t < num_tris; t++) {
+            if (tri_removed[t]) continue;
+            level.indices.insert(level.indices.end(), corners.begin() + 3*t, corners.begin() + 3*t + 3);
+            level.original.push_back(t);
+        }
+        return level;
+    };
+
+    std::vector<simplified_triangles> levels;
+    std::vector<std::pair<unsigned, unsigned>> seam_sides;  //(vertex at from, vertex at to) in the triangles around the edge
+    size_t next = 0;
+    while (next < targets.size()) {
+        if (tris_left <= targets[next]) {
+            levels.push_back(snapshot());
+            next++;
+            continue;
+        }
+        if (queue.empty()) break;
+
+        const auto c = queue.top();
+        queue.pop();
+        if (point_removed[c.from] || point_removed[c.to] || stamps[c.from] != c.from_stamp || stamps[c.to] != c.to_stamp) continue;
+        if (!can_collapse(c.from, c.to)) continue;
+
+        //the triangles with both ends are removed, the rest around from are moved onto to
+        seam_sides.clear();
+        for (const auto t : point_tris[c.from]) {
+            if (tri_removed[t]) continue;
+            unsigned at_from = 0, at_to = 0;
+            bool has_to = false;
+            for (unsigned j = 0; j < 3; j++) {
+                if (corner_point(t, j) == c.from) at_from = corners[3*t + j];
+                if (corner_point(t, j) == c.to) {
+                    at_to = corners[3*t + j];
+                    has_to = true;
+                }
+            }
+            if (has_to) seam_sides.emplace_back(at_from, at_to);
+        }
+        for (const auto t : point_tris[c.from]) {
+            if (tri_removed[t]) continue;
+            bool has_to = false;
+            for (unsigned j = 0; j < 3; j++) has_to |= corner_point(t, j) == c.to;
+            if (has_to) {
+                tri_removed[t] = true;
+                tris_left--;
+                continue;
+            }
+
+            for (unsigned j = 0; j < 3; j++) {
+                if (corner_point(t, j) != c.from) continue;
+                //the vertex at to on the same side of any seam, or else any vertex at to
+                unsigned moved = seam_sides.front().second;
+                for (const auto& [at_from, at_to] : seam_sides) {
+                    if (at_from == corners[3*t + j]) moved = at_to;
+                }
+                corners[3*t + j] = moved;
+            }
+            point_tris[c.to].push_back(t);
+        }
+
+        point_removed[c.from] = true;
+        point_tris[c.from].clear();
+        quadrics[c.to] += quadrics[c.from];
+        stamps[c.to]++;
+
+        auto& around = point_tris[c.to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](const unsigned t) {return tri_removed[t];}), around.end());
+        for (const auto t : around) {
+            for (unsigned j = 0; j < 3; j++) {
+                const unsigned q = corner_point(t, j);
+                if (q != c.to) add_collapse(c.to, q);
+            }
+        }
+    }
+    return levels;
+}
+
+
+struct lod_mesh : public hittable {
+    std::vector<std::shared_ptr<triangle_mesh>> levels;     //levels[0] is the full mesh
+    std::vector<double> edge_lengths;   //the mean length of the edges of each level
+
+    lod_mesh() = delete;
+    //makes the simplified levels of the mesh (the triangles are indices into positions, normals and uvs as for import_model)
+    lod_mesh(const std::vector<double>& positions, const std::vector<double>& normals, const std::vector<double>& uvs,
+             const std::vector<unsigned>& indices, const std::vector<std::shared_ptr<material>>& materials,
+             const std::vector<unsigned>& material_ids, const lod_settings& lod = {}, const bvh_settings& settings = {});
+
+    inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+        return levels[level(r)]->hit_time(r, t_min, t_max, rec);
+    }
+
+    //the level is picked again -- it is the same for the same ray
+    inline void hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+        levels[level(r)]->hit_info(r, t_min, t_max, rec);
+    }
+
+    inline bool bounding_box(const double time0, const double time1, aabb& output_box) const override {
+        return levels[0]->bounding_box(time0, time1, output_box);
+    }
+
+    //the level of detail a ray sees the mesh at
+    [[nodiscard]] unsigned level(const ray& r) const;
+
+    //the memory used by the vertices, triangles and bvh of every level
+    [[nodiscard]] inline size_t memory_usage() const {
+        size_t memory = 0;
+        for (const auto& l : levels) memory += l->triangle_memory() + l->bvh_memory();
+        return memory;
+    }
+
+private:
+    double detail;
+
+    //a number in [0, 1) from the bits of the ray, used to pick between 2 levels
+    static inline double ray_hash(const ray& r) {
+        std::uint64_t h = 0x9e3779b97f4a7c15u;
+        for (unsigned axis = 0; axis < 3; axis++) {
+            h = mix(h ^ std::bit_cast<std::uint64_t>(r.orig[axis]));
+            h = mix(h ^ std::bit_cast<std::uint64_t>(r.dir[axis]));
+        }
+        return static_cast<double>(h >> 11) * 0x1.0p-53;
+    }
+
+    //the finaliser of splitmix64
+    static inline std::uint64_t mix(std::uint64_t h) {
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9u;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebu;
+        return h ^ (h >> 31);
+    }
+};
+
+
+lod_mesh::lod_mesh(const std::vector<double>& positions, const std::vector<double>& normals, const std::vector<double>& uvs,
+                   const std::vector<unsigned>& indices, const std::vector<std::shared_ptr<material>>& materials,
+                   const std::vector<unsigned>& material_ids, const lod_settings& lod, const bvh_settings& settings) : detail(lod.detail) {
+    std::vector<size_t> targets;
+    for (auto target = static_cast<size_t>(static_cast<double>(indices.size() / 3) * lod.ratio);
+         targets.size() < lod.max_levels && target >= lod.min_triangles; target = static_cast<size_t>(static_cast<double>(target) * lod.ratio)) {
+        targets.push_back(target);
+    }
+
+    auto simplified = simplify_mesh(positions, indices, targets);
+    simplified.insert(simplified.begin(), simplified_triangles{indices, {}});
+
+    for (const auto& s : simplified) {
+        //a level only keeps the vertices it uses
+        std::unordered_map<unsigned, unsigned> local;   //vertex in the full mesh -> vertex in the level
+        std::vector<double> level_positions, level_normals, level_uvs;
+        std::vector<unsigned> level_indices, level_material_ids;
+        level_indices.reserve(s.indices.size());
+        double total_length = 0;
+        for (size_t tri = 0; tri < s.indices.size() / 3; tri++) {
+            for (unsigned j = 0; j < 3; j++) {
+                const unsigned v = s.indices[3*tri + j], next = s.indices[3*tri + (j + 1) % 3];
+                const auto [it, is_new] = local.try_emplace(v, static_cast<unsigned>(local.size()));
+                if (is_new) {
+                    level_positions.insert(level_positions.end(), positions.begin() + 3*v, positions.begin() + 3*v + 3);
+                    level_normals.insert(level_normals.end(), normals.begin() + 3*v, normals.begin() + 3*v + 3);
+                    level_uvs.insert(level_uvs.end(), uvs.begin() + 2*v, uvs.begin() + 2*v + 2);
+                }
+                level_indices.push_back(it->second);
+                total_length += (vec3(positions[3*next], positions[3*next + 1], positions[3*next + 2]) -
+                                 vec3(positions[3*v], positions[3*v + 1], positions[3*v + 2])).length();
+            }
+            if (!material_ids.empty()) level_material_ids.push_back(material_ids[s.original.empty() ? tri : s.original[tri]]);
+        }
+
+        edge_lengths.push_back(s.indices.empty() ? 0 : total_length / static_cast<double>(s.indices.size()));
+        levels.push_back(std::make_shared<triangle_mesh>(vertex_attributes<double>(level_positions, level_normals, level_uvs),
+                                                         std::move(level_indices), materials, std::move(level_material_ids), settings));
+    }
+}
+
+unsigned lod_mesh::level(const ray& r) const {
+    if (!r.has_cone()) return 0;
+
+    //the footprint where the ray enters the mesh (or at its origin if it starts inside)
+    aabb bounds;
+    levels[0]->bounding_box(0, 1, bounds);
+    double t_near, t_far;
+    unsigned near_face, far_face;
+    if (!box::slab(bounds.min(), bounds.max(), r, t_near, t_far, near_face, far_face)) return 0;
+    const double footprint = r.footprint(std::max(t_near, 0.0)) * detail;
+
+    //the coarsest level with edges no longer than the footprint, or the next finer level with probability in proportion to
+    //how far the footprint is (in log scale) from the edges of the finer level
+    const auto last = static_cast<unsigned>(levels.size() - 1);
+    if (footprint <= edge_lengths[0]) return 0;
+    if (footprint >= edge_lengths[last]) return last;
+    unsigned l = 0;
+    while (edge_lengths[l + 1] <= footprint) l++;
+    const double blend = std::log(footprint / edge_lengths[l]) / std::log(edge_lengths[l + 1] / edge_lengths[l]);
+    return ray_hash(r) < blend ? l + 1 : l;
+}
+
+
+//loads a model (as generate_model) with levels of detail -- nullptr if it could not be imported
+inline std::shared_ptr<lod_mesh> generate_lod_model(const std::string& file_name, const lod_settings& lod = {}, const bool flip_uvs = false,
+                                                    const bvh_settings& settings = {}) {
+    const auto imported = import_model(file_name, flip_uvs);
+    if (!imported) return nullptr;
+    const auto& data = *imported;
+    return std::make_shared<lod_mesh>(data.vertices, data.norms, data.uvs, data.indices, model_materials(file_name, data.tex_paths, data.colors),
+                                      data.material_ids, lod, settings);
+}
+
+#endif //RAYTRACER_LOD_MESH_HPP
@@ -10,7 +10,7 @@ struct scatter_record {
     ray specular_ray;
     bool is_specular;
     color attenuation;
-    std::shared_ptr<pdf> pdf_ptr;
+    any_pdf scatter_pdf;	//held by value, so scattering does not allocate (std::monostate for specular scattering)
 };
 
 struct material {
@@ -36,8 +36,8 @@ struct lambertian : public material {
 
 	bool scatter(const ray& ray_in, const hit_record& rec, scatter_record& srec) override {
 		srec.is_specular = false;
-		srec.attenuation = albedo->value(rec.u, rec.v, rec.p);
-		srec.pdf_ptr = std::make_shared<cosine_pdf>(rec.normal);
+		srec.attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_footprint);
+		srec.scatter_pdf.emplace<cosine_pdf>(rec.normal);
 		return true;
 	}
 
@@ -66,8 +66,8 @@ struct metal : public material {
 		//using Schlick's formula
 		const auto unit_direction = unit_vector(ray_in.direction());
 		const auto cosine = fmin(dot(-unit_direction, rec.normal), 1.0);
-        srec.attenuation = albedo->value(rec.u, rec.v, rec.p) + (color(1, 1, 1) - albedo->value(rec.u, rec.v, rec.p)) * pow(1-cosine, 5);
-        srec.pdf_ptr = nullptr;
+        srec.attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_footprint) + (color(1, 1, 1) - albedo->value(rec.u, rec.v, rec.p, rec.uv_footprint)) * pow(1-cosine, 5);
+        srec.scatter_pdf = std::monostate();
 		return (dot(srec.specular_ray.direction(), rec.normal) > 0);	//making sure scattering not opposing the normal
 	}
 };
@@ -109,7 +109,7 @@ struct dielectric : public material {
 		}
 
 		srec.is_specular = true;
-		srec.pdf_ptr = nullptr;
+		srec.scatter_pdf = std::monostate();
 		srec.attenuation = color(1.0, 1.0, 1.0); //material should be clear so white is a good choice for the color (absorbs nothing)
 		srec.specular_ray = ray(rec.p, direction, ray_in.time());
 		return true;
@@ -138,7 +138,7 @@ struct diffuse_light : public material {
 
 	[[nodiscard]] inline color emitted(const ray& r_in, const hit_record& rec, const double u, const double v, const point3& p) const override {
 	    if (rec.front_face)
-		    return emit->value(u, v, p);
+		    return emit->value(u, v, p, rec.uv_footprint);
 	    else
 	        return color(0,0,0);
 	}
@@ -156,8 +156,8 @@ struct isotropic : public material {
 	inline bool scatter(const ray& ray_in, const hit_record& rec, scatter_record& srec) override {
 	    srec.is_specular = true;    //not sure
 		srec.specular_ray = ray(rec.p, halton_random_in_unit_sphere(halton_counter), ray_in.time());	//pick a random direction for the ray to scatter
-		srec.attenuation = albedo->value(rec.u, rec.v, rec.p);
-		srec.pdf_ptr = nullptr;
+		srec.attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_footprint);
+		srec.scatter_pdf = std::monostate();
 		return true;
 	}
 };
@@ -175,8 +175,8 @@ struct Henyey_Greensteing : public material {
     inline bool scatter(const ray& ray_in, const hit_record& rec, scatter_record& srec) override {
         srec.is_specular = true;    //not sure
         srec.specular_ray = ray(rec.p, henyeyGreensteingPdf.generate(ray_in.direction()), ray_in.time());	//pick a random direction for the ray to scatter
-        srec.attenuation = albedo->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = nullptr;
+        srec.attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_footprint);
+        srec.scatter_pdf = std::monostate();
         return true;
     }
 };
@@ -0,0 +1,331 @@
+#ifndef RAYTRACER_MESH_FILE_HPP
+#define RAYTRACER_MESH_FILE_HPP
+
+#include "triangle_mesh.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+//for memory mapping the file
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*=====================================================================================================================
+ A binary file holding a model that has already been imported (and optionally its bvh), so it loads without assimp
+  - made once from a model file with convert_model, and loaded with load_mesh_file
+  - the file is memory mapped and the arrays in it are used as they are, so there is nothing to parse
+    - the vertices are never copied (mapped_vertex_attributes reads them from the mapping), the OS pages them in when used
+    - the indices and bvh nodes are copied out with a single memcpy each
+  - when the bvh is stored the triangles are written in the order of its leaves, so loading only makes the leaf blocks
+  - the numbers are stored as they are in memory, so the file is only meant to be read on the same kind of machine
+    - the stored bvh is only used when its leaves hold as many triangles as a packet does here (leaf_size, 8 with AVX and 4
+      with SSE), otherwise a new one is built
+  - every offset and count in the header is checked against the size of the file before it is used
+ ===================================================================================================================*/
+
+//layout of the file -- every array starts on a 64 byte boundary
+struct mesh_file_header {
+    static constexpr char magic_value[8] = "rtmesh";
+    static constexpr std::uint32_t current_version = 3;
+    static constexpr std::uint32_t no_bvh = 0xFFFFFFFF;
+
+    char magic[8]{};
+    std::uint32_t version = current_version;
+    std::uint32_t num_vertices = 0;
+    std::uint32_t num_indices = 0;
+    std::uint32_t bvh_format = no_bvh;  //a bvh_format, or no_bvh
+    std::uint32_t bvh_layout = 0;
+    std::uint32_t leaf_size = 0;        //the most triangles in a leaf of the bvh (triangle_mesh::leaf_size when it was made)
+    std::uint32_t num_nodes = 0;
+    std::uint32_t num_materials = 0;
+    std::uint32_t num_material_ids = 0; //1 per triangle, or 0 when the model has 1 material
+    double box_min[3]{}, box_max[3]{};
+
+    //offsets from the start of the file
+    std::uint64_t positions = 0;    //double, 3 per vertex
+    std::uint64_t normals = 0;      //double, 3 per vertex
+    std::uint64_t uvs = 0;          //double, 2 per vertex
+    std::uint64_t indices = 0;      //unsigned, 3 per triangle
+    std::uint64_t nodes = 0;        //bvh_info or compressed_bvh_info
+    std::uint64_t material_ids = 0; //unsigned, 1 per triangle
+    std::uint64_t colors = 0;       //double, 3 per material
+    std::uint64_t tex_paths = 0;    //the texture path of each material one after the other, each ended by '\0' (empty if it has none)
+    std::uint64_t tex_paths_size = 0;
+};
+
+
+//a read only file mapped into memory
+struct mapped_file {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    mapped_file() = delete;
+    explicit mapped_file(const std::string& file_name);
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file() {
+        if (data != nullptr) munmap(const_cast<char*>(data), size);
+    }
+
+    //whether count elements of element_size starting at offset are inside the file (with offset a multiple of alignment)
+    [[nodiscard]] inline bool contains(const std::uint64_t offset, const std::uint64_t count, const std::uint64_t element_size,
+                                       const std::uint64_t alignment = 1) const {
+        return offset % alignment == 0 && offset <= size && count <= (size - offset) / element_size;
+    }
+};
+
+mapped_file::mapped_file(const std::string& file_name) {
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open " << file_name << std::endl;
+        return;
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* const mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            data = static_cast<const char*>(mapping);
+            size = static_cast<size_t>(info.st_size);
+        }
+    }
+    close(fd);  //the mapping stays valid after the file is closed
+
+    if (data == nullptr) std::cerr << "Could not map " << file_name << std::endl;
+}
+
+
+//vertices read straight from a mesh file (see vertex_attributes.hpp)
+struct mapped_vertex_attributes {
+    std::shared_ptr<const mapped_file> file;    //keeps the mapping alive
+    const double* positions = nullptr;  //3 per vertex
+    const double* normals = nullptr;    //3 per vertex
+    const double* uvs = nullptr;        //2 per vertex
+    size_t count = 0;
+
+    [[nodiscard]] inline size_t num_vertices() const {
+        return count;
+    }
+
+    [[nodiscard]] inline vec3 position(const unsigned vertex) const {
+        return vec3(positions[3*vertex], positions[3*vertex + 1], positions[3*vertex + 2]);
+    }
+
+    [[nodiscard]] inline vec3 normal(const unsigned vertex) const {
+        return vec3(normals[3*vertex], normals[3*vertex + 1], normals[3*vertex + 2]);
+    }
+
+    [[nodiscard]] inline vec2 uv(const unsigned vertex) const {
+        return vec2(uvs[2*vertex], uvs[2*vertex + 1]);
+    }
+
+    //the size of the vertices in the mapping (which are only in memory once they have been used)
+    [[nodiscard]] inline size_t memory_usage() const {
+        return count * 8 * sizeof(double);
+    }
+};
+
+using mapped_triangle_mesh = basic_triangle_mesh<mapped_vertex_attributes>;
+
+
+//imports model_file with assimp and writes it to mesh_file
+// - with store_bvh the bvh is built (using settings) and stored as well, settings.eager_depth must be the full depth
+inline bool convert_model(const std::string& model_file, const std::string& mesh_file, const bool flip_uvs = false, const bool store_bvh = true,
+                          const bvh_settings& settings = {}) {
+    auto imported = import_model(model_file, flip_uvs);
+    if (!imported) return false;
+    auto& data = *imported;
+
+    mesh_file_header header;
+    std::memcpy(header.magic, mesh_file_header::magic_value, sizeof(header.magic));
+    header.num_vertices = static_cast<std::uint32_t>(data.vertices.size() / 3);
+
+    //building the bvh puts the triangles in the order of its leaves (the materials are not needed for that)
+    header.num_materials = static_cast<std::uint32_t>(data.tex_paths.size());
+    const auto mesh = std::make_shared<triangle_mesh>(vertex_attributes<double>(data.vertices, data.norms, data.uvs), std::move(data.indices),
+                                                      std::vector<std::shared_ptr<material>>(data.tex_paths.size()), std::move(data.material_ids),
+                                                      settings);
+    stored_bvh bvh;
+    if (store_bvh) {
+        if (mesh->can_store_bvh()) {
+            bvh = mesh->store_bvh();
+            header.bvh_format = static_cast<std::uint32_t>(bvh.settings.format);
+            header.bvh_layout = static_cast<std::uint32_t>(bvh.settings.layout);
+            header.leaf_size = triangle_mesh::leaf_size;
+            header.num_nodes = static_cast<std::uint32_t>(bvh.nodes.size() + bvh.compressed_nodes.size());
+            for (unsigned axis = 0; axis < 3; axis++) {
+                header.box_min[axis] = bvh.box.min()[axis];
+                header.box_max[axis] = bvh.box.max()[axis];
+            }
+        } else {
+            std::cerr << "The bvh of " << model_file << " was not fully built (eager_depth) -- it is not stored" << std::endl;
+        }
+    }
+    header.num_indices = static_cast<std::uint32_t>(mesh->indices.size());
+    header.num_material_ids = static_cast<std::uint32_t>(mesh->material_ids.size());
+
+    std::vector<double> colors;
+    for (const auto& c : data.colors) {
+        colors.insert(colors.end(), {c.x(), c.y(), c.z()});
+    }
+
+    std::string tex_paths;
+    for (const auto& path : data.tex_paths) {
+        tex_paths.append(path);
+        tex_paths.push_back('\0');
+    }
+
+    //placing the arrays
+    std::uint64_t end = sizeof(mesh_file_header);
+    const auto place = [&](std::uint64_t& offset, const std::uint64_t size) {
+        offset = (end + 63) / 64 * 64;
+        end = offset + size;
+    };
+    place(header.positions, data.vertices.size() * sizeof(double));
+    place(header.normals, data.norms.size() * sizeof(double));
+    place(header.uvs, data.uvs.size() * sizeof(double));
+    place(header.indices, mesh->indices.size() * sizeof(unsigned));
+    place(header.nodes, bvh.nodes.size() * sizeof(bvh_info) + bvh.compressed_nodes.size() * sizeof(compressed_bvh_info));
+    place(header.material_ids, mesh->material_ids.size() * sizeof(unsigned));
+    place(header.colors, colors.size() * sizeof(double));
+    place(header.tex_paths, tex_paths.size());
+    header.tex_paths_size = tex_paths.size();
+
+    std::ofstream file(mesh_file, std::ios::binary);
+    const auto write = [&](const std::uint64_t offset, const void* values, const std::uint64_t size) {
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(static_cast<const char*>(values), static_cast<std::streamsize>(size));
+    };
+    write(0, &header, sizeof(header));
+    write(header.positions, data.vertices.data(), data.vertices.size() * sizeof(double));
+    write(header.normals, data.norms.data(), data.norms.size() * sizeof(double));
+    write(header.uvs, data.uvs.data(), data.uvs.size() * sizeof(double));
+    write(header.indices, mesh->indices.data(), mesh->indices.size() * sizeof(unsigned));
+    write(header.nodes, bvh.nodes.data(), bvh.nodes.size() * sizeof(bvh_info));
+    write(header.nodes, bvh.compressed_nodes.data(), bvh.compressed_nodes.size() * sizeof(compressed_bvh_info));
+    write(header.material_ids, mesh->material_ids.data(), mesh->material_ids.size() * sizeof(unsigned));
+    write(header.colors, colors.data(), colors.size() * sizeof(double));
+    write(header.tex_paths, tex_paths.data(), tex_paths.size());
+
+    if (!file) {
+        std::cerr << "Could not write " << mesh_file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+//loads a file made by convert_model -- model_file is the model it was made from (textures are found relative to it)
+// - the bvh stored in the file is used if there is one, otherwise one is built using settings
+inline std::shared_ptr<mapped_triangle_mesh> load_mesh_file(const std::string& mesh_file, const std::string& model_file, const bvh_settings& settings = {}) {
+    const auto file = std::make_shared<const mapped_file>(mesh_file);
+    mesh_file_header header;
+    if (file->size < sizeof(header)) {
+        std::cerr << mesh_file << " is not a mesh file" << std::endl;
+        return nullptr;
+    }
+    std::memcpy(&header, file->data, sizeof(header));
+    if (std::memcmp(header.magic, mesh_file_header::magic_value, sizeof(header.magic)) != 0 || header.version != mesh_file_header::current_version) {
+        std::cerr << mesh_file << " is not a mesh file, or was made by a different version (convert the model again)" << std::endl;
+        return nullptr;
+    }
+
+    //each array has to be inside the file before it is read (and aligned when it is used in place)
+    const auto fits = [&](const std::uint64_t offset, const std::uint64_t count, const std::uint64_t element_size, const std::uint64_t alignment = 1) {
+        return file->contains(offset, count, element_size, alignment);
+    };
+    const std::uint64_t num_triangles = header.num_indices / 3;
+    const bool compressed = header.bvh_format == static_cast<std::uint32_t>(bvh_format::compressed);
+    if (!fits(header.positions, 3ull * header.num_vertices, sizeof(double), alignof(double)) ||
+        !fits(header.normals, 3ull * header.num_vertices, sizeof(double), alignof(double)) ||
+        !fits(header.uvs, 2ull * header.num_vertices, sizeof(double), alignof(double)) || header.num_indices % 3 != 0 ||
+        !fits(header.indices, header.num_indices, sizeof(unsigned)) ||
+        (header.num_material_ids != 0 && header.num_material_ids != num_triangles) ||
+        !fits(header.material_ids, header.num_material_ids, sizeof(unsigned)) ||
+        !fits(header.colors, 3ull * header.num_materials, sizeof(double), alignof(double)) || !fits(header.tex_paths, header.tex_paths_size, 1) ||
+        (header.bvh_format != mesh_file_header::no_bvh &&
+         (header.bvh_format > static_cast<std::uint32_t>(bvh_format::compressed) ||
+          header.bvh_layout > static_cast<std::uint32_t>(bvh_layout::van_emde_boas) ||
+          !fits(header.nodes, header.num_nodes, compressed ? sizeof(compressed_bvh_info) : sizeof(bvh_info))))) {
+        std::cerr << mesh_file << " is damaged (its header does not match what is in it)" << std::endl;
+        return nullptr;
+    }
+
+    mapped_vertex_attributes vertices;
+    vertices.file = file;
+    vertices.count = header.num_vertices;
+    vertices.positions = reinterpret_cast<const double*>(file->data + header.positions);
+    vertices.normals = reinterpret_cast<const double*>(file->data + header.normals);
+    vertices.uvs = reinterpret_cast<const double*>(file->data + header.uvs);
+
+    std::vector<unsigned> indices(header.num_indices);
+    std::memcpy(indices.data(), file->data + header.indices, indices.size() * sizeof(unsigned));
+    if (std::any_of(indices.begin(), indices.end(), [&](const unsigned v) {return v >= header.num_vertices;})) {
+        std::cerr << mesh_file << " is damaged (a triangle uses a vertex that is not in it)" << std::endl;
+        return nullptr;
+    }
+
+    std::vector<unsigned> material_ids(header.num_material_ids);
+    std::memcpy(material_ids.data(), file->data + header.material_ids, material_ids.size() * sizeof(unsigned));
+    if (std::any_of(material_ids.begin(), material_ids.end(), [&](const unsigned m) {return m >= header.num_materials;})) {
+        std::cerr << mesh_file << " is damaged (a triangle uses a material that is not in it)" << std::endl;
+        return nullptr;
+    }
+
+    std::vector<std::string> tex_paths;
+    std::vector<color> colors;
+    const char* path = file->data + header.tex_paths;
+    const char* const paths_end = path + header.tex_paths_size;
+    const auto color_values = reinterpret_cast<const double*>(file->data + header.colors);
+    for (unsigned i = 0; i < header.num_materials; i++) {
+        const auto path_end = static_cast<const char*>(std::memchr(path, '\0', static_cast<size_t>(paths_end - path)));
+        if (path_end == nullptr) {
+            std::cerr << mesh_file << " is damaged (the texture paths run past their end)" << std::endl;
+            return nullptr;
+        }
+        tex_paths.emplace_back(path, path_end);
+        path = path_end + 1;
+        colors.emplace_back(color_values[3*i], color_values[3*i + 1], color_values[3*i + 2]);
+    }
+    auto materials = model_materials(model_file, tex_paths, colors);
+
+    //a bvh made where packets are a different width has leaves that do not fit in a packet here -- a new one is built instead
+    if (header.bvh_format != mesh_file_header::no_bvh && header.leaf_size != mapped_triangle_mesh::leaf_size) {
+        std::cerr << "The bvh in " << mesh_file << " has leaves of " << header.leaf_size << " triangles (" << mapped_triangle_mesh::leaf_size
+                  << " here) -- building a new one" << std::endl;
+        header.bvh_format = mesh_file_header::no_bvh;
+    }
+    if (header.bvh_format == mesh_file_header::no_bvh) {
+        return std::make_shared<mapped_triangle_mesh>(std::move(vertices), std::move(indices), std::move(materials), std::move(material_ids), settings);
+    }
+
+    stored_bvh bvh;
+    bvh.settings.format = static_cast<bvh_format>(header.bvh_format);
+    bvh.settings.layout = static_cast<bvh_layout>(header.bvh_layout);
+    bvh.box = aabb(point3(header.box_min[0], header.box_min[1], header.box_min[2]), point3(header.box_max[0], header.box_max[1], header.box_max[2]));
+    if (bvh.settings.format == bvh_format::compressed) {
+        bvh.compressed_nodes.resize(header.num_nodes);
+        std::memcpy(bvh.compressed_nodes.data(), file->data + header.nodes, header.num_nodes * sizeof(compressed_bvh_info));
+    } else {
+        bvh.nodes.resize(header.num_nodes);
+        std::memcpy(bvh.nodes.data(), file->data + header.nodes, header.num_nodes * sizeof(bvh_info));
+    }
+    if (!indexed_bvh<mapped_triangle_mesh>::is_valid(bvh, num_triangles)) {
+        std::cerr << mesh_file << " is damaged (its bvh is not a tree over its triangles)" << std::endl;
+        return nullptr;
+    }
+    return std::make_shared<mapped_triangle_mesh>(std::move(vertices), std::move(indices), std::move(materials), std::move(material_ids),
+                                                  std::move(bvh));
+}
+
+#endif //RAYTRACER_MESH_FILE_HPP
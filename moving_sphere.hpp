@@ -79,11 +79,12 @@ void moving_sphere::hit_info(const ray& r, const double t_min, const double t_ma
     const vec3 outward_normal = (rec.p - center(r.time())) / radius;	//a normal vector is just a point on the sphere less the center
     //dividing by radius to make it normalised
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
 
     get_sphere_uv(outward_normal, rec.u, rec.v);	//setting the texture coordinates
     //outward_normal is technical a vec3 not a point3 but they are the same thing
     // - it points to the correct position on a unit sphere
+    rec.set_uv_footprint(r, 1 / (2*pi*std::abs(radius)));	//u goes once around the equator (hollow spheres have negative radii)
 }
 
 bool moving_sphere::bounding_box(const double _time0, const double _time1, aabb& output_box) const {
@@ -1,10 +1,14 @@
 #ifndef RAYTRACER_PDF_HPP
 #define RAYTRACER_PDF_HPP
 
+#include "environment_map.hpp"
 #include "hittable.hpp"
 #include "ONB.hpp"
 #include "probability.hpp"
 
+#include <type_traits>
+#include <variant>
+
 
 struct pdf {
     virtual ~pdf() = default;
@@ -33,12 +37,13 @@ struct cosine_pdf : public pdf {
 };
 
 //used for importance sampling hittables
+// - ptr is not owned (the scene keeps the hittables), so making one is free
 struct hittable_pdf : public pdf {
     const point3 o;
-    const std::shared_ptr<hittable> ptr;
+    hittable* const ptr;
 
     hittable_pdf() = delete;
-    hittable_pdf(std::shared_ptr<hittable> p, const point3& origin) : ptr(std::move(p)), o(origin) {}
+    hittable_pdf(hittable* const p, const point3& origin) : o(origin), ptr(p) {}
 
     [[nodiscard]] double value(const vec3& incoming_dir, const vec3& out_direction) const override {
         return ptr->pdf_value(o, out_direction);
@@ -49,13 +54,32 @@ struct hittable_pdf : public pdf {
     }
 };
 
+//used for importance sampling the environment map -- by the brightness of its texels, or uniformly over the sphere when
+//not importance (to compare against)
+// - map is not owned (the scene keeps it)
+struct environment_pdf : public pdf {
+    const environment_map* const map;
+    const bool importance;
+
+    environment_pdf() = delete;
+    environment_pdf(const environment_map* const m, const bool _importance) : map(m), importance(_importance) {}
+
+    [[nodiscard]] double value([[maybe_unused]] const vec3& incoming_dir, const vec3& out_direction) const override {
+        return importance ? map->pdf_value(out_direction) : 1 / (4*pi);
+    }
 
+    [[nodiscard]] vec3 generate([[maybe_unused]] const vec3& incoming_dir) override {
+        return importance ? map->random() : random_unit_vector();
+    }
+};
 
+
+//half of each pdf -- the pdfs are not owned, so they must outlive the mixture (e.g. both on the stack next to it)
 struct mixture_pdf : public pdf {
-    const std::shared_ptr<pdf> p[2];
+    pdf* const p[2];
 
     mixture_pdf() = delete;
-    mixture_pdf(const std::shared_ptr<pdf> &p0, const std::shared_ptr<pdf> &p1) : p{p0, p1} {}
+    mixture_pdf(pdf& p0, pdf& p1) : p{&p0, &p1} {}
 
     [[nodiscard]] inline double value(const vec3& incoming_dir, const vec3& out_direction) const override {
         return 0.5 * p[0]->value(incoming_dir, out_direction) + 0.5 * p[1]->value(incoming_dir, out_direction);
@@ -95,4 +119,19 @@ struct Henyey_Greensteing_pdf : public pdf {
 
 
 
+//any of the pdfs by value, so a pdf can be made for every bounce without going to the heap (see scatter_record)
+// - std::monostate for no pdf
+using any_pdf = std::variant<std::monostate, cosine_pdf, hittable_pdf, environment_pdf, mixture_pdf, Henyey_Greensteing_pdf>;
+
+//the pdf held, or nullptr for std::monostate
+inline pdf* get_pdf(any_pdf& p) {
+    return std::visit([](auto& held) -> pdf* {
+        if constexpr (std::is_same_v<std::decay_t<decltype(held)>, std::monostate>)
+            return nullptr;
+        else
+            return &held;
+    }, p);
+}
+
+
 #endif //RAYTRACER_PDF_HPP
@@ -1,9 +1,14 @@
 #pragma once
 
+#include "simd.hpp"
 #include "vec3.hpp"
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <numeric>
 
+//noise is the scalar version of the noise -- turb and the batches of points are done a lane of simd_double_lanes per point
+// (or per octave), which gives the same results
 class perlin {
 	static constexpr unsigned point_count = 256;
 	std::array<vec3, point_count> ranvec;		//array to hold the noise
@@ -11,6 +16,7 @@ class perlin {
 	const std::array<int, point_count> perm_x;		//permutations for the x-direction
 	const std::array<int, point_count> perm_y;
 	const std::array<int, point_count> perm_z;
+	alignas(64) std::array<double, point_count> gradient_x{}, gradient_y{}, gradient_z{};	//ranvec as a structure of arrays
 
 	static std::array<int, point_count> perlin_generate_perm() {	//creates a permutation of the numbers from 0 to point_count
         std::array<int, point_count> p;
@@ -50,11 +56,21 @@ class perlin {
 		return accum;
 	}
 
+	static constexpr unsigned max_lanes = 8;	//points in a call to noise_lanes
+
+	//noise at the points (x[l], y[l], z[l]) for l < count <= max_lanes, the same as noise at each
+	// - x, y and z are max_lanes long and aligned, the lanes after count repeat the last point
+	// - the permutations and gradients are gathered into the lanes
+	void noise_lanes(const double* x, const double* y, const double* z, double* out, unsigned count) const;
+
 
 	public:
 	perlin() : perm_x(perlin_generate_perm()), perm_y(perlin_generate_perm()), perm_z(perlin_generate_perm()){
 		for (int i = 0; i < point_count; i++) {
 			ranvec[i] = unit_vector(random_vec3(-1,1));
+			gradient_x[i] = ranvec[i].x();
+			gradient_y[i] = ranvec[i].y();
+			gradient_z[i] = ranvec[i].z();
 		}
 	}
 
@@ -94,12 +110,121 @@ class perlin {
 		auto temp_p = p;
 		auto weight = 1.0;
 
-		for (int i = 0; i < depth; i++) {
-			accum += weight * noise(temp_p);	//the actual noise
-			weight *= 0.5;				//progressive additions of noise have less impact overall
-			temp_p *= 2;				//so the noise is not all at the same place
+		//the octaves are independent, so they are found in the lanes together (then added in order)
+		alignas(64) double x[max_lanes], y[max_lanes], z[max_lanes], octaves[max_lanes];
+		for (int first = 0; first < depth; first += max_lanes) {
+			const auto count = static_cast<unsigned>(std::min(depth - first, static_cast<int>(max_lanes)));
+			for (unsigned i = 0; i < max_lanes; i++) {
+				x[i] = temp_p.x();
+				y[i] = temp_p.y();
+				z[i] = temp_p.z();
+				if (i + 1 < count) temp_p *= 2;			//so the noise is not all at the same place
+			}
+			temp_p *= 2;
+			noise_lanes(x, y, z, octaves, count);	//the actual noise
+			for (unsigned i = 0; i < count; i++) {
+				accum += weight * octaves[i];
+				weight *= 0.5;			//progressive additions of noise have less impact overall
+			}
 		}
 
 		return fabs(accum);
 	}
+
+	//noise and turb at count points at once (e.g. the points of many hits shaded together), into out
+	void noise(const point3* points, size_t count, double* out) const;
+	void turb(const point3* points, size_t count, double* out, int depth=7) const;
 };
+
+
+void perlin::noise_lanes(const double* const x, const double* const y, const double* const z, double* const out, const unsigned count) const {
+#if defined(__AVX__) || defined(__SSE2__)
+	using L = simd_double_lanes;
+	const int* const perms[3] = {perm_x.data(), perm_y.data(), perm_z.data()};
+	alignas(64) double result[L::width];
+
+	for (unsigned base = 0; base < count; base += L::width) {
+		//the lattice cell of each point, and its hashes along each axis (a hash per side of the cell)
+		const double* const coords[3] = {x + base, y + base, z + base};
+		L::type fraction[3];
+		L::index_type hash[3][2];
+		for (unsigned axis = 0; axis < 3; axis++) {
+			const L::type p = L::load(coords[axis]);
+			const L::type cell = L::floor(p);
+			fraction[axis] = L::sub(p, cell);
+
+			const L::index_type low = L::to_index(cell), all = L::set_index(255);
+			hash[axis][0] = L::gather(perms[axis], L::both(low, all));
+			hash[axis][1] = L::gather(perms[axis], L::both(L::add(low, L::set_index(1)), all));
+		}
+
+		//perlin_interp in every lane
+		const L::type one = L::set(1.0), two = L::set(2.0), three = L::set(3.0);
+		L::type weight[3][2], offset[3][2];
+		for (unsigned axis = 0; axis < 3; axis++) {
+			const L::type f = fraction[axis];
+			const L::type smooth = L::mul(L::mul(f, f), L::sub(three, L::mul(two, f)));	//the Hermite cubic
+			weight[axis][0] = L::sub(one, smooth);
+			weight[axis][1] = smooth;
+			offset[axis][0] = f;
+			offset[axis][1] = L::sub(f, one);
+		}
+
+		L::type accum = L::set(0.0);
+		for (unsigned corner = 0; corner < 8; corner++) {
+			const unsigned di = corner >> 2, dj = corner >> 1 & 1, dk = corner & 1;
+			const L::index_type gradient = L::either_not_both(L::either_not_both(hash[0][di], hash[1][dj]), hash[2][dk]);
+			const L::type dot = L::add(L::add(L::mul(L::gather(gradient_x.data(), gradient), offset[0][di]),
+											  L::mul(L::gather(gradient_y.data(), gradient), offset[1][dj])),
+									   L::mul(L::gather(gradient_z.data(), gradient), offset[2][dk]));
+			accum = L::add(accum, L::mul(L::mul(L::mul(weight[0][di], weight[1][dj]), weight[2][dk]), dot));
+		}
+
+		L::store(result, accum);
+		for (unsigned l = 0; l < L::width && base + l < count; l++) out[base + l] = result[l];
+	}
+#else
+	for (unsigned l = 0; l < count; l++) out[l] = noise(point3(x[l], y[l], z[l]));
+#endif
+}
+
+void perlin::noise(const point3* const points, const size_t count, double* const out) const {
+	alignas(64) double x[max_lanes], y[max_lanes], z[max_lanes];
+	for (size_t base = 0; base < count; base += max_lanes) {
+		const auto lanes = static_cast<unsigned>(std::min(count - base, static_cast<size_t>(max_lanes)));
+		for (unsigned l = 0; l < max_lanes; l++) {
+			const auto& p = points[base + std::min(l, lanes - 1)];
+			x[l] = p.x();
+			y[l] = p.y();
+			z[l] = p.z();
+		}
+		noise_lanes(x, y, z, out + base, lanes);
+	}
+}
+
+void perlin::turb(const point3* const points, const size_t count, double* const out, const int depth) const {
+	alignas(64) double x[max_lanes], y[max_lanes], z[max_lanes], octave[max_lanes];
+	for (size_t base = 0; base < count; base += max_lanes) {
+		const auto lanes = static_cast<unsigned>(std::min(count - base, static_cast<size_t>(max_lanes)));
+		double accum[max_lanes] = {};
+		for (unsigned l = 0; l < max_lanes; l++) {
+			const auto& p = points[base + std::min(l, lanes - 1)];
+			x[l] = p.x();
+			y[l] = p.y();
+			z[l] = p.z();
+		}
+
+		auto weight = 1.0;
+		for (int i = 0; i < depth; i++) {
+			noise_lanes(x, y, z, octave, lanes);
+			for (unsigned l = 0; l < lanes; l++) accum[l] += weight * octave[l];
+			for (unsigned l = 0; l < max_lanes; l++) {
+				x[l] *= 2;
+				y[l] *= 2;
+				z[l] *= 2;
+			}
+			weight *= 0.5;
+		}
+		for (unsigned l = 0; l < lanes; l++) out[base + l] = fabs(accum[l]);
+	}
+}
@@ -6,6 +6,11 @@ struct ray {
 	point3 orig;
 	vec3 dir;
 	double tm = 0;	//time the ray exists at
+
+	//the ray as a cone (for level of detail) -- its width at the origin and how fast it widens per unit distance travelled
+	// - both are 0 by default (an infinitely thin ray, so everything is seen at full detail)
+	double cone_width = 0;
+	double cone_spread = 0;
 	
 	ray() = default;
 	ray(const point3& origin, const vec3& direction, const double time = 0.0) : orig(origin), dir(direction), tm(time) {}
@@ -17,4 +22,20 @@ struct ray {
 	[[nodiscard]] point3 at(const double t) const {
 		return orig + t*dir;
 	}
+
+	//the width and spread are never negative
+	[[nodiscard]] inline bool has_cone() const {
+		return cone_width > 0 || cone_spread > 0;
+	}
+
+	//the width of the cone at at(t)
+	[[nodiscard]] inline double footprint(const double t) const {
+		return cone_width + cone_spread * t * dir.length();
+	}
+
+	//continues the cone of r from r.at(t) (for a ray scattered at a hit) -- the spread is kept
+	inline void continue_cone(const ray& r, const double t) {
+		cone_width = r.footprint(t);
+		cone_spread = r.cone_spread;
+	}
 };
@@ -17,6 +17,10 @@ struct render {
 
     render() = delete;
     explicit render(scene scn) : curr_scene(std::move(scn)) {
+        if (curr_scene.settings.auto_bvh) {
+            curr_scene.build_top_level_bvh(curr_scene.cam->shutter_open(), curr_scene.cam->shutter_close());
+        }
+
         halton_indices.resize(image_width);
         for (unsigned i = 0; i < image_width; i++) {
             halton_indices[i].resize(image_height);
@@ -196,13 +200,17 @@ struct render {
 
         }
 
+        lazy_bvh::print_stats(std::cout);
+        texture_page_cache::print_stats(std::cout);
     }
 
 
     void draw_to_buffer(std::vector <std::vector<color>> &buffer,
                         const std::vector<std::vector<size_t>> &samples) {
         unsigned counter = 0;
-        #pragma omp parallel for shared(buffer, counter, samples), default(none)
+        //the cone of a pixel, so textures can be filtered and meshes with a level of detail can pick a level
+        const double spread = curr_scene.settings.ray_cones ? curr_scene.cam->pixel_spread(image_height) : 0;
+        #pragma omp parallel for shared(buffer, counter, samples, spread), default(none)
         for (int j = (int) image_height - 1; j >= 0; --j) {
             if constexpr (log_scanlines) {
                 std::cout << "\rScanline: " << ++counter << " / " << image_height << std::flush;
@@ -212,7 +220,7 @@ struct render {
                     const auto r_v = random_halton_2D(halton_indices[i][j]);
                     const auto u = double(i + r_v.x()) / (image_width - 1);
                     const auto v = double(j + r_v.y()) / (image_height - 1);
-                    const ray r = curr_scene.cam->get_ray(u, v);
+                    const ray r = curr_scene.cam->get_ray(u, v, spread);
                     buffer[i][j] += ray_color(r, max_depth);
                 }
             }
@@ -230,9 +238,9 @@ struct render {
         if (depth <= 0)
             return color(0, 0, 0);
 
-        //If the ray hits nothing, return the background color
+        //If the ray hits nothing, return the background color (or the light from the environment map)
         if (!curr_scene.world.hit_time(r, 0.001, infinity, rec))
-            return curr_scene.background;
+            return curr_scene.environment ? curr_scene.environment->value(r.direction()) : curr_scene.background;
         curr_scene.world.hit_info(r, 0.001, infinity, rec);
 
 
@@ -244,15 +252,26 @@ struct render {
         if (!rec.mat_ptr->scatter(r, rec, srec))    //if the light shouldn't scatter
             return emitted;
 
-        if (srec.is_specular)
+        //the scattered rays carry on the cone of r from the hit
+        if (srec.is_specular) {
+            srec.specular_ray.continue_cone(r, rec.t);
             return srec.attenuation * ray_color(srec.specular_ray, depth - 1);
+        }
 
-        if (curr_scene.settings.importance) {
+        const bool sample_environment = curr_scene.environment && curr_scene.settings.sample_environment != environment_sampling::none;
+        if (curr_scene.settings.importance || sample_environment) {
             //https://en.wikipedia.org/wiki/Monte_Carlo_integration#Importance_sampling
-            const auto light_ptr = make_shared<hittable_pdf>(curr_scene.settings.important, rec.p);
-            mixture_pdf mixed_pdf(light_ptr, srec.pdf_ptr);
-
-            const auto scattered = ray(rec.p, mixed_pdf.generate(r.dir), r.time());
+            // - the important objects and the environment map are lights, each with half the light samples if there are both
+            // - the pdfs are all on the stack, so a bounce does not allocate
+            hittable_pdf important_pdf(curr_scene.settings.important.get(), rec.p);
+            environment_pdf environment_light(curr_scene.environment.get(), curr_scene.settings.sample_environment == environment_sampling::importance);
+            mixture_pdf both_lights(important_pdf, environment_light);
+            pdf& light = !sample_environment ? static_cast<pdf&>(important_pdf)
+                       : curr_scene.settings.importance ? static_cast<pdf&>(both_lights) : static_cast<pdf&>(environment_light);
+            mixture_pdf mixed_pdf(light, *get_pdf(srec.scatter_pdf));
+
+            auto scattered = ray(rec.p, mixed_pdf.generate(r.dir), r.time());
+            scattered.continue_cone(r, rec.t);
             const auto pdf_val = mixed_pdf.value(r.dir, scattered.direction());
 
 
@@ -260,8 +279,10 @@ struct render {
                    srec.attenuation * ray_color(scattered, depth - 1) * rec.mat_ptr->scattering_pdf(r, rec, scattered) /
                    pdf_val;    //return the color of the object darkened by the number of times the ray bounced
         } else {
-            const auto scattered = ray(rec.p, srec.pdf_ptr->generate(r.dir), r.time());
-            const auto pdf_val = srec.pdf_ptr->value(r.dir, scattered.direction());
+            pdf& scatter_pdf = *get_pdf(srec.scatter_pdf);
+            auto scattered = ray(rec.p, scatter_pdf.generate(r.dir), r.time());
+            scattered.continue_cone(r, rec.t);
+            const auto pdf_val = scatter_pdf.value(r.dir, scattered.direction());
 
             return emitted +
                    srec.attenuation * ray_color(scattered, depth - 1) * rec.mat_ptr->scattering_pdf(r, rec, scattered) /
@@ -12,11 +12,24 @@
 
 #include "triangle.hpp"
 #include "triangle_mesh.hpp"
+#include "mesh_file.hpp"
+#include "streamed_mesh.hpp"
+#include "lod_mesh.hpp"
+#include "tessellated_mesh.hpp"
+#include "texture_cache.hpp"
+#include "environment_map.hpp"
+#include "sphere_group.hpp"
+#include "box_group.hpp"
+#include "transform.hpp"
 
 constexpr double aspec1 = 16.0/9.0;
 
 enum class background_color {sky, black};
 
+//how rays that scatter off diffuse materials are sent towards the environment map (see scene::environment)
+// - none only samples the materials, uniform picks directions uniformly over the sphere and importance by brightness
+enum class environment_sampling {none, uniform, importance};
+
 struct scene_settings {
     scene_settings() {
         important = std::make_shared<hittable_list>();
@@ -25,6 +38,9 @@ struct scene_settings {
     std::shared_ptr<hittable_list> important;
 
     bool importance = false;
+    bool auto_bvh = true;   //whether to put all objects in the world into a bvh before rendering (see scene::build_top_level_bvh)
+    bool ray_cones = true;  //whether rays carry the cone of their pixel (see ray::footprint), for filtered textures and levels of detail
+    environment_sampling sample_environment = environment_sampling::importance;
 };
 
 
@@ -37,6 +53,7 @@ struct scene {
 	double aspect_ratio = 0;
 
     color background;
+    std::shared_ptr<const environment_map> environment;    //the background instead of the colour, if there is one
 
 	scene() = default;
 
@@ -48,6 +65,10 @@ struct scene {
 	}
 
 
+	inline void set_environment(const std::shared_ptr<const environment_map>& map) {
+		environment = map;
+	}
+
 	inline void set_background(const background_color& col) {
 		if (col == background_color::sky) {
 			background = color(0.70, 0.80, 1.00);
@@ -58,11 +79,52 @@ struct scene {
 		}
 	}
 
+	//replaces the objects in world with a single bvh over them
+	// - called before rendering so scenes don't need to remember to put groups of objects in a bvh themselves
+	// - objects without a bounding box cannot go in the bvh so are left in world and are tested separately
+	// - objects in nested hittable_lists are pulled out so they end up in the same bvh
+	// - chains of translate and rotate_y are replaced by a single transform (see collapse_transforms)
+	// - time0 and time1 are the camera's shutter times, so the boxes of moving objects cover where the rays can see them
+	void build_top_level_bvh(const double time0, const double time1) {
+	    std::vector<std::shared_ptr<hittable>> objects;
+	    flatten_lists(world.objects, objects);
+
+	    hittable_list bounded, unbounded;
+	    aabb temp_box;
+	    for (auto& obj : objects) {
+	        obj = collapse_transforms(obj);
+	        if (obj->bounding_box(time0, time1, temp_box)) {
+	            bounded.add(obj);
+	        } else {
+	            unbounded.add(obj);
+	        }
+	    }
+
+	    if (bounded.objects.size() < bvh_node::min_top_level_size) {
+	        world.objects = objects;
+	        return;
+	    }
+
+	    world = unbounded;
+	    world.add(std::make_shared<bvh>(bounded, time0, time1));
+	}
+
 	inline void set_camera(const point3 lookfrom, const point3 lookat, const double fov = 20.0, const double aperture = 0.1, const double dist_to_focus = 10.0, 
 			const double time0 = 0.0, const double time1 = 0.35, const vec3 vup = vec3(0,1,0)) {
 		cam = std::make_shared<camera>(lookfrom, lookat, vup, fov, aspect_ratio, aperture, dist_to_focus, time0, time1);
 	}	
 
+private:
+    static void flatten_lists(const std::vector<std::shared_ptr<hittable>>& src, std::vector<std::shared_ptr<hittable>>& dst) {
+	    for (const auto& obj : src) {
+	        if (const auto list = std::dynamic_pointer_cast<hittable_list>(obj)) {
+	            flatten_lists(list->objects, dst);
+	        } else {
+	            dst.push_back(obj);
+	        }
+	    }
+	}
+
 
 };
 
@@ -29,8 +29,7 @@ struct [[maybe_unused]] cornell_box_scene_fog : public scene {
 
         //big box
         std::shared_ptr<hittable> box1 = std::make_shared<box>(point3(0,0,0), point3(165,330,165), white);
-        box1 = std::make_shared<rotate_y>(box1, 15);
-        box1 = std::make_shared<translate>(box1, vec3(265, 0, 295));
+        box1 = std::make_shared<transform>(box1, affine::translation(vec3(265, 0, 295)) * affine::rotation_y(15));
         world.add(box1);
 
         //set_fog(std::make_shared<basic_constant_fog>(color(0.8, 0.8, 0.8), lambda, 0.3) );    //0.01, 0.007 possible lambda
@@ -30,15 +30,13 @@ struct [[maybe_unused]] cornell_box_gas_boxes_scene : public scene {
 
         //big box
         std::shared_ptr<hittable> box1 = std::make_shared<box>(point3(0,0,0), point3(165,330,165), white);
-        box1 = make_shared<rotate_y>(box1, 15);
-        box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+        box1 = std::make_shared<transform>(box1, affine::translation(vec3(265, 0, 295)) * affine::rotation_y(15));
         world.add(make_shared<constant_isotropic_medium>(box1, 0.01, color(0,0,0)) );
 
 
         //small box
         std::shared_ptr<hittable> box2 = std::make_shared<box>(point3(0,0,0), point3(165,165,165), white);
-        box2 = std::make_shared<rotate_y>(box2, -18);
-        box2 = std::make_shared<translate>(box2, vec3(130,0,65));
+        box2 = std::make_shared<transform>(box2, affine::translation(vec3(130,0,65)) * affine::rotation_y(-18));
         world.add(make_shared<constant_isotropic_medium>(box2, 0.01, color(1,1,1)));
 
 
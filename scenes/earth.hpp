@@ -11,7 +11,7 @@ struct [[maybe_unused]] earth_scene : public scene {
     earth_scene() : scene(aspec1) {
         set_background(background_color::black);
 
-        const auto earth_texture = std::make_shared<image_texture>("../textures/earthmap.jpg");
+        const auto earth_texture = texture_cache::get("../textures/earthmap.jpg");
         const auto earth_surface = std::make_shared<lambertian>(earth_texture);
         world.add(std::make_shared<sphere>(point3(0,0,0), 2, earth_surface));
 
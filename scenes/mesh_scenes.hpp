@@ -9,10 +9,10 @@
 
 
 struct [[maybe_unused]] door_scene : public scene {
-    door_scene() : scene(aspec1) {
+    explicit door_scene(const bvh_settings& model_settings = {}) : scene(aspec1) {
         set_background(background_color::sky);	//shouldn't matter -- can't see sky
 
-        world.add(generate_model("../models/door/door.obj"));
+        world.add(generate_model("../models/door/door.obj", false, model_settings));
         world.add(std::make_shared<sphere>(vec3(0, -100, -1), 100, std::make_shared<lambertian>(vec3(0,1,0)) ));
 
 
@@ -21,6 +21,81 @@ struct [[maybe_unused]] door_scene : public scene {
 };
 
 
+//the door as a streamed_mesh (brick_file is made by convert_model_to_bricks), keeping at most cache_size bytes of it in memory
+struct [[maybe_unused]] streamed_door_scene : public scene {
+    streamed_door_scene(const std::string& brick_file, const size_t cache_size) : scene(aspec1) {
+        set_background(background_color::sky);	//shouldn't matter -- can't see sky
+
+        world.add(std::make_shared<streamed_mesh>(brick_file, "../models/door/door.obj", cache_size));
+        world.add(std::make_shared<sphere>(vec3(0, -100, -1), 100, std::make_shared<lambertian>(vec3(0,1,0)) ));
+
+
+        set_camera(vec3(-3, 4, -5), vec3(0, 1, 0), 20.0, 0.0);
+    }
+};
+
+
+//a sphere of radius 2 made from an icosphere cage (the icosahedron subdivided twice, 320 patches), smoothed and displaced by noise
+// - each patch is tessellated into rate^2 triangles as rays reach it, keeping at most cache_size bytes of patches
+struct [[maybe_unused]] displaced_sphere_scene : public scene {
+    displaced_sphere_scene(const unsigned rate, const size_t cache_size) : scene(aspec1) {
+        set_background(background_color::sky);
+
+        std::vector<double> positions, normals, uvs;
+        std::vector<unsigned> indices;
+        icosphere(2, positions, indices);
+        for (size_t v = 0; v < positions.size() / 3; v++) {
+            const vec3 n(positions[3*v], positions[3*v + 1], positions[3*v + 2]);
+            normals.insert(normals.end(), {n.x(), n.y(), n.z()});
+            uvs.insert(uvs.end(), {(atan2(-n.z(), n.x()) + pi) / (2*pi), acos(-n.y()) / pi});
+            for (unsigned axis = 0; axis < 3; axis++) positions[3*v + axis] *= 2;
+        }
+
+        world.add(std::make_shared<tessellated_mesh>(positions, normals, uvs, indices, std::make_shared<lambertian>(color(0.8, 0.5, 0.3)),
+                                                     rate, std::make_shared<noise_texture>(4), 0.2, cache_size));
+        world.add(std::make_shared<sphere>(point3(0, -1002, 0), 1000, std::make_shared<lambertian>(vec3(0,1,0)) ));
+
+
+        set_camera(vec3(13.0, 2.0, 3.0), vec3(0.0, 0.0, 0.0), 20.0, 0.0);
+    }
+
+private:
+    //the unit icosahedron with each triangle split into 4 (with the new vertices pushed out onto the sphere) subdivisions times
+    static void icosphere(const unsigned subdivisions, std::vector<double>& positions, std::vector<unsigned>& indices) {
+        const double t = (1.0 + sqrt(5.0)) / 2.0;
+        for (const auto& p : {vec3(-1, t, 0), vec3(1, t, 0), vec3(-1, -t, 0), vec3(1, -t, 0), vec3(0, -1, t), vec3(0, 1, t),
+                              vec3(0, -1, -t), vec3(0, 1, -t), vec3(t, 0, -1), vec3(t, 0, 1), vec3(-t, 0, -1), vec3(-t, 0, 1)}) {
+            const vec3 n = unit_vector(p);
+            positions.insert(positions.end(), {n.x(), n.y(), n.z()});
+        }
+        indices = {0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,  1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+                   3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,  4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1};
+
+        for (unsigned s = 0; s < subdivisions; s++) {
+            std::unordered_map<std::uint64_t, unsigned> midpoints;   //the vertex made for each edge, so it is shared by both triangles
+            const auto midpoint = [&](const unsigned a, const unsigned b) {
+                const auto key = (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+                const auto [it, is_new] = midpoints.try_emplace(key, static_cast<unsigned>(positions.size() / 3));
+                if (is_new) {
+                    const vec3 n = unit_vector(vec3(positions[3*a] + positions[3*b], positions[3*a + 1] + positions[3*b + 1],
+                                                    positions[3*a + 2] + positions[3*b + 2]));
+                    positions.insert(positions.end(), {n.x(), n.y(), n.z()});
+                }
+                return it->second;
+            };
+
+            std::vector<unsigned> subdivided;
+            for (size_t tri = 0; tri < indices.size() / 3; tri++) {
+                const unsigned a = indices[3*tri], b = indices[3*tri + 1], c = indices[3*tri + 2];
+                const unsigned ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+                subdivided.insert(subdivided.end(), {a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca});
+            }
+            indices = std::move(subdivided);
+        }
+    }
+};
+
+
 struct [[maybe_unused]] cup_scene : public scene {
     cup_scene() : scene(aspec1) {
         set_background(background_color::sky);	//shouldn't matter -- can't see sky
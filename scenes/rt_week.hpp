@@ -8,8 +8,9 @@
 #include "../scene.hpp"
 
 
+//with group_ground false the boxes of the ground are left to go into the top-level bvh one by one (to compare with box_group)
 struct [[maybe_unused]] rt_week : public scene{
-    explicit rt_week() : scene(1) {
+    explicit rt_week(const bool group_ground = true) : scene(1) {
         set_background(background_color::black);
 
         hittable_list boxes1;
@@ -31,7 +32,8 @@ struct [[maybe_unused]] rt_week : public scene{
                 boxes1.add(make_shared<box>(point3(x0, y0, z0), point3(x1, y1, z1), ground));
             }
 
-        world.add(std::make_shared<bvh>(boxes1, 0, 1));
+        if (group_ground) world.add(std::make_shared<box_group>(boxes1));
+        else world.add(std::make_shared<hittable_list>(boxes1));
 
         //main light
         const auto light = std::make_shared<diffuse_light>(color(7, 7, 7));
@@ -59,7 +61,7 @@ struct [[maybe_unused]] rt_week : public scene{
         world.add(make_shared<constant_isotropic_medium>(boundary2, 0.0001, color(1,1,1) ));
 
         //Earth
-        const auto emat = make_shared<lambertian>(std::make_shared<image_texture>("../textures/earthmap.jpg"));
+        const auto emat = make_shared<lambertian>(texture_cache::get("../textures/earthmap.jpg"));
         world.add(make_shared<sphere>(point3(400,200,400), 100, emat));
 
         //sphere with noise texture
@@ -80,7 +82,7 @@ struct [[maybe_unused]] rt_week : public scene{
             }
         }
 
-        world.add(make_shared<translate>(make_shared<rotate_y>(std::make_shared<bvh>(boxes2, 0.0, 1.0), 30), vec3(-100, 270, 395) ));
+        world.add(std::make_shared<transform>(std::make_shared<bvh>(boxes2, 0.0, 1.0), affine::translation(vec3(-100, 270, 395)) * affine::rotation_y(30)));
 
         set_camera(point3(478, 278, -600), point3(278, 278, 0), 40.0, 0.0);
     }
@@ -61,7 +61,7 @@ struct [[maybe_unused]] rt_weekend : public scene {
         const auto material3 = std::make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
         obj.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-        world.add(std::make_shared<bvh>(obj, 0, 1));
+        world.add(std::make_shared<sphere_group>(obj));
 
 
         set_camera(vec3(13.0, 2.0, 3.0), vec3(0.0, 0.0, 0.0));
@@ -7,12 +7,19 @@
 
 #include "../scene.hpp"
 
+//with a bake_resolution the textures are baked into grids (see baked_texture) with that many samples along their longest side
+// - the ground is only baked near the spheres, further away it is evaluated as before
 struct [[maybe_unused]] two_perlin_spheres_scene : public scene {
-    two_perlin_spheres_scene() : scene(aspec1) {
+    explicit two_perlin_spheres_scene(const unsigned bake_resolution = 0)
+        : two_perlin_spheres_scene(std::make_shared<marble_texture>(4), std::make_shared<turbulent_texture>(5), bake_resolution) {}
+
+    two_perlin_spheres_scene(std::shared_ptr<texture> pertex1, std::shared_ptr<texture> pertex2, const unsigned bake_resolution) : scene(aspec1) {
         set_background(background_color::sky);
 
-        const auto pertex1 = std::make_shared<marble_texture>(4);
-        const auto pertex2 = std::make_shared<turbulent_texture>(5);
+        if (bake_resolution > 0) {
+            pertex1 = std::make_shared<baked_texture>(pertex1, aabb(point3(-15, -0.25, -15), point3(15, 0, 15)), bake_resolution);
+            pertex2 = std::make_shared<baked_texture>(pertex2, aabb(point3(-2, 0, -2), point3(2, 4, 2)), bake_resolution);
+        }
 
         world.add(std::make_shared<sphere>(point3(0,-1000,0), 1000, std::make_shared<lambertian>(pertex1) ));
         world.add(std::make_shared<sphere>(point3(0,    2,0),    2, std::make_shared<lambertian>(pertex2) ));
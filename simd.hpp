@@ -0,0 +1,174 @@
+#ifndef RAYTRACER_SIMD_HPP
+#define RAYTRACER_SIMD_HPP
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*=====================================================================================================================
+ The few SIMD operations the packet primitives (triangle_packet, sphere_packet, box_packet) need, for the widest SIMD available
+  - simd_lanes is single precision, simd_double_lanes is double precision
+  - comparisons give a mask_type, which is turned into 1 bit per lane by bits
+  - index_type is a 32 bit int per double lane, for gathers -- gather loads each lane from base[index of the lane] (a gather
+    instruction with AVX2 or AVX-512, a lane at a time without)
+  - neither is defined without SSE2, so the packets fall back to a lane at a time
+ ===================================================================================================================*/
+
+#if defined(__AVX__)
+struct simd_lanes {
+    using type = __m256;
+    static constexpr unsigned width = 8;
+
+    static inline type set(const float x) {return _mm256_set1_ps(x);}
+    static inline type load(const float* p) {return _mm256_load_ps(p);}
+    static inline void store(float* p, const type a) {_mm256_store_ps(p, a);}
+    static inline type add(const type a, const type b) {return _mm256_add_ps(a, b);}
+    static inline type sub(const type a, const type b) {return _mm256_sub_ps(a, b);}
+    static inline type mul(const type a, const type b) {return _mm256_mul_ps(a, b);}
+    static inline type div(const type a, const type b) {return _mm256_div_ps(a, b);}
+    static inline type greater_eq(const type a, const type b) {return _mm256_cmp_ps(a, b, _CMP_GE_OQ);}
+    static inline type greater(const type a, const type b) {return _mm256_cmp_ps(a, b, _CMP_GT_OQ);}
+    static inline type both(const type a, const type b) {return _mm256_and_ps(a, b);}
+    static inline type either(const type a, const type b) {return _mm256_or_ps(a, b);}
+    static inline unsigned mask(const type a) {return static_cast<unsigned>(_mm256_movemask_ps(a));}
+};
+#elif defined(__SSE2__)
+struct simd_lanes {
+    using type = __m128;
+    static constexpr unsigned width = 4;
+
+    static inline type set(const float x) {return _mm_set1_ps(x);}
+    static inline type load(const float* p) {return _mm_load_ps(p);}
+    static inline void store(float* p, const type a) {_mm_store_ps(p, a);}
+    static inline type add(const type a, const type b) {return _mm_add_ps(a, b);}
+    static inline type sub(const type a, const type b) {return _mm_sub_ps(a, b);}
+    static inline type mul(const type a, const type b) {return _mm_mul_ps(a, b);}
+    static inline type div(const type a, const type b) {return _mm_div_ps(a, b);}
+    static inline type greater_eq(const type a, const type b) {return _mm_cmpge_ps(a, b);}
+    static inline type greater(const type a, const type b) {return _mm_cmpgt_ps(a, b);}
+    static inline type both(const type a, const type b) {return _mm_and_ps(a, b);}
+    static inline type either(const type a, const type b) {return _mm_or_ps(a, b);}
+    static inline unsigned mask(const type a) {return static_cast<unsigned>(_mm_movemask_ps(a));}
+};
+#endif
+
+
+#if defined(__AVX512F__)
+struct simd_double_lanes {
+    using type = __m512d;
+    using mask_type = __mmask8;
+    static constexpr unsigned width = 8;
+
+    static inline type set(const double x) {return _mm512_set1_pd(x);}
+    static inline type load(const double* p) {return _mm512_load_pd(p);}
+    static inline void store(double* p, const type a) {_mm512_store_pd(p, a);}
+    static inline type add(const type a, const type b) {return _mm512_add_pd(a, b);}
+    static inline type sub(const type a, const type b) {return _mm512_sub_pd(a, b);}
+    static inline type mul(const type a, const type b) {return _mm512_mul_pd(a, b);}
+    static inline type div(const type a, const type b) {return _mm512_div_pd(a, b);}
+    static inline type min(const type a, const type b) {return _mm512_min_pd(a, b);}
+    static inline type max(const type a, const type b) {return _mm512_max_pd(a, b);}
+    static inline type sqrt(const type a) {return _mm512_sqrt_pd(a);}
+    static inline type floor(const type a) {return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);}
+    static inline mask_type greater_eq(const type a, const type b) {return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ);}
+    static inline mask_type both(const mask_type a, const mask_type b) {return a & b;}
+    static inline mask_type either(const mask_type a, const mask_type b) {return a | b;}
+    static inline type select(const mask_type m, const type a, const type b) {return _mm512_mask_blend_pd(m, b, a);} //a where m is set
+    static inline unsigned bits(const mask_type m) {return m;}
+
+    using index_type = __m256i;
+    static inline index_type set_index(const int x) {return _mm256_set1_epi32(x);}
+    static inline index_type to_index(const type a) {return _mm512_cvttpd_epi32(a);}  //truncated
+    static inline index_type add(const index_type a, const index_type b) {return _mm256_add_epi32(a, b);}
+    static inline index_type both(const index_type a, const index_type b) {return _mm256_and_si256(a, b);}
+    static inline index_type either_not_both(const index_type a, const index_type b) {return _mm256_xor_si256(a, b);}
+    static inline index_type gather(const int* base, const index_type index) {return _mm256_i32gather_epi32(base, index, 4);}
+    static inline type gather(const double* base, const index_type index) {return _mm512_i32gather_pd(index, base, 8);}
+};
+#elif defined(__AVX__)
+struct simd_double_lanes {
+    using type = __m256d;
+    using mask_type = __m256d;
+    static constexpr unsigned width = 4;
+
+    static inline type set(const double x) {return _mm256_set1_pd(x);}
+    static inline type load(const double* p) {return _mm256_load_pd(p);}
+    static inline void store(double* p, const type a) {_mm256_store_pd(p, a);}
+    static inline type add(const type a, const type b) {return _mm256_add_pd(a, b);}
+    static inline type sub(const type a, const type b) {return _mm256_sub_pd(a, b);}
+    static inline type mul(const type a, const type b) {return _mm256_mul_pd(a, b);}
+    static inline type div(const type a, const type b) {return _mm256_div_pd(a, b);}
+    static inline type min(const type a, const type b) {return _mm256_min_pd(a, b);}
+    static inline type max(const type a, const type b) {return _mm256_max_pd(a, b);}
+    static inline type sqrt(const type a) {return _mm256_sqrt_pd(a);}
+    static inline type floor(const type a) {return _mm256_floor_pd(a);}
+    static inline mask_type greater_eq(const type a, const type b) {return _mm256_cmp_pd(a, b, _CMP_GE_OQ);}
+    static inline mask_type both(const mask_type a, const mask_type b) {return _mm256_and_pd(a, b);}
+    static inline mask_type either(const mask_type a, const mask_type b) {return _mm256_or_pd(a, b);}
+    static inline type select(const mask_type m, const type a, const type b) {return _mm256_blendv_pd(b, a, m);}
+    static inline unsigned bits(const mask_type m) {return static_cast<unsigned>(_mm256_movemask_pd(m));}
+
+    using index_type = __m128i;
+    static inline index_type set_index(const int x) {return _mm_set1_epi32(x);}
+    static inline index_type to_index(const type a) {return _mm256_cvttpd_epi32(a);}  //truncated
+    static inline index_type add(const index_type a, const index_type b) {return _mm_add_epi32(a, b);}
+    static inline index_type both(const index_type a, const index_type b) {return _mm_and_si128(a, b);}
+    static inline index_type either_not_both(const index_type a, const index_type b) {return _mm_xor_si128(a, b);}
+#if defined(__AVX2__)
+    static inline index_type gather(const int* base, const index_type index) {return _mm_i32gather_epi32(base, index, 4);}
+    static inline type gather(const double* base, const index_type index) {return _mm256_i32gather_pd(base, index, 8);}
+#else
+    static inline index_type gather(const int* base, const index_type index) {
+        return _mm_set_epi32(base[_mm_extract_epi32(index, 3)], base[_mm_extract_epi32(index, 2)], base[_mm_extract_epi32(index, 1)], base[_mm_cvtsi128_si32(index)]);
+    }
+    static inline type gather(const double* base, const index_type index) {
+        return _mm256_set_pd(base[_mm_extract_epi32(index, 3)], base[_mm_extract_epi32(index, 2)], base[_mm_extract_epi32(index, 1)], base[_mm_cvtsi128_si32(index)]);
+    }
+#endif
+};
+#elif defined(__SSE2__)
+struct simd_double_lanes {
+    using type = __m128d;
+    using mask_type = __m128d;
+    static constexpr unsigned width = 2;
+
+    static inline type set(const double x) {return _mm_set1_pd(x);}
+    static inline type load(const double* p) {return _mm_load_pd(p);}
+    static inline void store(double* p, const type a) {_mm_store_pd(p, a);}
+    static inline type add(const type a, const type b) {return _mm_add_pd(a, b);}
+    static inline type sub(const type a, const type b) {return _mm_sub_pd(a, b);}
+    static inline type mul(const type a, const type b) {return _mm_mul_pd(a, b);}
+    static inline type div(const type a, const type b) {return _mm_div_pd(a, b);}
+    static inline type min(const type a, const type b) {return _mm_min_pd(a, b);}
+    static inline type max(const type a, const type b) {return _mm_max_pd(a, b);}
+    static inline type sqrt(const type a) {return _mm_sqrt_pd(a);}
+    static inline type floor(const type a) {
+#if defined(__SSE4_1__)
+        return _mm_floor_pd(a);
+#else
+        const type truncated = _mm_cvtepi32_pd(_mm_cvttpd_epi32(a));    //for |a| < 2^31
+        return _mm_sub_pd(truncated, _mm_and_pd(_mm_cmpgt_pd(truncated, a), _mm_set1_pd(1.0)));
+#endif
+    }
+    static inline mask_type greater_eq(const type a, const type b) {return _mm_cmpge_pd(a, b);}
+    static inline mask_type both(const mask_type a, const mask_type b) {return _mm_and_pd(a, b);}
+    static inline mask_type either(const mask_type a, const mask_type b) {return _mm_or_pd(a, b);}
+    static inline type select(const mask_type m, const type a, const type b) {return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b));}
+    static inline unsigned bits(const mask_type m) {return static_cast<unsigned>(_mm_movemask_pd(m));}
+
+    using index_type = __m128i;     //the low 2 ints are used
+    static inline index_type set_index(const int x) {return _mm_set1_epi32(x);}
+    static inline index_type to_index(const type a) {return _mm_cvttpd_epi32(a);}  //truncated
+    static inline index_type add(const index_type a, const index_type b) {return _mm_add_epi32(a, b);}
+    static inline index_type both(const index_type a, const index_type b) {return _mm_and_si128(a, b);}
+    static inline index_type either_not_both(const index_type a, const index_type b) {return _mm_xor_si128(a, b);}
+    static inline index_type gather(const int* base, const index_type index) {
+        return _mm_set_epi32(0, 0, base[_mm_cvtsi128_si32(_mm_srli_si128(index, 4))], base[_mm_cvtsi128_si32(index)]);
+    }
+    static inline type gather(const double* base, const index_type index) {
+        return _mm_set_pd(base[_mm_cvtsi128_si32(_mm_srli_si128(index, 4))], base[_mm_cvtsi128_si32(index)]);
+    }
+};
+#endif
+
+#endif //RAYTRACER_SIMD_HPP
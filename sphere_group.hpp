@@ -0,0 +1,184 @@
+#ifndef RAYTRACER_SPHERE_GROUP_HPP
+#define RAYTRACER_SPHERE_GROUP_HPP
+
+#include "sphere.hpp"
+#include "moving_sphere.hpp"
+#include "hittable_list.hpp"
+#include "indexed_bvh.hpp"
+#include "sphere_packet.hpp"
+
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+
+/*=====================================================================================================================
+ Many spheres (static and moving) as a single hittable, for scenes with large fields of small spheres
+  - each property of the spheres is stored in its own array (centres, radii, ...) instead of as a hittable per sphere
+  - motion is optional -- the velocities and start times are only stored if any of the spheres move
+  - materials are shared by index, so spheres with the same material only store it once
+  - the bvh refers to the spheres by index, and the spheres are stored in the order of the leaves
+  - each leaf of the bvh holds its spheres in a sphere_packet, which is intersected with SIMD
+  - the hits are the same as for the spheres tested one at a time, but there is no pdf_value or random (so it can't be a light)
+ ===================================================================================================================*/
+struct sphere_group : public hittable {
+    std::vector<point3> centers;    //the centres at time0 for moving spheres
+    std::vector<double> radii;      //negative for hollow spheres (the normals point inwards)
+    std::vector<vec3> velocities;   //empty if no sphere moves
+    std::vector<double> times0;     //empty if no sphere moves
+    std::vector<unsigned> material_ids;
+    std::vector<std::shared_ptr<material>> materials;
+
+    sphere_group() = delete;
+    //spheres should only hold sphere and moving_sphere objects -- anything else is left out
+    explicit sphere_group(const hittable_list& spheres, const bvh_settings& settings = {});
+
+
+    inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+        rec.t = t_max;
+        unsigned closest;
+        if (!group->hit(r, t_min, rec, closest))
+            return false;
+
+        rec.primitive_id = closest;
+        return true;
+    }
+
+    void hit_info(const ray& r, double t_min, double t_max, hit_record& rec) override;
+
+    inline bool bounding_box([[maybe_unused]] const double time0, [[maybe_unused]] const double time1, aabb& output_box) const override {
+        output_box = group->box;
+        return true;
+    }
+
+    [[nodiscard]] inline size_t num_spheres() const {
+        return radii.size();
+    }
+
+    [[nodiscard]] inline point3 center(const unsigned i, const double time) const {
+        return velocities.empty() ? centers[i] : centers[i] + (time - times0[i]) * velocities[i];
+    }
+
+    //used by the bvh
+    static constexpr unsigned leaf_size = sphere_packet::width;
+    using leaf_block = sphere_packet;
+
+    [[nodiscard]] sphere_packet make_leaf_block(unsigned first, unsigned count) const;
+
+    inline bool hit_leaf_block(const sphere_packet& packet, const ray& r, const double t_min, hit_record& rec, unsigned& closest) const {
+        double t;
+        const int lane = packet.hit(r, t_min, rec.t, t);
+        if (lane < 0)
+            return false;
+
+        rec.t = t;
+        closest = packet.first + lane;
+        return true;
+    }
+
+    void reorder_primitives(unsigned first, const std::vector<unsigned>& ids);
+
+private:
+    std::unique_ptr<indexed_bvh<sphere_group>> group;
+
+    static inline void get_sphere_uv(const point3& p, double& u, double& v) {
+        //same as sphere::get_sphere_uv
+        const auto theta = acos(-p.y());
+        const auto phi = atan2(-p.z(), p.x()) + pi;
+
+        u = phi / two_pi;
+        v = theta / pi;
+    }
+
+    //permutes one of the arrays in the same way as reorder_primitives
+    template <typename T>
+    static inline void reorder(std::vector<T>& values, const unsigned first, const std::vector<unsigned>& ids) {
+        const std::vector<T> old(values.begin() + first, values.begin() + first + ids.size());
+        for (unsigned k = 0; k < ids.size(); k++) {
+            values[first + k] = old[ids[k] - first];
+        }
+    }
+};
+
+
+sphere_group::sphere_group(const hittable_list& spheres, const bvh_settings& settings) {
+    std::unordered_map<const material*, unsigned> material_index;
+    std::vector<bvh_primitive> prims;
+    std::vector<vec3> velocity;
+    std::vector<double> time0;
+    bool any_moving = false;
+
+    const auto add = [&](const point3& center, const vec3& dc_d_dt, const double t0, const double radius,
+                         const std::shared_ptr<material>& mat, const aabb& box) {
+        const auto [it, is_new] = material_index.try_emplace(mat.get(), static_cast<unsigned>(materials.size()));
+        if (is_new) materials.push_back(mat);
+
+        prims.push_back({box, static_cast<unsigned>(radii.size())});
+        centers.push_back(center);
+        radii.push_back(radius);
+        velocity.push_back(dc_d_dt);
+        time0.push_back(t0);
+        material_ids.push_back(it->second);
+    };
+
+    for (const auto& object : spheres.objects) {
+        if (const auto s = std::dynamic_pointer_cast<sphere>(object)) {
+            const vec3 r(std::abs(s->radius));   //hollow spheres have a negative radius
+            add(s->center, vec3(0, 0, 0), 0, s->radius, s->mat_ptr, aabb(s->center - r, s->center + r));
+        } else if (const auto m = std::dynamic_pointer_cast<moving_sphere>(object)) {
+            const vec3 r(std::abs(m->radius));
+            const aabb box = surrounding_box(aabb(m->center(m->time0) - r, m->center(m->time0) + r),
+                                             aabb(m->center(m->time1) - r, m->center(m->time1) + r));
+            add(m->center0, m->dc_d_dt, m->time0, m->radius, m->mat_ptr, box);
+            any_moving = true;
+        } else {
+            std::cerr << "sphere_group given an object that is not a sphere -- it is left out" << std::endl;
+        }
+    }
+
+    if (any_moving) {
+        velocities = std::move(velocity);
+        times0 = std::move(time0);
+    }
+
+    group = std::make_unique<indexed_bvh<sphere_group>>(*this, prims, 0, settings);
+}
+
+sphere_packet sphere_group::make_leaf_block(const unsigned first, const unsigned count) const {
+    sphere_packet packet;
+    packet.first = first;
+    packet.count = count;
+    for (unsigned i = 0; i < count; i++) {
+        const unsigned s = first + i;
+        if (velocities.empty()) {
+            packet.set_sphere(i, centers[s], vec3(0, 0, 0), 0, radii[s]);
+        } else {
+            packet.set_sphere(i, centers[s], velocities[s], times0[s], radii[s]);
+        }
+    }
+    return packet;
+}
+
+void sphere_group::hit_info(const ray& r, [[maybe_unused]] const double t_min, [[maybe_unused]] const double t_max, hit_record& rec) {
+    //the same as sphere::hit_info for the sphere hit
+    const unsigned s = rec.primitive_id;
+    rec.p = r.at(rec.t);
+    const vec3 outward_normal = (rec.p - center(s, r.time())) / radii[s];
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = materials[material_ids[s]].get();
+
+    get_sphere_uv(outward_normal, rec.u, rec.v);
+    rec.set_uv_footprint(r, 1 / (2*pi*std::abs(radii[s])));
+}
+
+void sphere_group::reorder_primitives(const unsigned first, const std::vector<unsigned>& ids) {
+    reorder(centers, first, ids);
+    reorder(radii, first, ids);
+    reorder(material_ids, first, ids);
+    if (!velocities.empty()) {
+        reorder(velocities, first, ids);
+        reorder(times0, first, ids);
+    }
+}
+
+#endif //RAYTRACER_SPHERE_GROUP_HPP
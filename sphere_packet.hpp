@@ -0,0 +1,127 @@
+#ifndef RAYTRACER_SPHERE_PACKET_HPP
+#define RAYTRACER_SPHERE_PACKET_HPP
+
+#include "ray.hpp"
+#include "simd.hpp"
+
+#include <limits>
+
+
+/*=====================================================================================================================
+ A few spheres stored as a structure of arrays so they can all be intersected at once with SIMD
+  - 8 spheres with AVX-512, otherwise 4 (in 1 go with AVX, 2 with SSE2, and a sphere at a time without SSE2)
+  - double precision (unlike triangle_packet) so the hit times are the same as sphere and moving_sphere give
+  - moving spheres store their centre at time0 and velocity (as moving_sphere does), static spheres have a velocity of 0
+  - packets with no moving spheres skip finding the centres at the ray's time
+  - unused lanes are masked out by count
+ ===================================================================================================================*/
+
+struct alignas(64) sphere_packet {
+#if defined(__AVX512F__)
+    static constexpr unsigned width = 8;
+#else
+    static constexpr unsigned width = 4;
+#endif
+
+    double center0[3][width]{};     //[axis][sphere]
+    double velocity[3][width]{};    //(centre1 - centre0)/(time1 - time0)
+    double time0[width]{};
+    double radius_squared[width]{};
+    unsigned first = 0; //the index of the first sphere (the spheres of a packet are next to each other)
+    unsigned count = 0;
+    bool moving = false;    //whether any sphere in the packet has a velocity
+
+    inline void set_sphere(const unsigned lane, const point3& center, const vec3& vel, const double t0, const double radius) {
+        for (unsigned axis = 0; axis < 3; axis++) {
+            center0[axis][lane] = center[axis];
+            velocity[axis][lane] = vel[axis];
+        }
+        time0[lane] = t0;
+        radius_squared[lane] = radius * radius;
+        moving = moving || vel.length_squared() > 0;
+    }
+
+    //finds the closest of the spheres hit between t_min and t_max
+    // - returns the lane of the sphere hit (-1 if none were hit) and sets its hit time
+    inline int hit(const ray& r, double t_min, double t_max, double& t) const;
+};
+
+
+inline int sphere_packet::hit(const ray& r, const double t_min, const double t_max, double& t) const {
+    //the quadratic in sphere::hit_time for every lane at once
+    alignas(64) double t_lanes[width];
+    unsigned hit_mask = 0;
+
+#if defined(__AVX__) || defined(__SSE2__)
+    using L = simd_double_lanes;
+    const L::type dx = L::set(r.dir.x()), dy = L::set(r.dir.y()), dz = L::set(r.dir.z());
+    const L::type ox = L::set(r.orig.x()), oy = L::set(r.orig.y()), oz = L::set(r.orig.z());
+    const L::type a = L::set(r.dir.length_squared());
+    const L::type time = L::set(r.time());
+    const L::type zero = L::set(0.0), lower = L::set(t_min), upper = L::set(t_max);
+
+    for (unsigned base = 0; base < width; base += L::width) {
+        L::type cx = L::load(&center0[0][base]), cy = L::load(&center0[1][base]), cz = L::load(&center0[2][base]);
+        if (moving) {
+            //center(time) = center0 + (time - time0)*velocity
+            const L::type dt = L::sub(time, L::load(&time0[base]));
+            cx = L::add(cx, L::mul(dt, L::load(&velocity[0][base])));
+            cy = L::add(cy, L::mul(dt, L::load(&velocity[1][base])));
+            cz = L::add(cz, L::mul(dt, L::load(&velocity[2][base])));
+        }
+
+        const L::type ocx = L::sub(ox, cx), ocy = L::sub(oy, cy), ocz = L::sub(oz, cz);
+        const L::type half_b = L::add(L::add(L::mul(ocx, dx), L::mul(ocy, dy)), L::mul(ocz, dz));
+        const L::type c = L::sub(L::add(L::add(L::mul(ocx, ocx), L::mul(ocy, ocy)), L::mul(ocz, ocz)), L::load(&radius_squared[base]));
+        const L::type discriminant = L::sub(L::mul(half_b, half_b), L::mul(a, c));
+        const L::type sqrtd = L::sqrt(L::max(discriminant, zero));  //lanes with no hit are masked out below
+
+        const L::type root1 = L::div(L::sub(L::sub(zero, half_b), sqrtd), a);
+        const L::type root2 = L::div(L::add(L::sub(zero, half_b), sqrtd), a);
+        const L::mask_type use1 = L::both(L::greater_eq(root1, lower), L::greater_eq(upper, root1));
+        const L::mask_type use2 = L::both(L::greater_eq(root2, lower), L::greater_eq(upper, root2));
+        const L::mask_type valid = L::both(L::greater_eq(discriminant, zero), L::either(use1, use2));
+
+        hit_mask |= L::bits(valid) << base;
+        L::store(&t_lanes[base], L::select(use1, root1, root2));
+    }
+    hit_mask &= (1u << count) - 1;
+    if (hit_mask == 0) return -1;
+#else
+    for (unsigned i = 0; i < count; i++) {
+        const double dt = r.time() - time0[i];
+        const vec3 center(center0[0][i] + dt*velocity[0][i], center0[1][i] + dt*velocity[1][i], center0[2][i] + dt*velocity[2][i]);
+        const vec3 oc = r.orig - center;
+        const double a = r.dir.length_squared();
+        const double half_b = dot(oc, r.dir);
+        const double c = oc.length_squared() - radius_squared[i];
+        const double discriminant = half_b*half_b - a*c;
+        if (discriminant < 0) continue;
+
+        const double sqrtd = sqrt(discriminant);
+        t_lanes[i] = (-half_b - sqrtd) / a;
+        if (t_lanes[i] < t_min || t_max < t_lanes[i]) {
+            t_lanes[i] = (-half_b + sqrtd) / a;
+            if (t_lanes[i] < t_min || t_max < t_lanes[i]) continue;
+        }
+        hit_mask |= 1u << i;
+    }
+    if (hit_mask == 0) return -1;
+#endif
+
+    //the closest of the spheres hit
+    // - on a tie the later sphere is used, as happens when a list of spheres is tested one at a time
+    int closest = -1;
+    double t_closest = std::numeric_limits<double>::infinity();
+    for (unsigned i = 0; i < width; i++) {
+        if ((hit_mask & (1u << i)) && t_lanes[i] <= t_closest) {
+            t_closest = t_lanes[i];
+            closest = static_cast<int>(i);
+        }
+    }
+
+    t = t_closest;
+    return closest;
+}
+
+#endif //RAYTRACER_SPHERE_PACKET_HPP
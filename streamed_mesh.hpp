@@ -0,0 +1,523 @@
+#ifndef RAYTRACER_STREAMED_MESH_HPP
+#define RAYTRACER_STREAMED_MESH_HPP
+
+#include "mesh_file.hpp"
+#include "box.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+
+/*=====================================================================================================================
+ A mesh too large to keep in memory -- only the top levels of its bvh stay resident, and its triangles are paged in as needed
+  - the triangles are split into bricks of up to brick_size triangles that are close together (the leaves of the top level bvh)
+  - each brick is stored in a memory mapped file with its own vertices and bvh (made once with convert_model_to_bricks)
+  - a brick is paged into a brick_cache the first time a ray reaches it, and the least recently used bricks are dropped
+    once the cache is over its budget
+  - a paged in brick is a triangle_mesh made from its stored bvh, so it is intersected like any other mesh
+  - rays are deferred at bricks that are not in the cache: the bricks in the cache are tested first, and a deferred brick
+    is only paged in if the ray enters it before the closest hit found so far -- bricks hidden behind resident ones are never paged
+  - the bvh of each brick is stored with leaves of up to triangle_mesh::leaf_size triangles, so a brick file is only used where
+    packets are the same width as where it was made (convert it again otherwise)
+  - the header, the top level bvh and every brick (where it is, its triangles and its bvh) are checked when the file is opened
+ ===================================================================================================================*/
+
+//layout of a brick file -- every array starts on a 64 byte boundary
+struct brick_file_header {
+    static constexpr char magic_value[8] = "rtbrick";
+    static constexpr std::uint32_t current_version = 2;
+
+    char magic[8]{};
+    std::uint32_t version = current_version;
+    std::uint32_t num_bricks = 0;
+    std::uint32_t num_nodes = 0;        //in the top level bvh
+    std::uint32_t num_materials = 0;
+    std::uint32_t triangle_bits = 0;    //the triangles of a brick are numbered in this many bits (see streamed_mesh::hit_time)
+    std::uint32_t leaf_size = 0;        //the most triangles in a leaf of the bvh of a brick (triangle_mesh::leaf_size when it was made)
+
+    //offsets from the start of the file
+    std::uint64_t nodes = 0;        //bvh_info -- the leaves refer to bricks instead of triangles
+    std::uint64_t bricks = 0;       //brick_info
+    std::uint64_t colors = 0;       //double, 3 per material
+    std::uint64_t tex_paths = 0;    //the texture path of each material, each ended by '\0' (as in mesh_file_header)
+    std::uint64_t tex_paths_size = 0;
+};
+
+//where a brick is in the file, and how big it is
+struct brick_info {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint32_t num_vertices = 0;
+    std::uint32_t num_triangles = 0;
+    std::uint32_t num_nodes = 0;
+    std::uint32_t has_material_ids = 0;
+
+    //the offsets of the arrays of the brick from the start of the file -- positions, normals, uvs, indices, material_ids, nodes
+    [[nodiscard]] inline std::array<std::uint64_t, 6> arrays() const {
+        const std::array<std::uint64_t, 6> sizes = {3 * sizeof(double) * num_vertices, 3 * sizeof(double) * num_vertices,
+                                                    2 * sizeof(double) * num_vertices, 3 * sizeof(unsigned) * num_triangles,
+                                                    has_material_ids ? sizeof(unsigned) * num_triangles : 0, sizeof(bvh_info) * num_nodes};
+        std::array<std::uint64_t, 6> offsets{};
+        std::uint64_t end = offset;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            offsets[i] = (end + 63) / 64 * 64;
+            end = offsets[i] + sizes[i];
+        }
+        return offsets;
+    }
+
+    //the end of the last array
+    [[nodiscard]] inline std::uint64_t end() const {
+        return arrays()[5] + sizeof(bvh_info) * num_nodes;
+    }
+};
+
+
+//the bricks of a streamed_mesh that are in memory, up to a budget in bytes (also the patches of a tessellated_mesh)
+// - the least recently used brick is dropped when a new brick goes over the budget
+// - bricks are shared pointers, so a brick dropped while a ray is still in it stays alive until the ray is done
+struct brick_cache {
+    const size_t capacity;
+
+    //statistics -- reset between frames with reset_stats
+    std::atomic<size_t> num_hits = 0;       //a ray reached a brick that was in the cache
+    std::atomic<size_t> num_misses = 0;     //a brick had to be paged in
+    std::atomic<size_t> bytes_paged = 0;    //read from the file for the bricks paged in (or made, for tessellated patches)
+
+    brick_cache() = delete;
+    explicit brick_cache(const size_t _capacity) : capacity(_capacity) {}
+
+    //the brick if it is in the cache (counted as a hit when count is true)
+    std::shared_ptr<triangle_mesh> find(unsigned brick, bool count = true);
+
+    //adds a brick that was just paged in -- gives back the brick in the cache, which is not mesh if another thread added it first
+    std::shared_ptr<triangle_mesh> insert(unsigned brick, std::shared_ptr<triangle_mesh> mesh, size_t size);
+
+    [[nodiscard]] inline double hit_rate() const {
+        const size_t total = num_hits + num_misses;
+        return total == 0 ? 1.0 : static_cast<double>(num_hits) / static_cast<double>(total);
+    }
+
+    inline void reset_stats() {
+        num_hits = 0;
+        num_misses = 0;
+        bytes_paged = 0;
+    }
+
+    [[nodiscard]] inline size_t memory_usage() const {
+        const std::lock_guard<std::mutex> lock(cache_mutex);
+        return used;
+    }
+
+private:
+    struct entry {
+        std::shared_ptr<triangle_mesh> mesh;
+        size_t size;
+        std::list<unsigned>::iterator position;     //in order
+    };
+
+    mutable std::mutex cache_mutex;
+    std::list<unsigned> order;  //most recently used first
+    std::unordered_map<unsigned, entry> entries;
+    size_t used = 0;
+};
+
+std::shared_ptr<triangle_mesh> brick_cache::find(const unsigned brick, const bool count) {
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    const auto it = entries.find(brick);
+    if (it == entries.end())
+        return nullptr;
+
+    order.splice(order.begin(), order, it->second.position);
+    if (count) ++num_hits;
+    return it->second.mesh;
+}
+
+std::shared_ptr<triangle_mesh> brick_cache::insert(const unsigned brick, std::shared_ptr<triangle_mesh> mesh, const size_t size) {
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    if (const auto it = entries.find(brick); it != entries.end())
+        return it->second.mesh;
+
+    order.push_front(brick);
+    entries.emplace(brick, entry{mesh, size, order.begin()});
+    used += size;
+
+    //dropping bricks until back in budget (the new brick is always kept)
+    while (used > capacity && order.size() > 1) {
+        const auto dropped = entries.find(order.back());
+        used -= dropped->second.size;
+        entries.erase(dropped);
+        order.pop_back();
+    }
+    return mesh;
+}
+
+
+struct streamed_mesh : public hittable {
+    brick_cache cache;
+
+    streamed_mesh() = delete;
+    //brick_file is made by convert_model_to_bricks from model_file (textures are found relative to model_file)
+    // - cache_size is the most bytes of bricks kept in memory
+    streamed_mesh(const std::string& brick_file, const std::string& model_file, size_t cache_size);
+
+    bool hit_time(const ray& r, double t_min, double t_max, hit_record& rec) override;
+    void hit_info(const ray& r, double t_min, double t_max, hit_record& rec) override;
+
+    inline bool bounding_box([[maybe_unused]] const double time0, [[maybe_unused]] const double time1, aabb& output_box) const override {
+        output_box = nodes.empty() ? aabb() : nodes[0].box;
+        return !nodes.empty();
+    }
+
+    [[nodiscard]] inline size_t num_bricks() const {
+        return bricks.size();
+    }
+
+    //the memory always used (the top level bvh and the brick table), not including the bricks in the cache
+    [[nodiscard]] inline size_t resident_memory() const {
+        return nodes.size() * sizeof(bvh_info) + bricks.size() * sizeof(brick_info);
+    }
+
+private:
+    std::shared_ptr<const mapped_file> file;
+    std::vector<bvh_info> nodes;
+    std::vector<brick_info> bricks;
+    std::vector<std::shared_ptr<material>> materials;
+    unsigned triangle_bits = 0;
+
+    //the brick from the cache, or paged in from the file
+    std::shared_ptr<triangle_mesh> get_brick(unsigned brick);
+
+    //whether the top level bvh and the bricks only refer to what is in the file, including the triangles and bvh of each
+    //brick -- so nothing read when a brick is paged in has to be checked again
+    [[nodiscard]] bool check_bricks(const brick_file_header& header) const;
+
+    //hit_record::primitive_id is the brick in the high bits and the triangle in the brick in the low triangle_bits
+    inline bool hit_brick(triangle_mesh& mesh, const unsigned brick, const ray& r, const double t_min, hit_record& rec) const {
+        if (!mesh.hit_time(r, t_min, rec.t, rec))
+            return false;
+
+        rec.primitive_id |= brick << triangle_bits;
+        return true;
+    }
+};
+
+
+streamed_mesh::streamed_mesh(const std::string& brick_file, const std::string& model_file, const size_t cache_size)
+        : cache(cache_size), file(std::make_shared<const mapped_file>(brick_file)) {
+    brick_file_header header;
+    if (file->size < sizeof(header)) {
+        std::cerr << brick_file << " is not a brick file" << std::endl;
+        return;
+    }
+    std::memcpy(&header, file->data, sizeof(header));
+    if (std::memcmp(header.magic, brick_file_header::magic_value, sizeof(header.magic)) != 0 || header.version != brick_file_header::current_version) {
+        std::cerr << brick_file << " is not a brick file, or was made by a different version (convert the model again)" << std::endl;
+        return;
+    }
+    if (header.leaf_size != triangle_mesh::leaf_size) {
+        std::cerr << "The bricks in " << brick_file << " have leaves of " << header.leaf_size << " triangles (" << triangle_mesh::leaf_size
+                  << " here) -- convert the model again" << std::endl;
+        return;
+    }
+    if (header.triangle_bits >= 32 || (std::uint64_t{header.num_bricks} << header.triangle_bits) > std::numeric_limits<unsigned>::max() ||
+        !file->contains(header.nodes, header.num_nodes, sizeof(bvh_info)) ||
+        !file->contains(header.bricks, header.num_bricks, sizeof(brick_info)) ||
+        !file->contains(header.colors, 3ull * header.num_materials, sizeof(double), alignof(double)) ||
+        !file->contains(header.tex_paths, header.tex_paths_size, 1)) {
+        std::cerr << brick_file << " is damaged (its header does not match what is in it)" << std::endl;
+        return;
+    }
+    triangle_bits = header.triangle_bits;
+
+    nodes.resize(header.num_nodes);
+    std::memcpy(nodes.data(), file->data + header.nodes, nodes.size() * sizeof(bvh_info));
+    bricks.resize(header.num_bricks);
+    std::memcpy(bricks.data(), file->data + header.bricks, bricks.size() * sizeof(brick_info));
+
+    std::vector<std::string> tex_paths;
+    std::vector<color> colors;
+    const char* path = file->data + header.tex_paths;
+    const char* const paths_end = path + header.tex_paths_size;
+    const auto color_values = reinterpret_cast<const double*>(file->data + header.colors);
+    for (unsigned i = 0; i < header.num_materials; i++) {
+        const auto path_end = static_cast<const char*>(std::memchr(path, '\0', static_cast<size_t>(paths_end - path)));
+        if (path_end == nullptr) break;
+        tex_paths.emplace_back(path, path_end);
+        path = path_end + 1;
+        colors.emplace_back(color_values[3*i], color_values[3*i + 1], color_values[3*i + 2]);
+    }
+
+    //a damaged file is left empty, so nothing hits it
+    if (tex_paths.size() != header.num_materials || !check_bricks(header)) {
+        std::cerr << brick_file << " is damaged (its bvh or a brick does not match what is in it)" << std::endl;
+        nodes.clear();
+        bricks.clear();
+        return;
+    }
+    materials = model_materials(model_file, tex_paths, colors);
+}
+
+bool streamed_mesh::check_bricks(const brick_file_header& header) const {
+    if (nodes.empty() || header.num_materials == 0) return false;   //the triangles use material 0 when a brick has no material ids
+
+    //the top level bvh is walked from the root, so every node is seen once and its depth is known (as in indexed_bvh::is_valid)
+    std::vector<std::uint8_t> seen(nodes.size(), 0);
+    std::vector<std::pair<unsigned, size_t>> to_visit = {{0, 1}};   //(node, depth)
+    seen[0] = 1;
+    const auto add_child = [&](const unsigned child, const size_t depth) {
+        if (child >= nodes.size() || seen[child]) return false;
+        seen[child] = 1;
+        to_visit.emplace_back(child, depth);
+        return true;
+    };
+    while (!to_visit.empty()) {
+        const auto [index, depth] = to_visit.back();
+        to_visit.pop_back();
+        const auto& n = nodes[index];
+        if (depth >= bvh::traversal_stack_size) return false;
+        if (n.is_leaf ? n.primitives_offset >= bricks.size()
+                      : !add_child(n.first_child_offset, depth + 1) || !add_child(n.second_child_offset, depth + 1)) {
+            return false;
+        }
+    }
+
+    const std::uint64_t max_triangles = std::uint64_t{1} << header.triangle_bits;
+    for (const auto& info : bricks) {
+        //the arrays are placed after the offset, so the counts are checked before their ends are worked out
+        if (info.offset > file->size || info.num_vertices > file->size / (8 * sizeof(double)) ||
+            info.num_triangles > file->size / (3 * sizeof(unsigned)) || info.num_nodes > file->size / sizeof(bvh_info)) {
+            return false;
+        }
+        if (info.num_triangles == 0 || info.num_triangles > max_triangles || info.num_nodes == 0 || info.end() > file->size) {
+            return false;
+        }
+
+        //what is in the arrays -- the triangles only use the brick's vertices and the file's materials, and the bvh is a tree
+        //over the triangles
+        const auto arrays = info.arrays();
+        const auto indices = reinterpret_cast<const unsigned*>(file->data + arrays[3]);
+        if (std::any_of(indices, indices + 3 * static_cast<size_t>(info.num_triangles), [&](const unsigned v) {return v >= info.num_vertices;}))
+            return false;
+        const auto material_ids = reinterpret_cast<const unsigned*>(file->data + arrays[4]);
+        if (info.has_material_ids &&
+            std::any_of(material_ids, material_ids + info.num_triangles, [&](const unsigned m) {return m >= header.num_materials;}))
+            return false;
+
+        stored_bvh bvh;
+        bvh.nodes.resize(info.num_nodes);
+        std::memcpy(bvh.nodes.data(), file->data + arrays[5], bvh.nodes.size() * sizeof(bvh_info));
+        if (!indexed_bvh<triangle_mesh>::is_valid(bvh, info.num_triangles))
+            return false;
+    }
+    return true;
+}
+
+bool streamed_mesh::hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) {
+    if (nodes.empty())
+        return false;
+
+    //the bricks that were not in the cache -- (the time the ray enters the brick, brick)
+    thread_local std::vector<std::pair<double, unsigned>> deferred;
+    deferred.clear();
+
+    rec.t = t_max;
+    bool did_hit = bvh::traverse(nodes, r, t_min, rec,
+        [&](const bvh_info& leaf) {
+            const unsigned brick = leaf.primitives_offset;
+            if (const auto mesh = cache.find(brick))
+                return hit_brick(*mesh, brick, r, t_min, rec);
+
+            double t_near, t_far;
+            unsigned near_face, far_face;
+            box::slab(leaf.box.min(), leaf.box.max(), r, t_near, t_far, near_face, far_face);
+            deferred.emplace_back(std::max(t_near, t_min), brick);
+            return false;
+        },
+        [](const bvh_info&) {});
+
+    //the deferred bricks nearest first, stopping at the first that starts behind the closest hit
+    std::sort(deferred.begin(), deferred.end());
+    for (const auto& [t_enter, brick] : deferred) {
+        if (t_enter > rec.t) break;
+        if (hit_brick(*get_brick(brick), brick, r, t_min, rec)) did_hit = true;
+    }
+    return did_hit;
+}
+
+void streamed_mesh::hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) {
+    const unsigned brick = rec.primitive_id >> triangle_bits;
+    rec.primitive_id &= (1u << triangle_bits) - 1;
+
+    //normally still in the cache from hit_time, unless another thread's bricks have pushed it out since
+    auto mesh = cache.find(brick, false);
+    if (!mesh) mesh = get_brick(brick);
+    mesh->hit_info(r, t_min, t_max, rec);
+}
+
+std::shared_ptr<triangle_mesh> streamed_mesh::get_brick(const unsigned brick) {
+    if (auto mesh = cache.find(brick, false))   //another ray could have paged it in already
+        return mesh;
+
+    const auto& info = bricks[brick];  //checked against the file when it was opened (check_bricks)
+    const auto arrays = info.arrays();
+    const auto values = [&](const unsigned array) {
+        return reinterpret_cast<const double*>(file->data + arrays[array]);
+    };
+    const auto indices = [&](const unsigned array) {
+        return reinterpret_cast<const unsigned*>(file->data + arrays[array]);
+    };
+
+    vertex_attributes<double> vertices;
+    vertices.positions.assign(values(0), values(0) + 3 * info.num_vertices);
+    vertices.normals.assign(values(1), values(1) + 3 * info.num_vertices);
+    vertices.uvs.assign(values(2), values(2) + 2 * info.num_vertices);
+    std::vector<unsigned> triangles(indices(3), indices(3) + 3 * info.num_triangles);
+    std::vector<unsigned> material_ids;
+    if (info.has_material_ids) material_ids.assign(indices(4), indices(4) + info.num_triangles);
+
+    stored_bvh bvh;
+    bvh.nodes.resize(info.num_nodes);
+    std::memcpy(bvh.nodes.data(), file->data + arrays[5], bvh.nodes.size() * sizeof(bvh_info));
+    bvh.box = bvh.nodes[0].box;
+
+    auto mesh = std::make_shared<triangle_mesh>(std::move(vertices), std::move(triangles), materials, std::move(material_ids), std::move(bvh));
+    ++cache.num_misses;
+    cache.bytes_paged += info.size;
+    const size_t size = mesh->triangle_memory() + mesh->bvh_memory();
+    return cache.insert(brick, std::move(mesh), size);
+}
+
+
+//imports model_file with assimp and writes it to brick_file in bricks of up to brick_size triangles
+// - the whole model is loaded while converting, only rendering it with a streamed_mesh is out of core
+inline bool convert_model_to_bricks(const std::string& model_file, const std::string& brick_file, const unsigned brick_size = 4096,
+                                    const bool flip_uvs = false) {
+    if (brick_size < 1 || brick_size > std::numeric_limits<unsigned short>::max()) {
+        std::cerr << "The brick size must be in [1, 65535]" << std::endl;
+        return false;
+    }
+
+    const auto imported = import_model(model_file, flip_uvs);
+    if (!imported) return false;
+    const auto& data = *imported;
+    const auto num_triangles = static_cast<unsigned>(data.indices.size() / 3);
+    const auto position = [&](const unsigned v) {
+        return vec3(data.vertices[3*v], data.vertices[3*v + 1], data.vertices[3*v + 2]);
+    };
+
+    //the top level bvh -- its leaves are the bricks
+    std::vector<bvh_primitive> prims(num_triangles);
+    for (unsigned i = 0; i < num_triangles; i++) {
+        prims[i].box = triangle_mesh::triangle_box(position(data.indices[3*i]), position(data.indices[3*i + 1]), position(data.indices[3*i + 2]));
+        prims[i].id = i;
+    }
+    const auto root = bvh_node::build(prims, bvh_node::full_depth, brick_size);
+
+    brick_file_header header;
+    std::memcpy(header.magic, brick_file_header::magic_value, sizeof(header.magic));
+    std::vector<bvh_info> nodes;
+    std::vector<const bvh_node*> leaves;
+    bvh::flatten_nodes(root.get(), bvh_layout::depth_first, nodes, [&](const bvh_node* n, bvh_info& leaf) {
+        leaf.primitives_offset = static_cast<unsigned>(leaves.size());
+        leaf.num_primitives = static_cast<unsigned short>(n->ids.size());
+        leaves.push_back(n);
+    });
+
+    while ((1u << header.triangle_bits) < brick_size) header.triangle_bits++;
+    if (header.triangle_bits < 32 && (static_cast<std::uint64_t>(leaves.size()) << header.triangle_bits) > std::numeric_limits<unsigned>::max()) {
+        std::cerr << "Too many bricks for " << model_file << " -- use a larger brick size" << std::endl;
+        return false;
+    }
+    header.num_bricks = static_cast<std::uint32_t>(leaves.size());
+    header.num_nodes = static_cast<std::uint32_t>(nodes.size());
+    header.num_materials = static_cast<std::uint32_t>(data.tex_paths.size());
+    header.leaf_size = triangle_mesh::leaf_size;
+
+    std::vector<double> colors;
+    for (const auto& c : data.colors) {
+        colors.insert(colors.end(), {c.x(), c.y(), c.z()});
+    }
+    std::string tex_paths;
+    for (const auto& path : data.tex_paths) {
+        tex_paths.append(path);
+        tex_paths.push_back('\0');
+    }
+
+    std::uint64_t end = sizeof(brick_file_header);
+    const auto place = [&](std::uint64_t& offset, const std::uint64_t size) {
+        offset = (end + 63) / 64 * 64;
+        end = offset + size;
+    };
+    place(header.nodes, nodes.size() * sizeof(bvh_info));
+    place(header.bricks, leaves.size() * sizeof(brick_info));
+    place(header.colors, colors.size() * sizeof(double));
+    place(header.tex_paths, tex_paths.size());
+    header.tex_paths_size = tex_paths.size();
+
+    std::ofstream file(brick_file, std::ios::binary);
+    const auto write = [&](const std::uint64_t offset, const void* values, const std::uint64_t size) {
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(static_cast<const char*>(values), static_cast<std::streamsize>(size));
+    };
+
+    //each brick gets its own copy of the vertices it uses, and its own bvh (which reorders its triangles)
+    std::vector<brick_info> bricks(leaves.size());
+    for (size_t b = 0; b < leaves.size(); b++) {
+        std::unordered_map<unsigned, unsigned> local;   //vertex in the model -> vertex in the brick
+        std::vector<double> positions, normals, uvs;
+        std::vector<unsigned> indices, material_ids;
+        for (const auto tri : leaves[b]->ids) {
+            for (unsigned j = 0; j < 3; j++) {
+                const unsigned v = data.indices[3*tri + j];
+                const auto [it, is_new] = local.try_emplace(v, static_cast<unsigned>(local.size()));
+                if (is_new) {
+                    positions.insert(positions.end(), data.vertices.begin() + 3*v, data.vertices.begin() + 3*v + 3);
+                    normals.insert(normals.end(), data.norms.begin() + 3*v, data.norms.begin() + 3*v + 3);
+                    uvs.insert(uvs.end(), data.uvs.begin() + 2*v, data.uvs.begin() + 2*v + 2);
+                }
+                indices.push_back(it->second);
+            }
+            material_ids.push_back(data.material_ids[tri]);
+        }
+
+        const triangle_mesh mesh(vertex_attributes<double>(positions, normals, uvs), std::move(indices),
+                                 std::vector<std::shared_ptr<material>>(data.tex_paths.size()), std::move(material_ids));
+        const auto bvh = mesh.store_bvh();
+
+        auto& info = bricks[b];
+        info.offset = (end + 63) / 64 * 64;
+        info.num_vertices = static_cast<std::uint32_t>(local.size());
+        info.num_triangles = static_cast<std::uint32_t>(mesh.num_triangles());
+        info.num_nodes = static_cast<std::uint32_t>(bvh.nodes.size());
+        info.has_material_ids = !mesh.material_ids.empty();
+        info.size = info.end() - info.offset;
+        end = info.end();
+
+        const auto arrays = info.arrays();
+        write(arrays[0], positions.data(), positions.size() * sizeof(double));
+        write(arrays[1], normals.data(), normals.size() * sizeof(double));
+        write(arrays[2], uvs.data(), uvs.size() * sizeof(double));
+        write(arrays[3], mesh.indices.data(), mesh.indices.size() * sizeof(unsigned));
+        write(arrays[4], mesh.material_ids.data(), mesh.material_ids.size() * sizeof(unsigned));
+        write(arrays[5], bvh.nodes.data(), bvh.nodes.size() * sizeof(bvh_info));
+    }
+
+    write(0, &header, sizeof(header));
+    write(header.nodes, nodes.data(), nodes.size() * sizeof(bvh_info));
+    write(header.bricks, bricks.data(), bricks.size() * sizeof(brick_info));
+    write(header.colors, colors.data(), colors.size() * sizeof(double));
+    write(header.tex_paths, tex_paths.data(), tex_paths.size());
+
+    if (!file) {
+        std::cerr << "Could not write " << brick_file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif //RAYTRACER_STREAMED_MESH_HPP
@@ -0,0 +1,266 @@
+#ifndef RAYTRACER_TESSELLATED_MESH_HPP
+#define RAYTRACER_TESSELLATED_MESH_HPP
+
+#include "streamed_mesh.hpp"
+#include "texture.hpp"
+
+
+/*=====================================================================================================================
+ A smooth, displaced surface made from a cage of triangles, tessellated only where rays reach it
+  - each triangle of the cage is a patch, smoothed into a curved PN triangle (Vlachos et al.) from the normals at its corners
+    (the edge between 2 patches only depends on the vertices at its ends, so patches that share vertices meet without cracks)
+  - the patch is then displaced along its normal by the displacement texture (its red channel clamped to [0, 1], times displacement_scale)
+  - only the cage and a bvh over the bounds of the patches stay resident -- a patch is tessellated into rate^2 triangles the
+    first time a ray reaches its bounds, and kept in a brick_cache (as for streamed_mesh) of up to cache_size bytes
+  - as in streamed_mesh, rays are deferred at patches that are not in the cache, and a patch is only tessellated if the
+    ray enters it before the closest hit found so far
+ ===================================================================================================================*/
+struct tessellated_mesh : public hittable {
+    brick_cache cache;  //the tessellated patches
+
+    tessellated_mesh() = delete;
+    //the cage is as for import_model (indices into positions, normals and uvs)
+    // - displacement can be nullptr for a smooth surface with no displacement
+    tessellated_mesh(std::vector<double> _positions, std::vector<double> _normals, std::vector<double> _uvs, std::vector<unsigned> _indices,
+                     std::shared_ptr<material> mat, unsigned _rate, std::shared_ptr<texture> _displacement, double _displacement_scale,
+                     size_t cache_size);
+
+    bool hit_time(const ray& r, double t_min, double t_max, hit_record& rec) override;
+    void hit_info(const ray& r, double t_min, double t_max, hit_record& rec) override;
+
+    inline bool bounding_box([[maybe_unused]] const double time0, [[maybe_unused]] const double time1, aabb& output_box) const override {
+        output_box = nodes.empty() ? aabb() : nodes[0].box;
+        return !nodes.empty();
+    }
+
+    [[nodiscard]] inline size_t num_patches() const {
+        return indices.size() / 3;
+    }
+
+    //the memory always used (the cage and the bvh over the patches), not including the patches in the cache
+    [[nodiscard]] inline size_t resident_memory() const {
+        return (positions.size() + normals.size() + uvs.size()) * sizeof(double) + indices.size() * sizeof(unsigned) +
+               nodes.size() * sizeof(bvh_info);
+    }
+
+    //makes the triangles of a patch (the vertices are in rows from its first corner to its third)
+    [[nodiscard]] std::shared_ptr<triangle_mesh> tessellate(unsigned patch) const;
+
+private:
+    const std::vector<double> positions, normals, uvs;
+    const std::vector<unsigned> indices;
+    const std::vector<std::shared_ptr<material>> materials;
+    const unsigned rate;
+    const std::shared_ptr<texture> displacement;
+    const double displacement_scale;
+    std::vector<bvh_info> nodes;
+    unsigned triangle_bits = 0;
+
+    //the control points of a PN triangle (the weight of each is in point), with the normals and uvs at its corners
+    struct pn_triangle {
+        vec3 b[10];
+        vec3 n[3];
+        vec2 uv[3];
+
+        //the smoothed (not displaced) point and interpolated normal at barycentric coords (1 - u - v, u, v)
+        [[nodiscard]] inline vec3 point(const double u, const double v) const {
+            const double w = 1 - u - v;
+            return w*w*w*b[0] + u*u*u*b[1] + v*v*v*b[2] + 3*w*w*u*b[3] + 3*w*u*u*b[4] + 3*w*w*v*b[5] + 3*u*u*v*b[6] +
+                   3*w*v*v*b[7] + 3*u*v*v*b[8] + 6*w*u*v*b[9];
+        }
+
+        [[nodiscard]] inline vec3 normal(const double u, const double v) const {
+            return unit_vector((1 - u - v)*n[0] + u*n[1] + v*n[2]);
+        }
+
+        [[nodiscard]] inline vec2 tex_coords(const double u, const double v) const {
+            return (1 - u - v)*uv[0] + u*uv[1] + v*uv[2];
+        }
+    };
+
+    [[nodiscard]] pn_triangle make_pn_triangle(unsigned patch) const;
+
+    //the point of the surface after displacement
+    [[nodiscard]] inline vec3 surface_point(const pn_triangle& pn, const double u, const double v) const {
+        const vec3 p = pn.point(u, v);
+        if (!displacement) return p;
+        const vec2 uv = pn.tex_coords(u, v);
+        return p + displacement_scale * std::clamp(displacement->value(uv.x(), uv.y(), p, 0).x(), 0.0, 1.0) * pn.normal(u, v);
+    }
+
+    //the patch from the cache, or tessellated
+    std::shared_ptr<triangle_mesh> get_patch(unsigned patch);
+
+    //hit_record::primitive_id is the patch in the high bits and the triangle in the patch in the low triangle_bits
+    inline bool hit_patch(triangle_mesh& mesh, const unsigned patch, const ray& r, const double t_min, hit_record& rec) const {
+        if (!mesh.hit_time(r, t_min, rec.t, rec))
+            return false;
+
+        rec.primitive_id |= patch << triangle_bits;
+        return true;
+    }
+};
+
+
+tessellated_mesh::tessellated_mesh(std::vector<double> _positions, std::vector<double> _normals, std::vector<double> _uvs,
+                                   std::vector<unsigned> _indices, std::shared_ptr<material> mat, const unsigned _rate,
+                                   std::shared_ptr<texture> _displacement, const double _displacement_scale, const size_t cache_size)
+        : cache(cache_size), positions(std::move(_positions)), normals(std::move(_normals)), uvs(std::move(_uvs)), indices(std::move(_indices)),
+          materials{std::move(mat)}, rate(std::max(_rate, 1u)), displacement(std::move(_displacement)), displacement_scale(_displacement_scale) {
+    while ((1u << triangle_bits) < rate * rate) triangle_bits++;
+    if ((static_cast<std::uint64_t>(num_patches()) << triangle_bits) > std::numeric_limits<unsigned>::max()) {
+        std::cerr << "Too many patches to tessellate at rate " << rate << std::endl;
+        return;
+    }
+
+    //a patch is inside the box around its control points (as for any Bezier patch), displacement can move it out by displacement_scale
+    // - padded a little more so a flat patch still has a box with volume
+    std::vector<bvh_primitive> prims(num_patches());
+    const double pad = (displacement ? std::abs(displacement_scale) : 0) + 0.0001;
+    for (unsigned i = 0; i < num_patches(); i++) {
+        const auto pn = make_pn_triangle(i);
+        point3 lo = pn.b[0], hi = pn.b[0];
+        for (const auto& b : pn.b) {
+            for (unsigned axis = 0; axis < 3; axis++) {
+                lo[axis] = std::min(lo[axis], b[axis]);
+                hi[axis] = std::max(hi[axis], b[axis]);
+            }
+        }
+        prims[i].box = aabb(lo - vec3(pad, pad, pad), hi + vec3(pad, pad, pad));
+        prims[i].id = i;
+    }
+    if (prims.empty())
+        return;
+
+    const auto root = bvh_node::build(prims, bvh_node::full_depth, 1);
+    bvh::flatten_nodes(root.get(), bvh_layout::depth_first, nodes, [&](const bvh_node* n, bvh_info& leaf) {
+        leaf.primitives_offset = n->ids[0];
+        leaf.num_primitives = 1;
+    });
+}
+
+tessellated_mesh::pn_triangle tessellated_mesh::make_pn_triangle(const unsigned patch) const {
+    pn_triangle pn;
+    vec3 p[3];
+    for (unsigned j = 0; j < 3; j++) {
+        const unsigned v = indices[3*patch + j];
+        p[j] = vec3(positions[3*v], positions[3*v + 1], positions[3*v + 2]);
+        pn.n[j] = unit_vector(vec3(normals[3*v], normals[3*v + 1], normals[3*v + 2]));
+        pn.uv[j] = vec2(uvs[2*v], uvs[2*v + 1]);
+    }
+
+    //the point a third of the way along the edge from p[i] to p[j], projected onto the tangent plane at p[i]
+    const auto edge_point = [&](const unsigned i, const unsigned j) {
+        return (2*p[i] + p[j] - dot(p[j] - p[i], pn.n[i]) * pn.n[i]) / 3;
+    };
+    pn.b[0] = p[0];
+    pn.b[1] = p[1];
+    pn.b[2] = p[2];
+    pn.b[3] = edge_point(0, 1);     //w^2 u
+    pn.b[4] = edge_point(1, 0);     //w u^2
+    pn.b[5] = edge_point(0, 2);     //w^2 v
+    pn.b[6] = edge_point(1, 2);     //u^2 v
+    pn.b[7] = edge_point(2, 0);     //w v^2
+    pn.b[8] = edge_point(2, 1);     //u v^2
+    const vec3 edges_mean = (pn.b[3] + pn.b[4] + pn.b[5] + pn.b[6] + pn.b[7] + pn.b[8]) / 6;
+    const vec3 corners_mean = (p[0] + p[1] + p[2]) / 3;
+    pn.b[9] = edges_mean + (edges_mean - corners_mean) / 2;
+    return pn;
+}
+
+std::shared_ptr<triangle_mesh> tessellated_mesh::tessellate(const unsigned patch) const {
+    const auto pn = make_pn_triangle(patch);
+    const size_t num_vertices = (rate + 1) * (rate + 2) / 2;
+    std::vector<double> patch_positions, patch_normals, patch_uvs;
+    patch_positions.reserve(3 * num_vertices);
+    patch_normals.reserve(3 * num_vertices);
+    patch_uvs.reserve(2 * num_vertices);
+
+    //the normal of the displaced surface is found from the surface a small step along u and v
+    constexpr double step = 1e-4;
+    for (unsigned i = 0; i <= rate; i++) {
+        for (unsigned j = 0; j <= rate - i; j++) {
+            const double u = static_cast<double>(j) / rate, v = static_cast<double>(i) / rate;
+            const vec3 p = surface_point(pn, u, v);
+            vec3 n = pn.normal(u, v);
+            if (displacement) {
+                const vec3 displaced_n = cross(surface_point(pn, u + step, v) - p, surface_point(pn, u, v + step) - p);
+                if (displaced_n.length_squared() > 0) n = unit_vector(displaced_n);
+            }
+            const vec2 uv = pn.tex_coords(u, v);
+            patch_positions.insert(patch_positions.end(), {p.x(), p.y(), p.z()});
+            patch_normals.insert(patch_normals.end(), {n.x(), n.y(), n.z()});
+            patch_uvs.insert(patch_uvs.end(), {uv.x(), uv.y()});
+        }
+    }
+
+    //row i has rate + 1 - i vertices
+    const auto vertex = [&](const unsigned i, const unsigned j) {
+        return i * (rate + 1) - i * (i - 1) / 2 + j;
+    };
+    std::vector<unsigned> patch_indices;
+    patch_indices.reserve(3 * rate * rate);
+    for (unsigned i = 0; i < rate; i++) {
+        for (unsigned j = 0; j < rate - i; j++) {
+            patch_indices.insert(patch_indices.end(), {vertex(i, j), vertex(i, j + 1), vertex(i + 1, j)});
+            if (j + 1 < rate - i) patch_indices.insert(patch_indices.end(), {vertex(i, j + 1), vertex(i + 1, j + 1), vertex(i + 1, j)});
+        }
+    }
+
+    return std::make_shared<triangle_mesh>(vertex_attributes<double>(patch_positions, patch_normals, patch_uvs), std::move(patch_indices),
+                                           materials, std::vector<unsigned>());
+}
+
+bool tessellated_mesh::hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) {
+    if (nodes.empty())
+        return false;
+
+    //the patches that were not in the cache -- (the time the ray enters the patch, patch)
+    thread_local std::vector<std::pair<double, unsigned>> deferred;
+    deferred.clear();
+
+    rec.t = t_max;
+    bool did_hit = bvh::traverse(nodes, r, t_min, rec,
+        [&](const bvh_info& leaf) {
+            const unsigned patch = leaf.primitives_offset;
+            if (const auto mesh = cache.find(patch))
+                return hit_patch(*mesh, patch, r, t_min, rec);
+
+            double t_near, t_far;
+            unsigned near_face, far_face;
+            box::slab(leaf.box.min(), leaf.box.max(), r, t_near, t_far, near_face, far_face);
+            deferred.emplace_back(std::max(t_near, t_min), patch);
+            return false;
+        },
+        [](const bvh_info&) {});
+
+    //the deferred patches nearest first, stopping at the first that starts behind the closest hit
+    std::sort(deferred.begin(), deferred.end());
+    for (const auto& [t_enter, patch] : deferred) {
+        if (t_enter > rec.t) break;
+        if (hit_patch(*get_patch(patch), patch, r, t_min, rec)) did_hit = true;
+    }
+    return did_hit;
+}
+
+void tessellated_mesh::hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) {
+    const unsigned patch = rec.primitive_id >> triangle_bits;
+    rec.primitive_id &= (1u << triangle_bits) - 1;
+
+    auto mesh = cache.find(patch, false);
+    if (!mesh) mesh = get_patch(patch);
+    mesh->hit_info(r, t_min, t_max, rec);
+}
+
+std::shared_ptr<triangle_mesh> tessellated_mesh::get_patch(const unsigned patch) {
+    if (auto mesh = cache.find(patch, false))   //another ray could have tessellated it already
+        return mesh;
+
+    auto mesh = tessellate(patch);
+    ++cache.num_misses;
+    const size_t size = mesh->triangle_memory() + mesh->bvh_memory();
+    cache.bytes_paged += size;
+    return cache.insert(patch, std::move(mesh), size);
+}
+
+#endif //RAYTRACER_TESSELLATED_MESH_HPP
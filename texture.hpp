@@ -1,11 +1,32 @@
 #pragma once
 
 
+#include "aabb.hpp"
+#include "block_compression.hpp"
 #include "perlin.hpp"
 #include "stb_image_ne.hpp"
+#include "texture_pages.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <compare>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//for the page files of image textures
+#include <unistd.h>
 
 struct texture {
-	[[nodiscard]] virtual color value(double u, double v, const point3& p) const = 0;
+	//footprint is the width of the ray's cone at the hit in uv coords (hit_record::uv_footprint), for textures that filter
+	[[nodiscard]] virtual color value(double u, double v, const point3& p, double footprint) const = 0;
 };
 
 //texture that is all one colour
@@ -14,7 +35,7 @@ struct solid_color : public texture {
 	explicit solid_color(const color c) : color_value(c) {}
 	solid_color(const double red, const double green, const double blue) : solid_color(color(red, green, blue)) {}
 	
-	[[nodiscard]] color value(const double u, const double v, const vec3& p) const override {
+	[[nodiscard]] color value([[maybe_unused]] const double u, [[maybe_unused]] const double v, [[maybe_unused]] const vec3& p, [[maybe_unused]] const double footprint) const override {
 		return color_value;
 	}
 
@@ -31,13 +52,13 @@ struct checker_texture : public texture {
 	checker_texture(std::shared_ptr<texture> _even, std::shared_ptr<texture> _odd) : even(std::move(_even)), odd(std::move(_odd)) {}
 	checker_texture(const color c1, const color c2) : even(std::make_shared<solid_color>(c1)), odd(std::make_shared<solid_color>(c2)) {}
 
-	[[nodiscard]] color value(const double u, const double v, const point3& p) const override {
+	[[nodiscard]] color value(const double u, const double v, const point3& p, const double footprint) const override {
 		const auto sines = sin(10*p.x()) * sin(10*p.y()) * sin(10*p.z());	//essentially a 4D sine wave
 
 		if(sines < 0)	//sine is periodic. Having a different texture for if sine is positive or negative will given distinct regions of different colors
-			return odd->value(u, v, p);
+			return odd->value(u, v, p, footprint);
 		else 
-			return even->value(u, v, p);
+			return even->value(u, v, p, footprint);
 
 	}
 };
@@ -50,7 +71,7 @@ struct [[maybe_unused]] noise_texture : public texture {
 	noise_texture() = delete;
 	explicit noise_texture(const double sc = 1.0) : scale(sc) {}
 
-	[[nodiscard]] color value(const double u, const double v, const point3& p) const override {
+	[[nodiscard]] color value([[maybe_unused]] const double u, [[maybe_unused]] const double v, const point3& p, [[maybe_unused]] const double footprint) const override {
 		return color(1,1,1) *0.5 *(1.0 + noise.noise(scale*p));	//creates a gray color
 									//needs to be scaled to go between 0 and 1 else the gamma correcting function will return NaN's
 									// (sqrt of a negative number)
@@ -66,7 +87,7 @@ struct turbulent_texture : public texture {
 	turbulent_texture() = delete;
 	explicit turbulent_texture(const double sc = 1.0, const int dpt = 7) : scale(sc), depth(dpt) {}
 	
-	[[nodiscard]] color value(const double u, const double v, const point3& p) const override {
+	[[nodiscard]] color value([[maybe_unused]] const double u, [[maybe_unused]] const double v, const point3& p, [[maybe_unused]] const double footprint) const override {
 		return color(1,1,1) * noise.turb(scale*p, depth);
 	}
 };
@@ -79,60 +100,425 @@ struct marble_texture : public texture {
 	marble_texture() = delete;
 	explicit marble_texture(const double sc = 1.0) : scale(sc) {}
 	
-	[[nodiscard]] color value(const double u, const double v, const point3& p) const override {
+	[[nodiscard]] color value([[maybe_unused]] const double u, [[maybe_unused]] const double v, const point3& p, [[maybe_unused]] const double footprint) const override {
 		return color(1,1,1) * 0.5 * (1 + sin(scale*p.z() + 10* noise.turb(scale*p, 7) ) );
 	}
 };
 
+//a procedural texture baked into a grid of colours over a box, so a lookup is a trilinear read instead of evaluating it
+// - for textures that only depend on p (e.g. noise, turbulent and marble textures), baked over the box of the object using them
+// - the grid has resolution samples along the longest side of the box (the same spacing along the others), baked in
+//   parallel when it is made -- detail finer than the spacing is lost
+// - points outside the box are evaluated by the texture as before
+struct baked_texture : public texture {
+	const std::shared_ptr<texture> source;
+	double bake_time = 0;	//seconds
 
+	baked_texture() = delete;
+	baked_texture(std::shared_ptr<texture> _source, const aabb& bounds, unsigned resolution);
 
+	[[nodiscard]] inline size_t memory_usage() const {
+		return samples.size() * sizeof(float);
+	}
 
+	[[nodiscard]] color value(const double u, const double v, const point3& p, const double footprint) const override {
+		//in grid coords (with a little room for points on the box, which may be just outside it)
+		double f[3];
+		for (unsigned axis = 0; axis < 3; axis++) {
+			f[axis] = (p[axis] - origin[axis]) / spacing;
+			if (f[axis] < -0.01 || f[axis] > size[axis] - 1 + 0.01)
+				return source->value(u, v, p, footprint);
+			f[axis] = std::clamp(f[axis], 0.0, static_cast<double>(size[axis] - 1));
+		}
 
+		const auto i = std::min(static_cast<size_t>(f[0]), size[0] - 2);
+		const auto j = std::min(static_cast<size_t>(f[1]), size[1] - 2);
+		const auto k = std::min(static_cast<size_t>(f[2]), size[2] - 2);
+		const double tx = f[0] - i, ty = f[1] - j, tz = f[2] - k;
+
+		const float* const corner = &samples[3 * ((k*size[1] + j)*size[0] + i)];
+		const size_t dy = 3*size[0], dz = 3*size[0]*size[1];
+		const auto at = [&](const size_t offset) {
+			return color(corner[offset], corner[offset + 1], corner[offset + 2]);
+		};
+		const color front = (1 - ty) * ((1 - tx)*at(0) + tx*at(3)) + ty * ((1 - tx)*at(dy) + tx*at(dy + 3));
+		const color back = (1 - ty) * ((1 - tx)*at(dz) + tx*at(dz + 3)) + ty * ((1 - tx)*at(dz + dy) + tx*at(dz + dy + 3));
+		return (1 - tz)*front + tz*back;
+	}
+
+private:
+	point3 origin;	//of the first sample
+	double spacing = 0;	//between samples
+	size_t size[3]{};	//samples along each axis, at least 2
+	std::vector<float> samples;	//3 per sample, x fastest then y then z
+};
+
+baked_texture::baked_texture(std::shared_ptr<texture> _source, const aabb& bounds, const unsigned resolution)
+		: source(std::move(_source)), origin(bounds.minimum) {
+	const vec3 extent = bounds.maximum - bounds.minimum;
+	spacing = std::max({extent.x(), extent.y(), extent.z()}) / std::max(resolution - 1, 1u);
+	for (unsigned axis = 0; axis < 3; axis++) {
+		size[axis] = std::max(static_cast<size_t>(std::ceil(extent[axis] / spacing - 1e-9)) + 1, size_t(2));
+	}
+	samples.resize(3 * size[0] * size[1] * size[2]);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	const auto num_slices = static_cast<long>(size[2]);
+	#pragma omp parallel for
+	for (long k = 0; k < num_slices; k++) {
+		for (size_t j = 0; j < size[1]; j++) {
+			for (size_t i = 0; i < size[0]; i++) {
+				const point3 p = origin + spacing * vec3(static_cast<double>(i), static_cast<double>(j), static_cast<double>(k));
+				const color c = source->value(0, 0, p, 0);
+				float* const sample = &samples[3 * ((k*size[1] + j)*size[0] + i)];
+				for (unsigned channel = 0; channel < 3; channel++) sample[channel] = static_cast<float>(c[channel]);
+			}
+		}
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+	bake_time = std::chrono::duration<double>(end - start).count();
+}
+
+
+
+
+
+//how an image_texture keeps its texels -- textures of the same file with different options are separate textures
+struct texture_options {
+	//tiles 2^tile_bits texels a side (8x8 tiles are 3 bytes * 64 = 3 cache lines) -- 0 keeps each page in rows (to compare layouts)
+	unsigned tile_bits = 3;
+
+	//kept BC1 compressed -- 6 times smaller, but with the error of the compression (mostly where a 4x4 block has more than 2
+	//distinct colours) and the decoding in each lookup
+	bool compress = false;
+
+	auto operator<=>(const texture_options&) const = default;
+};
+
+//an image read from file, with a mip pyramid made the first time it is looked up
+// - a lookup with a footprint (the ray's cone) is filtered trilinearly between the 2 levels whose texels are closest to the
+//   footprint in size, so distant textures do not alias and rays near each other read the same small level
+// - a lookup with no footprint is the nearest texel of the full image
+// - the file is only decoded when a ray first looks the texture up -- its pyramid is then written in pages to a page file and
+//   the decoded image is dropped, and the pages are read back into the texture_page_cache as lookups need them, so the
+//   textures in memory stay in the cache's budget however many the scene has
+// - the texels are stored in small square tiles (see mip_level), so a lookup reads the same few cache lines whichever
+//   direction across the texture the rays before it moved in
+// - the texels can be kept BC1 compressed (see block_compression.hpp), 6 times smaller, decoded by each lookup
 class image_texture : public texture {
-	unsigned char* data;	//the data read from file
-	int width, height;	//the width and height of the image
-	int bytes_per_scanline;
+	//each level is half the size of the one before (rounded down), each texel the average of the 2x2 texels over it
+	// - a level is cut into square pages up to 2^max_page_bits texels a side (the pages in rows), the part of it that is in
+	//   memory or not
+	// - in a page the texels are in tiles 2^tile_bits texels a side (the tiles in rows), and in Morton order in a tile (the bits
+	//   of their coords interleaved), so texels near each other in both directions are near each other in memory
+	// - tile_bits = 0 is each page in rows
+	// - a compressed level has BC1 blocks for its tiles (4x4 texels), in Morton order in a page
+	struct mip_level {
+		int width = 0, height = 0;
+		bool compressed = false;
+		unsigned page_bits = 0, tile_bits = 0;
+		size_t pages_across = 0, num_pages = 0;
+		size_t first_page = 0;	//the number of the level's first page in the texture
+		size_t file_offset = 0;	//where the level's pages start in the page file
+
+		mip_level(int _width, int _height, bool _compressed, unsigned _tile_bits, size_t _first_page, size_t _file_offset);
+
+		[[nodiscard]] inline size_t page_size() const {
+			return compressed ? static_cast<size_t>(bc1_block_size) << (2*page_bits - 4) : static_cast<size_t>(bytes_per_pixel) << (2*page_bits);
+		}
+
+		[[nodiscard]] inline size_t page(const int i, const int j) const {
+			return first_page + (static_cast<size_t>(j) >> page_bits) * pages_across + (static_cast<size_t>(i) >> page_bits);
+		}
+
+		//where the texel (or its block) is in its page
+		[[nodiscard]] inline size_t offset(const int i, const int j) const {
+			const unsigned in_page = (1u << page_bits) - 1, in_tile = (1u << tile_bits) - 1;
+			const unsigned x = i & in_page, y = j & in_page;
+			if (compressed) return bc1_block_size * morton(x >> 2, y >> 2);
+
+			const size_t tile = static_cast<size_t>(y >> tile_bits << (page_bits - tile_bits)) + (x >> tile_bits);
+			return bytes_per_pixel * ((tile << (2*tile_bits)) | morton(x & in_tile, y & in_tile));
+		}
+
+		//the texel at offset(i, j) in its page
+		[[nodiscard]] inline color texel(const unsigned char* const at, const int i, const int j) const {
+			if (compressed) return color_scale * bc1_decode(at, i & 3, j & 3);
+			return color(color_scale*at[0], color_scale*at[1], color_scale*at[2]);
+		}
+
+		//x and y are less than 256 (tiles are at most 256 texels a side)
+		static inline unsigned morton(unsigned x, unsigned y) {
+			x = (x | (x << 4)) & 0x0f0fu;
+			x = (x | (x << 2)) & 0x3333u;
+			x = (x | (x << 1)) & 0x5555u;
+			y = (y | (y << 4)) & 0x0f0fu;
+			y = (y | (y << 2)) & 0x3333u;
+			y = (y | (y << 1)) & 0x5555u;
+			return x | (y << 1);
+		}
+	};
+
+	//the pages each thread used last, so most lookups do not go to the texture_page_cache (and its lock)
+	// - a page here stays in memory after the cache drops it, until the thread's lookups replace it -- it is still counted
+	//   against the budget, and the cache keeps it as recently used rather than dropping it (see texture_page_cache)
+	static constexpr size_t num_recent_pages = 32;
+	struct recent_page {
+		std::uint64_t key = std::numeric_limits<std::uint64_t>::max();
+		const unsigned char* texels = nullptr;	//of data
+		texture_page_cache::page data;
+	};
+	static thread_local std::array<recent_page, num_recent_pages> recent_pages;
+
+	[[nodiscard]] inline const unsigned char* page_texels(const mip_level& level, const size_t number) const {
+		const std::uint64_t key = static_cast<std::uint64_t>(id) << 32 | number;
+		auto& recent = recent_pages[(key * 0x9E3779B97F4A7C15ull >> 32) % num_recent_pages];
+		if (recent.key != key) [[unlikely]] {
+			recent.data = get_page(level, number);
+			recent.texels = recent.data->data();
+			recent.key = key;
+		}
+		return recent.texels;
+	}
+
+	[[nodiscard]] inline color texel(const mip_level& level, const int i, const int j) const {
+		return level.texel(page_texels(level, level.page(i, j)) + level.offset(i, j), i, j);
+	}
+
+	//bilinear filtering, clamped at the edges -- (x, y) in [0,1]^2 image coords
+	[[nodiscard]] inline color bilinear(const mip_level& level, const double x, const double y) const {
+		const double fx = x*level.width - 0.5, fy = y*level.height - 0.5;
+		const double x0 = std::floor(fx), y0 = std::floor(fy);
+		const double tx = fx - x0, ty = fy - y0;
+		const int i0 = std::clamp(static_cast<int>(x0), 0, level.width - 1), i1 = std::clamp(static_cast<int>(x0) + 1, 0, level.width - 1);
+		const int j0 = std::clamp(static_cast<int>(y0), 0, level.height - 1), j1 = std::clamp(static_cast<int>(y0) + 1, 0, level.height - 1);
+
+		//the 4 texels are nearly always in the same page, so it is only found once
+		const size_t first_page = level.page(i0, j0);
+		const unsigned char* const first_texels = page_texels(level, first_page);
+		const auto at = [&](const int i, const int j) {
+			const size_t number = level.page(i, j);
+			return level.texel((number == first_page ? first_texels : page_texels(level, number)) + level.offset(i, j), i, j);
+		};
+		return (1 - ty) * ((1 - tx)*at(i0, j0) + tx*at(i1, j0)) + ty * ((1 - tx)*at(i0, j1) + tx*at(i1, j1));
+	}
+
+	const std::string file_name;
+	const std::uint32_t id;	//of the texture's pages in the texture_page_cache
+	const unsigned layout_tile_bits;	//the tile_bits of its options (at most max_page_bits)
+	const bool compressed;	//the compress of its options
+
+	//made on the first lookup (see load)
+	mutable std::atomic<bool> loaded = false;
+	mutable std::mutex load_mutex;
+	mutable std::vector<mip_level> mips;	//mips[0] is the full image
+	mutable int width = 0, height = 0;	//the width and height of the image
+	mutable int page_file = -1;
+
+	void load() const;
+
+	inline void ensure_loaded() const {
+		if (loaded.load(std::memory_order_acquire)) [[likely]]
+			return;
+
+		const std::lock_guard<std::mutex> lock(load_mutex);
+		if (!loaded.load(std::memory_order_relaxed)) {	//another thread could have loaded it while waiting for the lock
+			load();
+			loaded.store(true, std::memory_order_release);
+		}
+	}
+	[[nodiscard]] texture_page_cache::page get_page(const mip_level& level, size_t number) const;
+	void write_pages(const mip_level& level, const std::vector<unsigned char>& rows) const;
+	static std::vector<unsigned char> half(const std::vector<unsigned char>& rows, int width, int height);
 
 	public:
 	const static int bytes_per_pixel = 3;
+	static constexpr double color_scale = 1.0 / 255.0;	//to scale the input from [0,255] to [0,1]
+	static constexpr unsigned max_page_bits = 6;	//64x64 texel pages, 12KB
 
 	image_texture() = delete;
-	//image_texture() : data(nullptr), width(0), height(0), bytes_per_scanline(0) {}
+	image_texture(const image_texture&) = delete;
+	image_texture& operator=(const image_texture&) = delete;
 
-	explicit image_texture(const char* filename) {
-		auto components_per_pixel = bytes_per_pixel;
+	explicit image_texture(const char* filename, const texture_options& options = {}) : file_name(filename),
+			id(texture_page_cache::new_texture_id()), layout_tile_bits(std::min(options.tile_bits, max_page_bits)), compressed(options.compress) {}
 
-		data = stbi_load(filename, &width, &height, &components_per_pixel, components_per_pixel);	//reading the data from disk
+	~image_texture() {
+		texture_page_cache::erase(id);
+		if (page_file >= 0) close(page_file);
+	}
 
-		if (!data) {	//file not read
-			std::cerr << "ERROR: Could not load texture image file '" << filename << "'.\n";
-			width = height =0;
-		}
-		bytes_per_scanline = bytes_per_pixel * width;
+	[[nodiscard]] inline const std::string& file() const {
+		return file_name;
 	}
 
-	~image_texture() {
-		delete data;
+	[[nodiscard]] inline int image_width() const {
+		ensure_loaded();
+		return width;
+	}
+
+	[[nodiscard]] inline int image_height() const {
+		ensure_loaded();
+		return height;
+	}
+
+	[[nodiscard]] inline size_t num_levels() const {
+		ensure_loaded();
+		return mips.size();
 	}
 
-	[[nodiscard]] color value(const double u, const double v, const vec3& p) const override {
-		if (data == nullptr)	//if not texture data, return cyan color
+	//the memory the texture's pyramid takes when all of its pages are in memory
+	[[nodiscard]] inline size_t memory_usage() const {
+		ensure_loaded();
+		size_t memory = 0;
+		for (const auto& level : mips) memory += level.num_pages * level.page_size();
+		return memory;
+	}
+
+	[[nodiscard]] color value(const double u, const double v, [[maybe_unused]] const vec3& p, const double footprint) const override {
+		ensure_loaded();
+		if (mips.empty())	//if not texture data, return cyan color
 			return color(0, 1, 1);
 
 		//Clamp input texture coordinates to [0,1]^2
 		const auto uu = std::clamp(u, 0.0, 1.0);
 		const auto vv = 1.0 - std::clamp(v, 0.0, 1.0);	//Flip v to image coordinates
 
-		auto i = static_cast<int>(uu*width);
-		auto j = static_cast<int>(vv*height);
-
-		//Clamp integer mapping since actual coordinates should be less than 1.0
-		if (i >= width)  i = width - 1;
-		if (j >= height) j = height - 1;
-
-		const auto color_scale = 1.0 / 255.0;	//to scale the input from [0,255] to [0,1]
-		const auto pixel = data + j*bytes_per_scanline + i*bytes_per_pixel;	//the pixel at coordinates (u,v)
+		if (footprint <= 0) {
+			//Clamp integer mapping since actual coordinates should be less than 1.0
+			const auto i = std::min(static_cast<int>(uu*width), width - 1);
+			const auto j = std::min(static_cast<int>(vv*height), height - 1);
+			return texel(mips[0], i, j);
+		}
 
-		return color(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]);
+		//the level where a texel is the size of the footprint (between 2 levels, both are filtered and blended)
+		const double level = std::clamp(std::log2(footprint * std::max(width, height)), 0.0, static_cast<double>(mips.size() - 1));
+		const auto fine = static_cast<size_t>(level);
+		const size_t coarse = std::min(fine + 1, mips.size() - 1);
+		const double blend = level - static_cast<double>(fine);
+		const color fine_color = bilinear(mips[fine], uu, vv);
+		return blend <= 0 ? fine_color : (1 - blend)*fine_color + blend*bilinear(mips[coarse], uu, vv);
 	}
 };
+
+inline thread_local std::array<image_texture::recent_page, image_texture::num_recent_pages> image_texture::recent_pages;
+
+image_texture::mip_level::mip_level(const int _width, const int _height, const bool _compressed, const unsigned _tile_bits,
+									const size_t _first_page, const size_t _file_offset)
+		: width(_width), height(_height), compressed(_compressed), first_page(_first_page), file_offset(_file_offset) {
+	//pages no bigger than the level, so the small levels are not mostly padding (but at least a block when compressed)
+	page_bits = compressed ? 2 : 0;
+	while (page_bits < max_page_bits && (1 << page_bits) < std::max(width, height)) page_bits++;
+	tile_bits = compressed ? 2 : std::min(_tile_bits, page_bits);
+	pages_across = ((static_cast<size_t>(width) - 1) >> page_bits) + 1;
+	num_pages = pages_across * (((static_cast<size_t>(height) - 1) >> page_bits) + 1);
+}
+
+void image_texture::load() const {
+	auto components_per_pixel = bytes_per_pixel;
+	unsigned char* data = stbi_load(file_name.c_str(), &width, &height, &components_per_pixel, components_per_pixel);	//reading the data from disk
+
+	if (!data) {	//file not read
+		std::cerr << "ERROR: Could not load texture image file '" << file_name << "'.\n";
+		width = height = 0;
+		return;
+	}
+	++texture_page_cache::num_decoded;
+	std::vector<unsigned char> rows(data, data + bytes_per_pixel * static_cast<size_t>(width) * height);
+	stbi_image_free(data);
+
+	//the page file is deleted as soon as it is made, so it goes when it is closed (or the process ends)
+	auto page_file_name = (std::filesystem::temp_directory_path() / "raytracer_texture_XXXXXX").string();
+	page_file = mkstemp(page_file_name.data());
+	if (page_file < 0) {
+		std::cerr << "ERROR: Could not make a page file for texture '" << file_name << "'.\n";
+		width = height = 0;
+		return;
+	}
+	unlink(page_file_name.c_str());
+
+	int level_width = width, level_height = height;
+	size_t first_page = 0, file_offset = 0;
+	while (true) {
+		const auto& level = mips.emplace_back(level_width, level_height, compressed, layout_tile_bits, first_page, file_offset);
+		write_pages(level, rows);
+		first_page += level.num_pages;
+		file_offset += level.num_pages * level.page_size();
+		if (level_width == 1 && level_height == 1) break;
+
+		rows = half(rows, level_width, level_height);
+		level_width = std::max(level_width / 2, 1);
+		level_height = std::max(level_height / 2, 1);
+	}
+}
+
+//rows is the level in rows as it was read
+void image_texture::write_pages(const mip_level& level, const std::vector<unsigned char>& rows) const {
+	const int page_width = 1 << level.page_bits;
+	std::vector<unsigned char> data(level.page_size());
+	for (size_t number = 0; number < level.num_pages; number++) {
+		const int i0 = static_cast<int>(number % level.pages_across) * page_width, j0 = static_cast<int>(number / level.pages_across) * page_width;
+		std::fill(data.begin(), data.end(), 0);
+		if (level.compressed) {
+			//the blocks over the edge of the level repeat its last row and column
+			unsigned char block[16 * bytes_per_pixel];
+			for (int bj = j0; bj < std::min(j0 + page_width, level.height); bj += 4) {
+				for (int bi = i0; bi < std::min(i0 + page_width, level.width); bi += 4) {
+					for (int y = 0; y < 4; y++) {
+						for (int x = 0; x < 4; x++) {
+							const auto i = std::min(bi + x, level.width - 1), j = std::min(bj + y, level.height - 1);
+							std::copy_n(&rows[bytes_per_pixel * (static_cast<size_t>(j) * level.width + i)], bytes_per_pixel, &block[bytes_per_pixel * (4*y + x)]);
+						}
+					}
+					bc1_encode(block, &data[level.offset(bi, bj)]);
+				}
+			}
+		}
+		else {
+			for (int j = j0; j < std::min(j0 + page_width, level.height); j++) {
+				for (int i = i0; i < std::min(i0 + page_width, level.width); i++) {
+					std::copy_n(&rows[bytes_per_pixel * (static_cast<size_t>(j) * level.width + i)], bytes_per_pixel, &data[level.offset(i, j)]);
+				}
+			}
+		}
+		const auto at = static_cast<off_t>(level.file_offset + number * data.size());
+		if (pwrite(page_file, data.data(), data.size(), at) != static_cast<ssize_t>(data.size())) {
+			std::cerr << "ERROR: Could not write the pages of texture '" << file_name << "'.\n";
+			return;
+		}
+	}
+}
+
+texture_page_cache::page image_texture::get_page(const mip_level& level, const size_t number) const {
+	if (auto found = texture_page_cache::find(id, static_cast<std::uint32_t>(number)))
+		return found;
+
+	++texture_page_cache::num_misses;
+	auto data = texture_page_cache::new_page(level.page_size());
+	const auto at = static_cast<off_t>(level.file_offset + (number - level.first_page) * data->size());
+	if (pread(page_file, data->data(), data->size(), at) != static_cast<ssize_t>(data->size())) {
+		std::cerr << "ERROR: Could not read a page of texture '" << file_name << "'.\n";
+		std::fill(data->begin(), data->end(), 0);
+	}
+	return texture_page_cache::insert(id, static_cast<std::uint32_t>(number), std::move(data));
+}
+
+std::vector<unsigned char> image_texture::half(const std::vector<unsigned char>& rows, const int width, const int height) {
+	const int next_width = std::max(width / 2, 1), next_height = std::max(height / 2, 1);
+	std::vector<unsigned char> next(static_cast<size_t>(bytes_per_pixel) * next_width * next_height);
+	for (int j = 0; j < next_height; j++) {
+		for (int i = 0; i < next_width; i++) {
+			//the 2x2 texels over the texel (fewer at the edge of an odd sized level that has been halved to 1)
+			const int i0 = std::min(2*i, width - 1), i1 = std::min(2*i + 1, width - 1);
+			const int j0 = std::min(2*j, height - 1), j1 = std::min(2*j + 1, height - 1);
+			for (int c = 0; c < bytes_per_pixel; c++) {
+				const auto at = [&](const int x, const int y) {
+					return static_cast<unsigned>(rows[bytes_per_pixel * (static_cast<size_t>(y) * width + x) + c]);
+				};
+				next[bytes_per_pixel * (static_cast<size_t>(j) * next_width + i) + c] =
+						static_cast<unsigned char>((at(i0, j0) + at(i1, j0) + at(i0, j1) + at(i1, j1) + 2) / 4);
+			}
+		}
+	}
+	return next;
+}
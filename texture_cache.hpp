@@ -0,0 +1,63 @@
+#ifndef RAYTRACER_TEXTURE_CACHE_HPP
+#define RAYTRACER_TEXTURE_CACHE_HPP
+
+#include "texture.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+
+/*=====================================================================================================================
+ The image textures of the whole process, so each file is only decoded once
+  - textures are keyed by the resolved path of their file and their options, so different paths to the same file share the
+    texture, and the same file with other options (e.g. another layout) is another texture
+  - the cache only holds weak pointers -- a texture is freed once nothing uses it, and is loaded again if asked for later
+  - safe to use from several threads (e.g. models loaded in parallel)
+ ===================================================================================================================*/
+struct texture_cache {
+    //statistics -- the number of textures made (each decodes its file on its first lookup), and the number of times a
+    //texture was shared instead
+    static inline std::atomic<size_t> num_loaded = 0;
+    static inline std::atomic<size_t> num_shared = 0;
+
+    static std::shared_ptr<image_texture> get(const std::string& file_name, const texture_options& options = {});
+
+    //the memory used by the pages of textures that are in memory (see texture_page_cache) -- 0 until they are looked up
+    static size_t memory_usage();
+
+private:
+    static inline std::mutex cache_mutex;
+    static inline std::map<std::pair<std::string, texture_options>, std::weak_ptr<image_texture>> textures;
+};
+
+
+std::shared_ptr<image_texture> texture_cache::get(const std::string& file_name, const texture_options& options) {
+    std::error_code error;
+    auto key = std::filesystem::weakly_canonical(file_name, error).string();
+    if (error) key = file_name;
+
+    //the lock is held while the texture is made (which only sets it up -- its file is decoded on its first lookup), so 2
+    //threads asking for the same file share 1 texture
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    auto& entry = textures[{std::move(key), options}];
+    if (auto tex = entry.lock()) {
+        ++num_shared;
+        return tex;
+    }
+
+    auto tex = std::make_shared<image_texture>(file_name.c_str(), options);
+    entry = tex;
+    ++num_loaded;
+    return tex;
+}
+
+size_t texture_cache::memory_usage() {
+    return texture_page_cache::memory_usage();
+}
+
+#endif //RAYTRACER_TEXTURE_CACHE_HPP
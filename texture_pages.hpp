@@ -0,0 +1,161 @@
+#ifndef RAYTRACER_TEXTURE_PAGES_HPP
+#define RAYTRACER_TEXTURE_PAGES_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+
+/*=====================================================================================================================
+ The pages of image textures that are in memory, for every texture in the process under a single budget in bytes
+  - a page is a square of texels of one mip level of a texture (see image_texture), read from the texture's page file the
+    first time a lookup needs it
+  - the least recently used pages are dropped once the pages in memory go over the budget
+  - every page made with new_page counts against the budget until it is freed, including pages the cache has dropped that
+    a thread still holds (e.g. in image_texture's recent pages) -- so a budget smaller than the pages the threads hold is
+    always gone over
+    - a page that is still held elsewhere when it would be dropped is moved to the front instead, since it is still being used
+      (lookups that hit a thread's recent pages do not come through the cache to mark it as used)
+  - safe to use from several threads -- a page dropped while a lookup is still reading it is freed when the lookup is done
+ ===================================================================================================================*/
+struct texture_page_cache {
+    using page = std::shared_ptr<const std::vector<unsigned char>>;
+
+    static inline std::atomic<size_t> budget = size_t(1) << 30;    //in bytes
+
+    //statistics -- reset with reset_stats
+    static inline std::atomic<size_t> num_hits = 0;     //a lookup found its page in memory
+    static inline std::atomic<size_t> num_misses = 0;   //a page was read from a page file
+    static inline std::atomic<size_t> num_decoded = 0;  //texture files decoded (on the first lookup of the texture)
+
+    //a number for the pages of a new texture
+    static inline std::uint32_t new_texture_id() {
+        return next_id++;
+    }
+
+    //an empty page of size bytes, counted in memory_usage until it is freed
+    static std::shared_ptr<std::vector<unsigned char>> new_page(size_t size);
+
+    //the page if it is in memory
+    static page find(std::uint32_t texture, std::uint32_t page_number);
+
+    //adds a page that was just read -- gives back the page in the cache, which is not data if another thread added it first
+    static page insert(std::uint32_t texture, std::uint32_t page_number, page data);
+
+    //drops the pages of a texture that is being freed
+    static void erase(std::uint32_t texture);
+
+    static size_t memory_usage();       //of every page that has not been freed, in the cache or not
+    static size_t peak_memory_usage();  //since the last reset_stats
+
+    static void reset_stats();
+    static void print_stats(std::ostream& out);
+
+private:
+    struct entry {
+        page data;
+        std::list<std::uint64_t>::iterator position;    //in order
+    };
+
+    static inline std::atomic<std::uint32_t> next_id = 0;
+    static inline std::mutex cache_mutex;
+    static inline std::list<std::uint64_t> order;   //most recently used first
+    static inline std::unordered_map<std::uint64_t, entry> entries;
+    static inline std::atomic<size_t> used = 0;
+    static inline size_t peak = 0;
+
+    static inline std::uint64_t key(const std::uint32_t texture, const std::uint32_t page_number) {
+        return static_cast<std::uint64_t>(texture) << 32 | page_number;
+    }
+};
+
+
+std::shared_ptr<std::vector<unsigned char>> texture_page_cache::new_page(const size_t size) {
+    used += size;
+    return {new std::vector<unsigned char>(size), [size](const std::vector<unsigned char>* const p) {
+        used -= size;
+        delete p;
+    }};
+}
+
+texture_page_cache::page texture_page_cache::find(const std::uint32_t texture, const std::uint32_t page_number) {
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    const auto it = entries.find(key(texture, page_number));
+    if (it == entries.end())
+        return nullptr;
+
+    order.splice(order.begin(), order, it->second.position);
+    ++num_hits;
+    return it->second.data;
+}
+
+texture_page_cache::page texture_page_cache::insert(const std::uint32_t texture, const std::uint32_t page_number, page data) {
+    const auto k = key(texture, page_number);
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    if (const auto it = entries.find(k); it != entries.end())
+        return it->second.data;
+
+    order.push_front(k);
+    entries.emplace(k, entry{data, order.begin()});
+    peak = std::max(peak, used.load());
+
+    //dropping pages until back in budget (the new page is always kept)
+    // - each of the other pages is looked at once at most, pages held outside the cache are moved to the front as they are in use
+    for (size_t remaining = order.size() - 1; used > budget && remaining > 0; remaining--) {
+        const auto dropped = entries.find(order.back());
+        if (dropped->second.data.use_count() > 1) {
+            order.splice(order.begin(), order, dropped->second.position);
+        } else {
+            entries.erase(dropped);     //frees the page
+            order.pop_back();
+        }
+    }
+    return data;
+}
+
+void texture_page_cache::erase(const std::uint32_t texture) {
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    for (auto it = order.begin(); it != order.end();) {
+        if (*it >> 32 == texture) {
+            entries.erase(*it);
+            it = order.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+size_t texture_page_cache::memory_usage() {
+    return used;
+}
+
+size_t texture_page_cache::peak_memory_usage() {
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    return peak;
+}
+
+void texture_page_cache::reset_stats() {
+    num_hits = 0;
+    num_misses = 0;
+    num_decoded = 0;
+    const std::lock_guard<std::mutex> lock(cache_mutex);
+    peak = used;
+}
+
+void texture_page_cache::print_stats(std::ostream& out) {
+    const size_t lookups = num_hits + num_misses;
+    if (lookups == 0) return;
+    out << "textures : " << num_decoded << " decoded, " << num_misses << " page misses in " << lookups << " page lookups ("
+        << 100.0 * static_cast<double>(num_hits) / static_cast<double>(lookups) << "% hits), peak "
+        << static_cast<double>(peak_memory_usage()) / (1024.0 * 1024.0) << "MB of a "
+        << static_cast<double>(budget) / (1024.0 * 1024.0) << "MB budget\n";
+}
+
+#endif //RAYTRACER_TEXTURE_PAGES_HPP
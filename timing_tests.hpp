@@ -6,7 +6,152 @@
 #define RAYTRACER_TIMING_TESTS_HPP
 
 #include "render.hpp"
+#include "scenes/cornell_box.hpp"
 #include "scenes/foggy_balls.hpp"
+#include "scenes/earth.hpp"
+#include "scenes/mesh_scenes.hpp"
+#include "scenes/rt_week.hpp"
+#include "scenes/two_perlin_spheres.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <omp.h>
+
+
+//initialises the Halton sequence (the camera's rays need it) if it has not been already
+inline void init_Halton() {
+    if (global::Halton_rng.is_initialised) return;
+    std::cout << "Initialising Halton sequence";
+    const auto start_Halton = std::chrono::system_clock::now();
+    global::Halton_rng.init();
+    const auto end_Halton = std::chrono::system_clock::now();
+    const std::chrono::duration<double> elapsed_seconds_Halton = end_Halton - start_Halton;
+    std::cout << " -- took : " << elapsed_seconds_Halton.count() << "s" << std::endl;
+}
+
+//the seconds f() takes
+template <typename F>
+double time_seconds(F&& f) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    f();
+    const auto end = std::chrono::high_resolution_clock::now();
+    const std::chrono::duration<double> elapsed = end - start;
+    return elapsed.count();
+}
+
+using image_buffer = std::vector<std::vector<color>>;    //as render::draw_to_buffer draws to
+
+//the rms difference of the pixels of 2 renders, each divided by its samples per pixel
+inline double rms_difference(const image_buffer& a, const size_t a_samples, const image_buffer& b, const size_t b_samples) {
+    double squared_difference = 0;
+    size_t num_pixels = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        for (size_t j = 0; j < a[i].size(); j++, num_pixels++) {
+            squared_difference += (a[i][j] / static_cast<double>(a_samples) - b[i][j] / static_cast<double>(b_samples)).length_squared();
+        }
+    }
+    return std::sqrt(squared_difference / static_cast<double>(num_pixels));
+}
+
+//a hardware event of this thread counted by perf, between start and stop
+// - not available (stop gives 0) off linux and where the counters can't be read (most VMs)
+struct perf_counter {
+    enum class event {l1d_read_misses, cache_misses};   //cache_misses are of the last level cache
+
+    perf_counter() = delete;
+    perf_counter(const perf_counter&) = delete;
+    perf_counter& operator=(const perf_counter&) = delete;
+    explicit perf_counter(event e);
+    ~perf_counter();
+
+    [[nodiscard]] bool available() const { return fd >= 0; }
+    void start();
+    long long stop();
+
+private:
+    int fd = -1;
+};
+
+#ifdef __linux__
+perf_counter::perf_counter(const event e) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    if (e == event::l1d_read_misses) {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+    else {
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+perf_counter::~perf_counter() {
+    if (available()) close(fd);
+}
+
+void perf_counter::start() {
+    if (!available()) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+long long perf_counter::stop() {
+    if (!available()) return 0;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    long long count = 0;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+    return count;
+}
+#else
+perf_counter::perf_counter(event) {}
+perf_counter::~perf_counter() = default;
+void perf_counter::start() {}
+long long perf_counter::stop() { return 0; }
+#endif
+
+
+//rays per second of obj->hit_time for the rays, and the triangles tested per ray by the meshes (see triangle_mesh::triangles_tested,
+//only counted when built with RAYTRACER_STATS)
+// - with count_misses, also the L1d and last level cache misses per ray (see perf_counter)
+inline void time_rays(const std::string& name, const std::shared_ptr<hittable>& obj, const std::vector<ray>& rays, const bool count_misses = false) {
+    size_t num_hits = 0;
+    hit_record rec;
+    triangle_mesh::triangles_tested = 0;
+    perf_counter l1d_misses(perf_counter::event::l1d_read_misses), cache_misses(perf_counter::event::cache_misses);
+    long long num_l1d_misses = 0, num_cache_misses = 0;
+    const double seconds = time_seconds([&] {
+        l1d_misses.start();
+        cache_misses.start();
+        for (const auto& r : rays) {
+            if (obj->hit_time(r, 0.001, infinity, rec)) num_hits++;
+        }
+        num_cache_misses = cache_misses.stop();
+        num_l1d_misses = l1d_misses.stop();
+    });
+
+    const auto num_rays = static_cast<double>(rays.size());
+    std::cout << name << " : ";
+    if (triangle_mesh::count_triangles && triangle_mesh::triangles_tested > 0)
+        std::cout << static_cast<double>(triangle_mesh::triangles_tested) / num_rays << " triangles tested per ray, ";
+    if (count_misses) {
+        if (l1d_misses.available()) std::cout << static_cast<double>(num_l1d_misses) / num_rays << " L1d misses per ray, ";
+        else std::cout << "L1d misses n/a, ";
+        if (cache_misses.available()) std::cout << static_cast<double>(num_cache_misses) / num_rays << " cache misses per ray, ";
+        else std::cout << "cache misses n/a, ";
+    }
+    std::cout << num_rays / seconds / 1e6 << " million rays/s (" << num_hits << " hits)\n";
+}
+
 
 template <size_t image_width, size_t image_height, size_t num_runs, size_t num_samples>
 struct timing_test {
@@ -69,6 +214,13 @@ struct timing_test {
     }
 };
 
+//renders the scene of a timing_test once into its buffer (cleared first), giving the seconds it took
+template <size_t image_width, size_t image_height, size_t num_runs, size_t num_samples>
+double draw_once(timing_test<image_width, image_height, num_runs, num_samples>& test) {
+    for (auto& column : test.buffer) std::fill(column.begin(), column.end(), color(0, 0, 0));
+    return time_seconds([&] { test.ren.draw_to_buffer(test.buffer, test.samples); });
+}
+
 //quick and dirty -- around 3min
 struct test1 : public timing_test<300, 200, 5, 100> {
     test1() : timing_test(foggy_balls()) {}
@@ -79,5 +231,736 @@ struct test2 : public timing_test<600, 400, 20, 100> {
     test2() : timing_test(foggy_balls()) {}
 };
 
+//the rays per second and cache misses per ray of each bvh_layout (and the compressed format) for a field of spheres too
+//big for the caches and for the door mesh
+// - the rays are random, so their paths through the tree are not coherent -- as for the bounces of a render
+// - the layouts give the same hits (the count of hits is printed to check)
+struct bvh_layout_test {
+    static constexpr size_t num_spheres = 200000, num_rays = 200000;
+
+    void run() {
+        hittable_list spheres;
+        for (size_t i = 0; i < num_spheres; i++) {
+            spheres.add(std::make_shared<sphere>(random_vec3(-100, 100), 0.3, std::make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+        }
+        std::vector<ray> rays(num_rays);
+        for (auto& r : rays) r = ray(random_vec3(-100, 100), random_unit_vector());
+
+        std::cout << num_spheres << " spheres (" << static_cast<double>(2 * num_spheres * sizeof(bvh_info)) / (1024.0 * 1024.0) << "MB of nodes)\n";
+        for (const auto layout : {bvh_layout::depth_first, bvh_layout::breadth_first, bvh_layout::van_emde_boas}) {
+            time_rays("\t" + layout_name(layout), std::make_shared<bvh>(spheres, 0, 1, layout), rays, true);
+        }
+
+        const std::string file = "../models/door/door.obj";
+        if (!std::filesystem::exists(file)) {
+            std::cout << file << " not found\n";
+            return;
+        }
+        aabb bounds;
+        generate_model(file)->bounding_box(0, 1, bounds);
+        for (auto& r : rays) {
+            const point3 origin = bounds.min() + (bounds.max() - bounds.min()) * (1.5*random_vec3() - vec3(0.25));
+            r = ray(origin, random_unit_vector());
+        }
+
+        std::cout << "door\n";
+        for (const auto layout : {bvh_layout::depth_first, bvh_layout::breadth_first, bvh_layout::van_emde_boas}) {
+            bvh_settings settings;
+            settings.layout = layout;
+            time_rays("\t" + layout_name(layout), generate_model(file, false, settings), rays, true);
+        }
+        bvh_settings compressed;
+        compressed.format = bvh_format::compressed;
+        time_rays("\tcompressed", generate_model(file, false, compressed), rays, true);
+    }
+
+    static std::string layout_name(const bvh_layout layout) {
+        switch (layout) {
+            case bvh_layout::depth_first: return "depth first";
+            case bvh_layout::breadth_first: return "breadth first";
+            case bvh_layout::van_emde_boas: return "van Emde Boas";
+        }
+        return "";
+    }
+};
+
+//the time to the first pixel of a field of spheres with its bvh built eagerly and with deeper and deeper subtrees left to
+//be built when a ray first enters them (see lazy_bvh) -- then the rest of the frame, which builds the subtrees it reaches
+// - the first pixel is the centre of the image, with num_samples rays through it
+struct lazy_build_test {
+    static constexpr size_t num_spheres = 300000, image_width = 150, image_height = 100, num_samples = 4;
+
+    void run() {
+        init_Halton();     //the camera's rays need it
+        hittable_list spheres;
+        for (size_t i = 0; i < num_spheres; i++) {
+            const point3 center(random_double(-50, 50), random_double(0, 10), random_double(-50, 50));
+            spheres.add(std::make_shared<sphere>(center, 0.1, std::make_shared<lambertian>(random_vec3())));
+        }
+
+        for (const unsigned eager_depth : {bvh_node::full_depth, 12u, 6u, 2u}) {
+            const size_t built_before = lazy_bvh::num_built, subtrees_before = lazy_bvh::num_subtrees;
+            std::shared_ptr<bvh> tree;
+            const double build = time_seconds([&] { tree = std::make_shared<bvh>(spheres, 0, 1, bvh_layout::depth_first, eager_depth); });
+
+            scene sc(aspec1);
+            sc.settings.auto_bvh = false;
+            sc.set_background(background_color::sky);
+            sc.world.add(tree);
+            sc.set_camera(point3(60, 20, 60), point3(0, 5, 0), 40.0, 0.0);
+            timing_test<image_width, image_height, 1, num_samples> test(sc);
+
+            color pixel(0, 0, 0);
+            const double spread = test.ren.curr_scene.cam->pixel_spread(image_height);
+            const double first_pixel = time_seconds([&] {
+                for (size_t s = 0; s < num_samples; s++) {
+                    pixel += test.ren.ray_color(test.ren.curr_scene.cam->get_ray(0.5, 0.5, spread), decltype(test.ren)::max_depth);
+                }
+            });
+            const double frame = draw_once(test);
+
+            std::cout << (eager_depth == bvh_node::full_depth ? std::string("eager") : "eager depth " + std::to_string(eager_depth))
+                      << " : build " << build << "s, first pixel after " << build + first_pixel << "s, rest of the frame "
+                      << frame << "s, built " << lazy_bvh::num_built - built_before << " of " << lazy_bvh::num_subtrees - subtrees_before
+                      << " deferred subtrees (pixel " << pixel.x() + pixel.y() + pixel.z() << ")\n";
+        }
+    }
+};
+
+//compares the memory used and the render time of the standard and compressed bvh formats on a mesh
+struct bvh_format_test {
+    void run() {
+        for (const auto format : {bvh_format::standard, bvh_format::compressed}) {
+            bvh_settings settings;
+            settings.format = format;
+
+            const auto model = generate_model("../models/door/door.obj", false, settings);
+            std::cout << (format == bvh_format::standard ? "standard" : "compressed") << " bvh uses "
+                      << static_cast<double>(model->bvh_memory()) / 1024.0 << "KB, the " << model->num_triangles() << " triangles use "
+                      << static_cast<double>(model->triangle_memory()) / 1024.0 << "KB\n";
+
+            timing_test<300, 200, 5, 20> test{door_scene(settings)};
+            test.run();
+        }
+    }
+};
+
+//compares the memory used by the vertices of each model stored in double and quantized, and the error made by quantizing them
+struct vertex_compression_test {
+    void run() {
+        for (const auto& file : {"../models/door/door.obj", "../models/crate/Crate1.obj"}) {
+            const auto model = generate_model(file);
+            const auto quantized = generate_model<quantized_vertex_attributes>(file);
+            const auto& q = quantized->vertices;
+
+            std::cout << file << " (" << model->vertices.num_vertices() << " vertices)\n";
+            std::cout << "\tvertices use " << static_cast<double>(model->vertices.memory_usage()) / 1024.0 << "KB as doubles, "
+                      << static_cast<double>(q.memory_usage()) / 1024.0 << "KB quantized\n";
+            //the packets the rays are intersected with are floats either way, so they are counted in both totals
+            std::cout << "\tbvh and its packets use " << static_cast<double>(quantized->bvh_memory()) / 1024.0 << "KB, in total "
+                      << static_cast<double>(model->triangle_memory() + model->bvh_memory()) / 1024.0 << "KB as doubles, "
+                      << static_cast<double>(quantized->triangle_memory() + quantized->bvh_memory()) / 1024.0 << "KB quantized\n";
+            std::cout << "\tlargest errors -- position : " << q.max_position_error << ", normal : " << q.max_normal_error
+                      << " degrees, uv : " << q.max_uv_error << "\n";
+        }
+    }
+};
+
+//compares the time to load each model with assimp and from a mesh file (the mesh file is made first)
+struct mesh_loading_test {
+    void run() {
+        for (const std::string file : {"../models/door/door.obj", "../models/crate/Crate1.obj"}) {
+            const std::string mesh_file = file + ".rtmesh";
+            convert_model(file, mesh_file);
+
+            std::shared_ptr<triangle_mesh> imported;
+            const double assimp_time = time_seconds([&] { imported = generate_model(file); });
+            const double mapped_time = time_seconds([&] { (void)load_mesh_file(mesh_file, file); });
+
+            std::cout << file << " (" << imported->num_triangles() << " triangles)\n";
+            std::cout << "\tassimp : " << assimp_time << "s, mesh file : " << mapped_time << "s\n";
+        }
+    }
+};
+
+//the time to load each model and its materials, then the time to decode its textures (on their first lookup) and the memory
+//their pages take once all of them are in memory
+// - the second load of each model shares the textures of the first through the texture_cache, so nothing is decoded again
+struct model_materials_test {
+    void run() {
+        for (const std::string file : {"../models/door/door.obj", "../models/crate/Crate1.obj", "../models/backpack/backpack.obj"}) {
+            if (!std::filesystem::exists(file)) {
+                std::cout << file << " not found\n";
+                continue;
+            }
+
+            std::vector<std::shared_ptr<triangle_mesh>> models;   //kept so the textures are still in the cache for the second load
+            for (unsigned load = 0; load < 2; load++) {
+                const size_t loaded_before = texture_cache::num_loaded, decoded_before = texture_page_cache::num_decoded;
+                const double seconds = time_seconds([&] { models.push_back(generate_model(file)); });
+                const auto& model = models.back();
+
+                //the image textures of the model, each once
+                std::vector<const image_texture*> textures;
+                for (const auto& m : model->materials) {
+                    const auto l = std::dynamic_pointer_cast<lambertian>(m);
+                    if (const auto tex = l ? dynamic_cast<const image_texture*>(l->albedo.get()) : nullptr) textures.push_back(tex);
+                }
+                std::sort(textures.begin(), textures.end());
+                textures.erase(std::unique(textures.begin(), textures.end()), textures.end());
+
+                size_t texture_memory = 0;
+                const double decode_seconds = time_seconds([&] {
+                    for (const auto tex : textures) texture_memory += tex->memory_usage();    //decodes the texture the first time
+                });
+
+                std::cout << file << " (load " << load + 1 << ") : " << seconds << "s, " << model->materials.size() << " materials, "
+                          << texture_cache::num_loaded - loaded_before << " textures made, "
+                          << texture_page_cache::num_decoded - decoded_before << " decoded in " << decode_seconds << "s, textures "
+                          << static_cast<double>(texture_memory) / (1024.0 * 1024.0) << "MB with all of their pages in memory, triangles "
+                          << static_cast<double>(model->triangle_memory()) / 1024.0 << "KB\n";
+            }
+        }
+    }
+};
+
+//renders the door streamed from bricks with a cache that holds a quarter of them, giving the cache statistics for each frame
+struct streaming_test {
+    static constexpr size_t num_frames = 3;
+
+    void run() {
+        const std::string brick_file = "../models/door/door.rtbricks";
+        convert_model_to_bricks("../models/door/door.obj", brick_file, 256);
+        const size_t cache_size = std::filesystem::file_size(brick_file) / 4;
+
+        const streamed_door_scene sc(brick_file, cache_size);
+        const auto mesh = std::dynamic_pointer_cast<streamed_mesh>(sc.world.objects[0]);
+        timing_test<300, 200, 1, 20> test{sc};
+        std::cout << mesh->num_bricks() << " bricks, cache of " << static_cast<double>(cache_size) / 1024.0 << "KB\n";
+
+        for (size_t frame = 0; frame < num_frames; frame++) {
+            test.run();
+            std::cout << "frame " << frame << " -- cache hit rate : " << 100 * mesh->cache.hit_rate() << "%, paged : "
+                      << static_cast<double>(mesh->cache.bytes_paged) / 1024.0 << "KB\n";
+            mesh->cache.reset_stats();
+        }
+    }
+};
+
+//renders a displaced sphere tessellated on demand with caches that hold all, a half and a quarter of its patches,
+//giving the cache statistics for each frame
+struct tessellation_test {
+    static constexpr unsigned rate = 16;
+    static constexpr size_t num_frames = 2;
+
+    void run() {
+        //the memory of every patch when they are all tessellated
+        const displaced_sphere_scene full_sc(rate, std::numeric_limits<size_t>::max());
+        const auto full = std::dynamic_pointer_cast<tessellated_mesh>(full_sc.world.objects[0]);
+        size_t all_patches = 0;
+        for (unsigned patch = 0; patch < full->num_patches(); patch++) {
+            const auto mesh = full->tessellate(patch);
+            all_patches += mesh->triangle_memory() + mesh->bvh_memory();
+        }
+        std::cout << full->num_patches() << " patches of " << rate * rate << " triangles, the cage uses "
+                  << static_cast<double>(full->resident_memory()) / 1024.0 << "KB, every patch tessellated "
+                  << static_cast<double>(all_patches) / 1024.0 << "KB\n";
+
+        for (const size_t fraction : {1, 2, 4}) {
+            const size_t cache_size = all_patches / fraction;
+            const displaced_sphere_scene sc(rate, cache_size);
+            const auto mesh = std::dynamic_pointer_cast<tessellated_mesh>(sc.world.objects[0]);
+            timing_test<150, 100, 1, 4> test{sc};
+            std::cout << "cache of " << static_cast<double>(cache_size) / 1024.0 << "KB\n";
+
+            for (size_t frame = 0; frame < num_frames; frame++) {
+                test.run();
+                std::cout << "frame " << frame << " -- cache hit rate : " << 100 * mesh->cache.hit_rate() << "%, tessellated : "
+                          << static_cast<double>(mesh->cache.bytes_paged) / 1024.0 << "KB, in cache : "
+                          << static_cast<double>(mesh->cache.memory_usage()) / 1024.0 << "KB\n";
+                mesh->cache.reset_stats();
+            }
+        }
+    }
+};
+
+//the noise and render time of the earth seen from far away, with its texture filtered from the mip pyramid (rays with cones) and without
+// - the earth glows with its texture (and nothing else is lit) so all the noise is from sampling the texture
+// - the noise is the rms difference between 2 renders with different samples, which is lower when fewer samples are needed to converge
+struct mipmap_test {
+    static constexpr size_t image_width = 300, image_height = 200, num_samples = 4;
+
+    void run() {
+        const auto earth = texture_cache::get("../textures/earthmap.jpg");
+        std::cout << "earth texture : " << earth->num_levels() << " levels using " << static_cast<double>(earth->memory_usage()) / (1024.0 * 1024.0) << "MB\n";
+
+        for (const double distance : {15.0, 60.0}) {
+            for (const bool cones : {false, true}) {
+                scene sc(aspec1);
+                sc.set_background(background_color::black);
+                sc.world.add(std::make_shared<sphere>(point3(0, 0, 0), 2, std::make_shared<diffuse_light>(earth)));
+                sc.set_camera(vec3(distance, 0.0, 0.0), vec3(0.0, 0.0, 0.0), 20.0, 0.0);
+                sc.settings.ray_cones = cones;
+                timing_test<image_width, image_height, 1, num_samples> test(sc);
+
+                double seconds = draw_once(test);
+                const auto first = test.buffer;
+                seconds += draw_once(test);
+                std::cout << "distance " << distance << (cones ? ", mip mapped" : ", full resolution") << " : " << seconds / 2
+                          << "s per render, noise " << rms_difference(first, num_samples, test.buffer, num_samples) << "\n";
+            }
+        }
+    }
+};
+
+//the triangles tested per ray (built with RAYTRACER_STATS) and rays per second for the door at full detail and with levels of detail, from further and further away
+// - the rays go from the camera to points in the door's box, with the cone of a pixel of a 200 pixel high image with a 20 degree fov
+struct lod_test {
+    static constexpr size_t num_rays = 200000;
+
+    void run() {
+        const auto full = generate_model("../models/door/door.obj");
+        const auto lod = generate_lod_model("../models/door/door.obj");
+        for (size_t l = 0; l < lod->levels.size(); l++) {
+            std::cout << "level " << l << " : " << lod->levels[l]->num_triangles() << " triangles, mean edge " << lod->edge_lengths[l] << "\n";
+        }
+        std::cout << "memory -- full detail : " << static_cast<double>(full->triangle_memory() + full->bvh_memory()) / 1024.0
+                  << "KB, all levels : " << static_cast<double>(lod->memory_usage()) / 1024.0 << "KB\n";
+
+        aabb bounds;
+        full->bounding_box(0, 1, bounds);
+        const vec3 direction = unit_vector(vec3(-3, 3, -5));
+        for (const double distance : {5.0, 20.0, 80.0, 320.0}) {
+            const point3 origin = point3(0, 1, 0) + distance * direction;
+            const camera cam(origin, point3(0, 1, 0), vec3(0, 1, 0), 20.0, 1.5, 0.0, distance, 0, 0);
+
+            std::vector<ray> rays(num_rays);
+            for (auto& r : rays) {
+                const point3 target(random_double(bounds.min().x(), bounds.max().x()), random_double(bounds.min().y(), bounds.max().y()),
+                                    random_double(bounds.min().z(), bounds.max().z()));
+                r = ray(origin, target - origin);
+                r.cone_spread = cam.pixel_spread(200);
+            }
+
+            std::cout << "distance " << distance << "\n";
+            time_rays("\tfull detail", full, rays);
+            time_rays("\tlevels of detail", lod, rays);
+        }
+    }
+};
+
+//compares the rays per second for a field of spheres (like foggy_balls) as a bvh of sphere hittables and as a sphere_group
+struct sphere_group_test {
+    static constexpr size_t num_rays = 1000000;
+
+    void run() {
+        hittable_list spheres;
+        for (int a = -20; a < 30; a++) {
+            for (int b = -11; b < 11; b++) {
+                const point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
+                const auto mat = std::make_shared<lambertian>(random_vec3());
+                if (random_double() < 0.8) {
+                    spheres.add(std::make_shared<moving_sphere>(center, center + vec3(0, random_double(0, 0.5), 0), 0.0, 1.0, 0.2, mat));
+                } else {
+                    spheres.add(std::make_shared<sphere>(center, 0.2, mat));
+                }
+            }
+        }
+
+        //rays from the foggy_balls camera through the field
+        std::vector<ray> rays(num_rays);
+        const point3 origin(13.0, 2.0, 3.0);
+        for (auto& r : rays) {
+            const point3 target(random_double(-20, 30), random_double(0, 0.6), random_double(-11, 11));
+            r = ray(origin, target - origin, random_double());
+        }
+
+        std::cout << spheres.objects.size() << " spheres\n";
+        time_rays("bvh of spheres", std::make_shared<bvh>(spheres, 0, 1), rays);
+        time_rays("sphere_group", std::make_shared<sphere_group>(spheres), rays);
+    }
+};
+
+//compares the rays per second for the ground of rt_week (400 boxes) as a list of boxes, a bvh of boxes and a box_group, and
+//the renders of the cornell box (2 boxes) and of rt_week with its ground as a box_group and as boxes in the top-level bvh
+struct box_group_test {
+    static constexpr size_t num_rays = 1000000, image_width = 300, image_height = 300, num_samples = 16;
+
+    void run() {
+        hittable_list boxes;
+        const auto ground = std::make_shared<lambertian>(color(0.48, 0.83, 0.53));
+        for (int i = 0; i < 20; i++) {
+            for (int j = 0; j < 20; j++) {
+                const point3 corner(-1000.0 + i*100.0, 0.0, -1000.0 + j*100.0);
+                boxes.add(std::make_shared<box>(corner, corner + vec3(100, random_double(1, 101), 100), ground));
+            }
+        }
+
+        //rays from the rt_week camera down onto the ground
+        std::vector<ray> rays(num_rays);
+        const point3 origin(478, 278, -600);
+        for (auto& r : rays) {
+            const point3 target(random_double(-1000, 1000), 0, random_double(-1000, 1000));
+            r = ray(origin, target - origin, random_double());
+        }
+
+        std::cout << boxes.objects.size() << " boxes\n";
+        time_rays("list of boxes", std::make_shared<hittable_list>(boxes), rays);
+        time_rays("bvh of boxes", std::make_shared<bvh>(boxes, 0, 1), rays);
+        time_rays("box_group", std::make_shared<box_group>(boxes), rays);
+
+        time_scene("cornell box", cornell_box_scene());
+        time_scene("rt_week, ground as a box_group", rt_week(true));
+        time_scene("rt_week, ground as boxes in the top-level bvh", rt_week(false));
+    }
+
+    static void time_scene(const std::string& name, const scene& sc) {
+        timing_test<image_width, image_height, 1, num_samples> test(sc);
+        draw_once(test);    //so lazily built parts of the scene are not in the time
+        std::cout << name << " : " << draw_once(test) << "s per render\n";
+    }
+};
+
+
+//renders scenes with image textures with the texture pages in memory kept to smaller and smaller budgets
+// - the textures are decoded on their first lookup, so textures that are never seen are never decoded
+struct texture_budget_test {
+    static constexpr size_t image_width = 300, image_height = 200, num_samples = 4;
+
+    void run() {
+        for (const size_t budget : {size_t(1) << 30, size_t(1) << 20, size_t(256) << 10}) {
+            texture_page_cache::budget = budget;
+            std::cout << "budget " << static_cast<double>(budget) / (1024.0 * 1024.0) << "MB:\n";
+            time_scene("earth", earth_scene());
+            time_scene("crate", crate_scene());
+        }
+        texture_page_cache::budget = size_t(1) << 30;
+    }
+
+    static void time_scene(const std::string& name, const scene& sc) {
+        timing_test<image_width, image_height, 1, num_samples> test(sc);
+        texture_page_cache::reset_stats();
+        const double seconds = draw_once(test);
+
+        std::cout << "  " << name << " : " << seconds << "s -- ";
+        texture_page_cache::print_stats(std::cout);
+    }
+};
+
+//image textures kept BC1 compressed against uncompressed -- their memory, their error (PSNR of the full image) and the time a lookup takes
+struct texture_compression_test {
+    static constexpr size_t num_lookups = 1000000;
+
+    void run() {
+        for (const std::string file : {"../textures/earthmap.jpg", "../models/door/Door_C.jpg", "../models/crate/crate_1.jpg"}) {
+            if (!std::filesystem::exists(file)) {
+                std::cout << file << " not found\n";
+                continue;
+            }
+
+            const image_texture original(file.c_str());
+            const image_texture compressed(file.c_str(), texture_options{.compress = true});
+
+            //the error at the centre of each texel of the full image
+            const int width = original.image_width(), height = original.image_height();
+            double squared_error = 0;
+            for (int j = 0; j < height; j++) {
+                for (int i = 0; i < width; i++) {
+                    const double u = (i + 0.5) / width, v = (j + 0.5) / height;
+                    const auto difference = 255.0 * (original.value(u, v, point3(0, 0, 0), 0) - compressed.value(u, v, point3(0, 0, 0), 0));
+                    squared_error += difference.length_squared() / 3;
+                }
+            }
+            const double psnr = 10 * std::log10(255.0 * 255.0 * width * height / squared_error);
+
+            std::cout << file << " : " << static_cast<double>(original.memory_usage()) / (1024.0 * 1024.0) << "MB -> "
+                      << static_cast<double>(compressed.memory_usage()) / (1024.0 * 1024.0) << "MB, PSNR " << psnr << "dB, "
+                      << time_lookups(original) << "ns -> " << time_lookups(compressed) << "ns per filtered lookup\n";
+        }
+    }
+
+    //lookups at random points with footprints from a texel to 1/16 of the texture
+    static double time_lookups(const image_texture& tex) {
+        std::mt19937 generator(1);
+        std::uniform_real_distribution<double> distribution(0, 1);
+        std::vector<std::array<double, 3>> lookups(num_lookups);
+        for (auto& l : lookups) l = {distribution(generator), distribution(generator), std::exp2(-4 - 8*distribution(generator))};
+
+        for (const auto& l : lookups) (void)tex.value(l[0], l[1], point3(0, 0, 0), l[2]);     //reading the pages in first
+
+        const double seconds = time_seconds([&] {
+            for (const auto& l : lookups) (void)tex.value(l[0], l[1], point3(0, 0, 0), l[2]);
+        });
+        return seconds / num_lookups * 1e9;
+    }
+};
+
+//procedural textures baked into grids (baked_texture) against evaluating them -- the bake, the lookups and whole renders
+struct baked_texture_test {
+    static constexpr size_t num_lookups = 1000000;
+    static constexpr size_t image_width = 300, image_height = 200, num_samples = 4;
+
+    void run() {
+        //points on the turbulent sphere of two_perlin_spheres_scene
+        std::vector<point3> points(num_lookups);
+        for (auto& p : points) p = point3(0, 2, 0) + 2*random_unit_vector();
+
+        const auto turbulent = std::make_shared<turbulent_texture>(5);
+        std::cout << "turbulent texture : " << time_lookups(*turbulent, points) << "ns per lookup\n";
+        for (const unsigned resolution : {64u, 128u, 256u}) {
+            const baked_texture baked(turbulent, aabb(point3(-2, 0, -2), point3(2, 4, 2)), resolution);
+            double squared_error = 0;
+            for (const auto& p : points) squared_error += (baked.value(0, 0, p, 0) - turbulent->value(0, 0, p, 0)).length_squared() / 3;
+            std::cout << "  baked at " << resolution << " : " << baked.bake_time << "s to bake, "
+                      << static_cast<double>(baked.memory_usage()) / (1024.0 * 1024.0) << "MB, " << time_lookups(baked, points)
+                      << "ns per lookup, rms error " << std::sqrt(squared_error / num_lookups) << "\n";
+        }
+
+        //the same textures in each render, so the renders only differ by the baking and their noise (the difference of the
+        //2 evaluated renders)
+        const auto marble = std::make_shared<marble_texture>(4);
+        image_buffer evaluated;
+        for (const unsigned resolution : {0u, 0u, 128u, 256u, 512u}) {
+            timing_test<image_width, image_height, 1, num_samples> test{two_perlin_spheres_scene(marble, turbulent, resolution)};
+            const double seconds = draw_once(test);
+
+            std::cout << "two perlin spheres" << (resolution == 0 ? std::string(", evaluated") : ", baked at " + std::to_string(resolution))
+                      << " : " << seconds << "s per render";
+            if (evaluated.empty())
+                evaluated = test.buffer;
+            else
+                std::cout << ", rms difference from evaluated " << rms_difference(test.buffer, num_samples, evaluated, num_samples);
+            std::cout << "\n";
+        }
+    }
+
+    static double time_lookups(const texture& tex, const std::vector<point3>& points) {
+        color sum(0, 0, 0);
+        const double seconds = time_seconds([&] {
+            for (const auto& p : points) sum += tex.value(0, 0, p, 0);
+        });
+        if (sum.x() < 0) std::cout << "negative texture\n";  //uses sum, so the lookups are kept
+        return seconds / static_cast<double>(points.size()) * 1e9;
+    }
+};
+
+//turbulence a point at a time with scalar noise (as perlin::turb was), with its octaves in simd lanes (perlin::turb), and
+//for a batch of points at once -- then the two_perlin_spheres scene, whose textures use perlin::turb
+struct perlin_test {
+    static constexpr size_t num_points = 1000000, image_width = 300, image_height = 200, num_samples = 4;
+
+    void run() {
+        const perlin noise;
+        std::vector<point3> points(num_points);
+        for (auto& p : points) p = random_vec3(-10, 10);
+        std::vector<double> scalar(num_points), lanes(num_points), batch(num_points);
+
+        const auto time = [&](const char* name, const auto& turb, std::vector<double>& out) {
+            const double seconds = time_seconds([&] { turb(out); });
+            double difference = 0;
+            for (size_t i = 0; i < num_points; i++) difference = std::max(difference, std::fabs(out[i] - scalar[i]));
+            std::cout << name << " : " << seconds / num_points * 1e9 << "ns per point (largest difference " << difference << ")\n";
+        };
+        time("turb, scalar octaves", [&](std::vector<double>& out) {
+            for (size_t i = 0; i < num_points; i++) {
+                double accum = 0, weight = 1;
+                point3 p = points[i];
+                for (int octave = 0; octave < 7; octave++, weight *= 0.5, p *= 2) accum += weight * noise.noise(p);
+                out[i] = std::fabs(accum);
+            }
+        }, scalar);
+        time("turb, octaves in lanes", [&](std::vector<double>& out) {
+            for (size_t i = 0; i < num_points; i++) out[i] = noise.turb(points[i]);
+        }, lanes);
+        time("turb, batch of points", [&](std::vector<double>& out) {
+            noise.turb(points.data(), num_points, out.data());
+        }, batch);
+
+        timing_test<image_width, image_height, 1, num_samples> test{two_perlin_spheres_scene()};
+        std::cout << "two perlin spheres : " << draw_once(test) << "s per render\n";
+    }
+};
+
+//the texture lookups of the first hits of scenes, replayed with the textures laid out in rows and in tiles of each size
+// - the lookups are in the order the render makes them, from rays with cones, so they read the mip levels a render would
+// - L1 data cache read misses are counted where the hardware counters can be read (linux, and not in most VMs)
+struct texture_layout_test {
+    static constexpr size_t image_width = 600, image_height = 400, num_replays = 10;
+
+    struct lookup {
+        std::shared_ptr<image_texture> tex;
+        double u, v, footprint;
+        point3 p;
+    };
+
+    void run() {
+        init_Halton();     //the camera's rays need it
+        const std::vector<std::pair<std::string, std::vector<lookup>>> scenes = {
+            {"earth", first_hit_lookups(earth_scene())}, {"door", first_hit_lookups(door_scene())}, {"crate", first_hit_lookups(crate_scene())}};
+
+        for (const unsigned tile_bits : {0u, 2u, 3u, 4u}) {
+            std::cout << (tile_bits == 0 ? std::string("rows") : std::to_string(1 << tile_bits) + "x" + std::to_string(1 << tile_bits) + " tiles") << ":\n";
+            for (const auto& [name, lookups] : scenes) time_lookups(name, with_options(lookups, texture_options{tile_bits}));
+        }
+    }
+
+    static void time_lookups(const std::string& name, const std::vector<lookup>& lookups) {
+        if (lookups.empty()) {
+            std::cout << "  " << name << " : no image textures seen\n";
+            return;
+        }
+
+        //a pass first, so the textures are decoded and their pages read before timing
+        color sum(0, 0, 0);
+        for (const auto& l : lookups) sum += l.tex->value(l.u, l.v, l.p, l.footprint);
+
+        long long misses = 0;
+        perf_counter counter(perf_counter::event::l1d_read_misses);
+        const double seconds = time_seconds([&] {
+            counter.start();
+            for (size_t i = 1; i < num_replays; i++) {
+                for (const auto& l : lookups) sum += l.tex->value(l.u, l.v, l.p, l.footprint);
+            }
+            misses = counter.stop();
+        });
+
+        const auto num_lookups = static_cast<double>(lookups.size() * (num_replays - 1));
+        std::cout << "  " << name << " : " << lookups.size() << " lookups, " << seconds / num_lookups * 1e9 << "ns per lookup, ";
+        if (counter.available()) std::cout << static_cast<double>(misses) / num_lookups << " L1d misses per lookup";
+        else std::cout << "L1d misses n/a";
+        std::cout << " (checksum " << sum.x() + sum.y() + sum.z() << ")\n";
+    }
+
+    static std::vector<lookup> first_hit_lookups(scene&& sc) {
+        sc.build_top_level_bvh(sc.cam->shutter_open(), sc.cam->shutter_close());
+        std::vector<lookup> lookups;
+        const double spread = sc.cam->pixel_spread(image_height);
+        for (int j = static_cast<int>(image_height) - 1; j >= 0; --j) {
+            for (size_t i = 0; i < image_width; ++i) {
+                const auto u = (i + 0.5) / (image_width - 1), v = (j + 0.5) / (image_height - 1);
+                const ray r = sc.cam->get_ray(u, v, spread);
+                hit_record rec;
+                if (!sc.world.hit_time(r, 0.001, infinity, rec)) continue;
+                sc.world.hit_info(r, 0.001, infinity, rec);
+
+                const auto mat = dynamic_cast<const lambertian*>(rec.mat_ptr);
+                if (!mat) continue;
+                if (auto tex = std::dynamic_pointer_cast<image_texture>(mat->albedo)) {
+                    lookups.push_back({std::move(tex), rec.u, rec.v, rec.uv_footprint, rec.p});
+                }
+            }
+        }
+        return lookups;
+    }
+
+    //the lookups on textures of the same files made with the options (the textures of the lookups given are kept, so each
+    //is only replaced once)
+    static std::vector<lookup> with_options(std::vector<lookup> lookups, const texture_options& options) {
+        std::map<const image_texture*, std::shared_ptr<image_texture>> replacements;
+        for (auto& l : lookups) {
+            auto& replacement = replacements[l.tex.get()];
+            if (!replacement) replacement = texture_cache::get(l.tex->file(), options);
+            l.tex = replacement;
+        }
+        return lookups;
+    }
+};
+
+//the noise of diffuse spheres lit by a sky with a small bright sun (an environment map), at the same number of samples when
+//rays only follow the materials, when they also go uniformly over the sphere and when they go towards the bright texels --
+//as the rms difference from a render with many samples
+struct environment_map_test {
+    static constexpr size_t image_width = 150, image_height = 100, num_samples = 16, reference_samples = 1024;
+    static constexpr int map_width = 512, map_height = 256;
+
+    void run() {
+        scene sc(aspec1);
+        sc.set_environment(sun_and_sky());
+        sc.world.add(std::make_shared<sphere>(point3(0, -1000, 0), 1000, std::make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+        sc.world.add(std::make_shared<sphere>(point3(0, 1, 0), 1, std::make_shared<lambertian>(color(0.7, 0.3, 0.2))));
+        sc.world.add(std::make_shared<sphere>(point3(-2.5, 1, 1), 1, std::make_shared<lambertian>(color(0.2, 0.4, 0.7))));
+        sc.world.add(std::make_shared<sphere>(point3(2.5, 1, -1), 1, std::make_shared<metal>(color(0.8, 0.8, 0.8), 0.2)));
+        sc.set_camera(point3(10, 3, 6), point3(0, 1, 0), 35.0, 0.0);
+
+        sc.settings.sample_environment = environment_sampling::importance;
+        timing_test<image_width, image_height, 1, reference_samples> reference(sc);
+        std::cout << "environment map, reference : " << draw_once(reference) << "s for " << reference_samples << " samples per pixel\n";
+        for (const auto sampling : {environment_sampling::none, environment_sampling::uniform, environment_sampling::importance}) {
+            sc.settings.sample_environment = sampling;
+            timing_test<image_width, image_height, 1, num_samples> test(sc);
+            const double seconds = draw_once(test);
+            std::cout << "  " << (sampling == environment_sampling::none ? "materials only" : sampling == environment_sampling::uniform ? "uniform" : "importance")
+                      << " : " << seconds << "s, rms difference from reference "
+                      << rms_difference(test.buffer, num_samples, reference.buffer, reference_samples) << "\n";
+        }
+    }
+
+    //a blue sky getting lighter towards the horizon, a grey ground and a sun 1.5 degrees across giving most of the light
+    static std::shared_ptr<environment_map> sun_and_sky() {
+        const auto sun = unit_vector(vec3(1, 1.2, 0.6));
+        const double sun_cos = std::cos(0.75 * pi / 180);
+        std::vector<color> texels(static_cast<size_t>(map_width) * map_height);
+        for (int row = 0; row < map_height; row++) {
+            for (int column = 0; column < map_width; column++) {
+                //the centre of the texel (as environment_map::random)
+                const double phi = two_pi * (column + 0.5) / map_width, theta = pi * (1 - (row + 0.5) / map_height);
+                const vec3 d(-std::sin(theta) * std::cos(phi), -std::cos(theta), std::sin(theta) * std::sin(phi));
+                auto& c = texels[row * map_width + column];
+                if (dot(d, sun) > sun_cos) c = color(5000, 4500, 4000);
+                else if (d.y() > 0) c = (1 - d.y()) * color(0.8, 0.85, 0.9) + d.y() * color(0.25, 0.4, 0.8);
+                else c = color(0.1, 0.1, 0.1);
+            }
+        }
+        return std::make_shared<environment_map>(map_width, map_height, std::move(texels));
+    }
+};
+
+//renders of the cornell box (many hits sharing a few materials) with 1 to 64 threads, and their speed up over 1 thread
+// - threads beyond the cores of the machine only show the cost of oversubscribing
+struct thread_scaling_test {
+    static constexpr size_t image_width = 200, image_height = 200, num_samples = 16;
+
+    void run() {
+        timing_test<image_width, image_height, 1, num_samples> test{cornell_box_scene()};
+        draw_once(test);    //so lazily built parts of the scene are not in the first time
+
+        const int max_threads = omp_get_max_threads();
+        std::cout << "thread scaling (" << omp_get_num_procs() << " cores)\n";
+        double one_thread = 0;
+        for (int threads = 1; threads <= 64; threads *= 2) {
+            omp_set_num_threads(threads);
+            const double seconds = draw_once(test);
+            if (threads == 1) one_thread = seconds;
+            std::cout << "  " << threads << " threads : " << seconds << "s, " << one_thread / seconds << "x\n";
+        }
+        omp_set_num_threads(max_threads);
+    }
+};
+
+//the time generate_model takes to load a model (its import, the copying of its meshes and its bvh) with 1 to as many threads
+//as there are cores, and the speed up over 1 thread
+struct mesh_thread_scaling_test {
+    void run() {
+        const int max_threads = omp_get_max_threads(), num_cores = omp_get_num_procs();
+        std::cout << "mesh load thread scaling (" << num_cores << " cores)\n";
+        for (const std::string file : {"../models/door/door.obj", "../models/backpack/backpack.obj"}) {
+            if (!generate_model(file)) {    //also so the file is in the page cache for the timed loads
+                std::cout << "  " << file << " could not be loaded\n";
+                continue;
+            }
+
+            std::cout << "  " << file << ":\n";
+            double one_thread = 0;
+            for (int threads = 1; threads <= num_cores; threads *= 2) {
+                omp_set_num_threads(threads);
+                const double seconds = time_seconds([&] { (void)generate_model(file); });
+                if (threads == 1) one_thread = seconds;
+                std::cout << "    " << threads << " threads : " << seconds << "s, " << one_thread / seconds << "x\n";
+            }
+        }
+        omp_set_num_threads(max_threads);
+    }
+};
+
 
 #endif //RAYTRACER_TIMING_TESTS_HPP
@@ -0,0 +1,201 @@
+#ifndef RAYTRACER_TRANSFORM_HPP
+#define RAYTRACER_TRANSFORM_HPP
+
+#include "hittable.hpp"
+#include "helpful.hpp"
+
+#include <memory>
+
+
+//an affine map p -> linear*p + offset, stored as the 3x4 matrix [linear | offset]
+struct affine {
+    double m[3][4]{};
+
+    static inline affine identity() {
+        affine a;
+        a.m[0][0] = a.m[1][1] = a.m[2][2] = 1;
+        return a;
+    }
+
+    static inline affine translation(const vec3& offset) {
+        affine a = identity();
+        for (unsigned i = 0; i < 3; i++) a.m[i][3] = offset[i];
+        return a;
+    }
+
+    static inline affine scaling(const vec3& scale) {
+        affine a;
+        for (unsigned i = 0; i < 3; i++) a.m[i][i] = scale[i];
+        return a;
+    }
+
+    //a rotation by angle (in degrees) anticlockwise about axis (Rodrigues' formula, see rotate in vec3.hpp)
+    static inline affine rotation(const vec3& axis, const double angle) {
+        const vec3 r = unit_vector(axis);
+        const double c = cos(degrees_to_radians(angle)), s = sin(degrees_to_radians(angle));
+        affine a;
+        for (unsigned i = 0; i < 3; i++) {
+            for (unsigned j = 0; j < 3; j++) {
+                a.m[i][j] = (1 - c) * r[i] * r[j] + (i == j ? c : 0);
+            }
+        }
+        a.m[0][1] -= s*r[2];    a.m[0][2] += s*r[1];
+        a.m[1][0] += s*r[2];    a.m[1][2] -= s*r[0];
+        a.m[2][0] -= s*r[1];    a.m[2][1] += s*r[0];
+        return a;
+    }
+
+    //the same rotation as rotate_y
+    static inline affine rotation_y(const double sin_theta, const double cos_theta) {
+        affine a = identity();
+        a.m[0][0] = cos_theta;  a.m[0][2] = sin_theta;
+        a.m[2][0] = -sin_theta; a.m[2][2] = cos_theta;
+        return a;
+    }
+
+    static inline affine rotation_y(const double angle) {
+        return rotation_y(sin(degrees_to_radians(angle)), cos(degrees_to_radians(angle)));
+    }
+
+    //the map that does b then this
+    inline affine operator*(const affine& b) const {
+        affine a;
+        for (unsigned i = 0; i < 3; i++) {
+            for (unsigned j = 0; j < 4; j++) {
+                a.m[i][j] = m[i][0]*b.m[0][j] + m[i][1]*b.m[1][j] + m[i][2]*b.m[2][j] + (j == 3 ? m[i][3] : 0);
+            }
+        }
+        return a;
+    }
+
+    [[nodiscard]] inline point3 point(const point3& p) const {
+        return vector(p) + vec3(m[0][3], m[1][3], m[2][3]);
+    }
+
+    [[nodiscard]] inline vec3 vector(const vec3& v) const {
+        return vec3(m[0][0]*v[0] + m[0][1]*v[1] + m[0][2]*v[2],
+                    m[1][0]*v[0] + m[1][1]*v[1] + m[1][2]*v[2],
+                    m[2][0]*v[0] + m[2][1]*v[1] + m[2][2]*v[2]);
+    }
+
+    //the linear part transposed -- normals are moved by the inverse transpose, so this is used on the inverse map
+    [[nodiscard]] inline vec3 transposed_vector(const vec3& v) const {
+        return vec3(m[0][0]*v[0] + m[1][0]*v[1] + m[2][0]*v[2],
+                    m[0][1]*v[0] + m[1][1]*v[1] + m[2][1]*v[2],
+                    m[0][2]*v[0] + m[1][2]*v[1] + m[2][2]*v[2]);
+    }
+
+    [[nodiscard]] affine inverse() const;
+};
+
+affine affine::inverse() const {
+    //the inverse of the linear part by cofactors, then offset -> -inverse*offset
+    const vec3 c0(m[0][0], m[1][0], m[2][0]), c1(m[0][1], m[1][1], m[2][1]), c2(m[0][2], m[1][2], m[2][2]);
+    const vec3 r0 = cross(c1, c2), r1 = cross(c2, c0), r2 = cross(c0, c1);  //rows of the inverse (times the determinant)
+    const double inv_det = 1.0 / dot(c0, r0);
+
+    affine a;
+    for (unsigned j = 0; j < 3; j++) {
+        a.m[0][j] = r0[j] * inv_det;
+        a.m[1][j] = r1[j] * inv_det;
+        a.m[2][j] = r2[j] * inv_det;
+    }
+    const vec3 offset = -a.vector(vec3(m[0][3], m[1][3], m[2][3]));
+    for (unsigned i = 0; i < 3; i++) a.m[i][3] = offset[i];
+    return a;
+}
+
+
+/*=====================================================================================================================
+ An instance of an object moved by any affine map (rotations, scales, translations and compositions of them)
+  - replaces chains of translate and rotate_y (see collapse_transforms) so the ray is only moved once
+  - the ray is moved into the object's frame in hit_time, and only the closest hit has its point and normal moved back (in hit_info)
+  - the ray's direction is not normalised, so hit times are the same in both frames
+ ===================================================================================================================*/
+struct transform : public hittable {
+    const std::shared_ptr<hittable> ptr;
+    const affine to_world;
+    const affine to_object;
+
+    transform() = delete;
+    transform(std::shared_ptr<hittable> p, const affine& m);
+
+    inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+        return ptr->hit_time(object_ray(r), t_min, t_max, rec);
+    }
+
+    inline void hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+        ptr->hit_info(object_ray(r), t_min, t_max, rec);
+        rec.p = to_world.point(rec.p);
+        //dot(direction, normal) is the same in both frames, so the normal still opposes the ray and front_face is unchanged
+        rec.normal = unit_vector(to_object.transposed_vector(rec.normal));
+    }
+
+    inline bool bounding_box([[maybe_unused]] const double time0, [[maybe_unused]] const double time1, aabb& output_box) const override {
+        output_box = bbox;
+        return hasbox;
+    }
+
+private:
+    bool hasbox;
+    aabb bbox;
+
+    //the cone of the ray is scaled with it, so its footprint is the same size relative to the object
+    [[nodiscard]] inline ray object_ray(const ray& r) const {
+        ray object_r = r;
+        object_r.orig = to_object.point(r.orig);
+        object_r.dir = to_object.vector(r.dir);
+        if (r.cone_width > 0) object_r.cone_width *= object_r.dir.length() / r.dir.length();
+        return object_r;
+    }
+};
+
+transform::transform(std::shared_ptr<hittable> p, const affine& m) : ptr(std::move(p)), to_world(m), to_object(m.inverse()) {
+    hasbox = ptr->bounding_box(0, 1, bbox);
+
+    //the box around the moved corners of the object's box (as for rotate_y)
+    point3 min( infinity,  infinity,  infinity);
+    point3 max(-infinity, -infinity, -infinity);
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 2; j++)
+            for (int k = 0; k < 2; k++) {
+                const point3 corner(i ? bbox.max().x() : bbox.min().x(), j ? bbox.max().y() : bbox.min().y(), k ? bbox.max().z() : bbox.min().z());
+                const point3 moved = to_world.point(corner);
+                for (int c = 0; c < 3; c++) {
+                    min[c] = fmin(min[c], moved[c]);
+                    max[c] = fmax(max[c], moved[c]);
+                }
+            }
+    bbox = aabb(min, max);
+}
+
+
+//replaces a chain of translate, rotate_y and transform objects with a single transform of the object at the end of the chain
+// - anything that is not a chain is returned as it is
+inline std::shared_ptr<hittable> collapse_transforms(const std::shared_ptr<hittable>& obj) {
+    affine m = affine::identity();
+    std::shared_ptr<hittable> inner = obj;
+    unsigned chain_length = 0;
+
+    while (true) {
+        if (const auto t = std::dynamic_pointer_cast<translate>(inner)) {
+            m = m * affine::translation(t->offset);
+            inner = t->ptr;
+        } else if (const auto rot = std::dynamic_pointer_cast<rotate_y>(inner)) {
+            m = m * affine::rotation_y(rot->sin_theta, rot->cos_theta);
+            inner = rot->ptr;
+        } else if (const auto tr = std::dynamic_pointer_cast<transform>(inner)) {
+            m = m * tr->to_world;
+            inner = tr->ptr;
+        } else {
+            break;
+        }
+        chain_length++;
+    }
+
+    if (chain_length == 0 || (chain_length == 1 && std::dynamic_pointer_cast<transform>(obj)))
+        return obj;
+    return std::make_shared<transform>(inner, m);
+}
+
+#endif //RAYTRACER_TRANSFORM_HPP
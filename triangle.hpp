@@ -12,7 +12,7 @@ struct triangle : public hittable {
 	const vec3 v0, v1;	//edges of the triangle
     //precomputed quantities to find the uv coordinates
     //https://gamedev.stackexchange.com/questions/23743/whats-the-most-efficient-way-to-find-barycentric-coordinates
-	const double d00{}, d01{}, d11{};	//helpful quantities for finding texture coords
+	double d00{}, d01{}, d11{};	//helpful quantities for finding texture coords (set in the constructors from the edges)
 
 	const bool vertex_normals{};	//whether to use face normals or vertex normals
 
@@ -23,16 +23,17 @@ struct triangle : public hittable {
            std::shared_ptr<material> mat)
 		: vertex0(vec0), vertex1(vec1), vertex2(vec2), u_0(u0_), v_0(v0_), u_1(u1_), v_1(v1_), u_2(u2_), v_2(v2_),  mp(std::move(mat)),
 		vertex_normals(false), v0(vec1 - vec0), v1(vec2 - vec0),
-          d00(dot(v0, v0)/(dot(v0, v0) * dot(v1, v1) - dot(v0, v1) * dot(v0, v1))), d01(dot(v0, v1)/(dot(v0, v0) * dot(v1, v1) - dot(v0, v1) * dot(v0, v1))),
-           d11(dot(v1, v1)/(dot(v0, v0) * dot(v1, v1) - dot(v0, v1) * dot(v0, v1))),
-           normal0(cross(v1, v0)) {}
+          normal0(cross(v1, v0)) {
+		set_barycentric_factors();
+	}
 
 	 triangle(const vec3 &vec0, const vec3 &vec1, const vec3 &vec2, const vec3 &n0, const vec3 &n1, const vec3 &n2,
            double u0_, double v0_, double u1_, double v1_, double u2_, double v2_,  std::shared_ptr<material> mat)
            : vertex0(vec0), vertex1(vec1), vertex2(vec2), u_0(u0_), v_0(v0_), u_1(u1_), v_1(v1_), u_2(u2_), v_2(v2_),  mp(std::move(mat)),
              vertex_normals(true), v0(vec1 - vec0), v1(vec2 - vec0),
-             d00(dot(v0, v0)/(dot(v0, v0) * dot(v1, v1) - dot(v0, v1) * dot(v0, v1))), d01(dot(v0, v1)/(dot(v0, v0) * dot(v1, v1) - dot(v0, v1) * dot(v0, v1))),
-              d11(dot(v1, v1)/(dot(v0, v0) * dot(v1, v1) - dot(v0, v1) * dot(v0, v1))), normal0(n0), normal1(n1), normal2(n2) {}
+             normal0(n0), normal1(n1), normal2(n2) {
+		set_barycentric_factors();
+	}
 
 	
 	 bool hit_time(const ray& r, double t_min, double t_max, hit_record& rec) override;
@@ -112,6 +113,16 @@ struct triangle : public hittable {
 		out = Bary2*interp0 + Bary0*interp1 + Bary1*interp2; 
 	}
 
+private:
+	//each dot product is only found once, and the 1/denominator is folded into all 3
+	inline void set_barycentric_factors() {
+		const double dot00 = dot(v0, v0), dot01 = dot(v0, v1), dot11 = dot(v1, v1);
+		const double inv_denom = 1.0 / (dot00 * dot11 - dot01 * dot01);
+		d00 = dot00 * inv_denom;
+		d01 = dot01 * inv_denom;
+		d11 = dot11 * inv_denom;
+	}
+
 };
 
  bool triangle::hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) {
@@ -155,7 +166,7 @@ struct triangle : public hittable {
 
 
 void triangle::hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) {
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(rec.t);
 
     //finding the uv coords using interpolation with barycentric coordinates
@@ -175,4 +186,12 @@ void triangle::hit_info(const ray& r, const double t_min, const double t_max, hi
         }
         rec.set_face_normal(r, temp_norm_res);
     }
+
+    //as for basic_triangle_mesh::hit_info
+    rec.uv_footprint = 0;
+    if (r.has_cone()) {
+        const double area = cross(v0, v1).length();
+        const double uv_area = std::abs((u_1 - u_0) * (v_2 - v_0) - (u_2 - u_0) * (v_1 - v_0));
+        if (area > 0) rec.set_uv_footprint(r, sqrt(uv_area / area));
+    }
 }
@@ -1,132 +1,389 @@
 #pragma once
 
 #include "triangle.hpp"
+#include <algorithm>
+#include <optional>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 //for loading a model
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#include "bvh.hpp"
+#include "indexed_bvh.hpp"
+#include "triangle_packet.hpp"
+#include "vertex_attributes.hpp"
+#include "texture_cache.hpp"
+
+
+/*=====================================================================================================================
+ A mesh where the vertices are shared between the triangles
+  - the position, normal and uv of each vertex are stored once, and a triangle is only the indices of its 3 vertices
+  - everything else about a triangle (edges, face normal, ...) is computed when it is hit
+  - the bvh refers to the triangles by index, and the triangles are stored in the order of the leaves
+  - each leaf of the bvh holds its triangles in a triangle_packet, which is intersected with SIMD
+  - Attributes is how the vertices are stored (see vertex_attributes.hpp), e.g. quantized_vertex_attributes for huge meshes
+    - they are decoded when the packets are made and in hit_info -- the ray is intersected with the packets, which hold the
+      positions as floats whatever Attributes is (~36 bytes per triangle)
+  - each triangle can have its own material (e.g. the submeshes of a model) -- materials are shared by index as in box_group
+  ~30-45 bytes per triangle (+ the bvh and its packets) compared to ~300 for a triangle hittable
+ ===================================================================================================================*/
+template <typename Attributes>
+struct basic_triangle_mesh : public hittable {
+    Attributes vertices;
+    std::vector<unsigned> indices;  //3 per triangle
+    std::vector<std::shared_ptr<material>> materials;
+    std::vector<unsigned> material_ids; //1 per triangle, an index into materials -- left empty when there is only 1 material
+
+	basic_triangle_mesh() = delete;
+	basic_triangle_mesh(Attributes _vertices, std::vector<unsigned> _indices, std::vector<std::shared_ptr<material>> _materials,
+	                    std::vector<unsigned> _material_ids, const bvh_settings& settings = {});
+	//the triangles must already be in the order of the leaves of bvh (as when it was stored)
+	basic_triangle_mesh(Attributes _vertices, std::vector<unsigned> _indices, std::vector<std::shared_ptr<material>> _materials,
+	                    std::vector<unsigned> _material_ids, stored_bvh bvh);
 
 
-struct triangle_mesh : public hittable {
-	const std::shared_ptr<bvh> tris;
-	//stored in a bvh node for 2 reasons
-	// 1. there will rarely be an instance where a mesh will not have enough triangles to gain a performance boost
-	// 2. so it is consider 1 hittable (i.e. 1 object) rather than multiple (more intuitive I think this way)
-
-	triangle_mesh() = delete;
-	triangle_mesh(hittable_list &triangles, const double time0, const double time1) : tris(std::make_shared<bvh>(triangles,time0, time1)) {}
+	inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
+	    rec.t = t_max;
+	    unsigned closest;
+	    if (!tris->hit(r, t_min, rec, closest))
+	        return false;
+
+	    //the barycentric coords of the closest hit are already in rec.u and rec.v
+	    rec.primitive_id = closest;
+	    return true;
+	}
 
+    void hit_info(const ray& r, double t_min, double t_max, hit_record& rec) override;
 
-	inline bool hit_time(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
-		return tris->hit_time(r, t_min, t_max, rec);
+	inline bool bounding_box([[maybe_unused]] const double time0, [[maybe_unused]] const double time1, aabb& output_box) const override {
+	    output_box = tris->box;
+	    return true;
 	}
 
-    inline void hit_info(const ray& r, const double t_min, const double t_max, hit_record& rec) override {
-        tris->hit_info(r, t_min, t_max, rec);
+    [[nodiscard]] inline size_t num_triangles() const {
+        return indices.size() / 3;
     }
 
-	inline bool bounding_box(const double time0, const double time1, aabb& output_box) const override {
-		return tris->bounding_box(time0, time1, output_box);	
+	[[nodiscard]] inline size_t bvh_memory() const {
+	    return tris->memory_usage();
+	}
+
+	//the bvh can only be stored if none of it was deferred (bvh_settings::eager_depth)
+	[[nodiscard]] inline bool can_store_bvh() const {
+	    return tris->is_fully_built();
+	}
+
+	[[nodiscard]] inline stored_bvh store_bvh() const {
+	    return tris->store();
+	}
+
+	//the memory used by the vertices and triangles (not including the bvh)
+	[[nodiscard]] inline size_t triangle_memory() const {
+	    return vertices.memory_usage() + (indices.size() + material_ids.size()) * sizeof(unsigned);
+	}
+
+	//the number of triangles each thread has tested rays against (a statistic for the timing tests)
+	// - only counted when built with RAYTRACER_STATS, so rendering does not pay for it
+#ifdef RAYTRACER_STATS
+	static constexpr bool count_triangles = true;
+#else
+	static constexpr bool count_triangles = false;
+#endif
+	static inline thread_local size_t triangles_tested = 0;
+
+	//used by the bvh
+	static constexpr unsigned leaf_size = triangle_packet::width;
+	using leaf_block = triangle_packet;
+
+	[[nodiscard]] triangle_packet make_leaf_block(unsigned first, unsigned count) const;
+
+	inline bool hit_leaf_block(const triangle_packet& packet, const ray& r, const double t_min, hit_record& rec, unsigned& closest) const {
+	    if constexpr (count_triangles) triangles_tested += packet.count;
+	    double t, u, v;
+	    const int lane = packet.hit(r, t_min, rec.t, t, u, v);
+	    if (lane < 0)
+	        return false;
+
+	    rec.t = t;
+	    //the barycentric coords are needed in hit_info -- stored so they do not need to be found again
+	    rec.u = u;
+	    rec.v = v;
+	    closest = packet.first + lane;
+	    return true;
 	}
+
+	void reorder_primitives(unsigned first, const std::vector<unsigned>& ids);
+
+	//the box around a triangle (padded when it is flat, as for triangle::bounding_box)
+	static aabb triangle_box(const vec3& p0, const vec3& p1, const vec3& p2);
+
+private:
+    std::unique_ptr<indexed_bvh<basic_triangle_mesh>> tris;
+
+    [[nodiscard]] inline aabb triangle_box(const unsigned tri) const {
+        return triangle_box(vertices.position(indices[3*tri]), vertices.position(indices[3*tri + 1]), vertices.position(indices[3*tri + 2]));
+    }
 };
 
+using triangle_mesh = basic_triangle_mesh<vertex_attributes<double>>;
+using quantized_triangle_mesh = basic_triangle_mesh<quantized_vertex_attributes>;
 
 
+template <typename Attributes>
+basic_triangle_mesh<Attributes>::basic_triangle_mesh(Attributes _vertices, std::vector<unsigned> _indices,
+                                                     std::vector<std::shared_ptr<material>> _materials, std::vector<unsigned> _material_ids,
+                                                     const bvh_settings& settings)
+        : vertices(std::move(_vertices)), indices(std::move(_indices)), materials(std::move(_materials)), material_ids(std::move(_material_ids)) {
+    if (materials.size() <= 1) material_ids.clear();
 
-void processMesh(aiMesh *mesh, const aiScene *scene, std::vector<double> &vertices, std::vector<unsigned> &indices, std::vector<double> &uvs, std::vector<std::string> &tex_paths, std::vector<double> &norms) {
+    std::vector<bvh_primitive> prims(num_triangles());
+    #pragma omp parallel for default(none) shared(prims)
+    for (unsigned i = 0; i < prims.size(); i++) {
+        prims[i].box = triangle_box(i);
+        prims[i].id = i;
+    }
+    tris = std::make_unique<indexed_bvh<basic_triangle_mesh>>(*this, prims, 0, settings);
+}
 
-	for (unsigned i = 0; i < mesh->mNumVertices; i++) {
-		//process vertex positions, normals and texture coordinates
+template <typename Attributes>
+basic_triangle_mesh<Attributes>::basic_triangle_mesh(Attributes _vertices, std::vector<unsigned> _indices,
+                                                     std::vector<std::shared_ptr<material>> _materials, std::vector<unsigned> _material_ids,
+                                                     stored_bvh bvh)
+        : vertices(std::move(_vertices)), indices(std::move(_indices)), materials(std::move(_materials)), material_ids(std::move(_material_ids)) {
+    if (materials.size() <= 1) material_ids.clear();
+    tris = std::make_unique<indexed_bvh<basic_triangle_mesh>>(*this, std::move(bvh));
+}
 
-		vertices.push_back(mesh->mVertices[i].x);
-		vertices.push_back(mesh->mVertices[i].y);
-		vertices.push_back(mesh->mVertices[i].z);
+template <typename Attributes>
+triangle_packet basic_triangle_mesh<Attributes>::make_leaf_block(const unsigned first, const unsigned count) const {
+    triangle_packet packet;
+    packet.first = first;
+    packet.count = count;
+    for (unsigned i = 0; i < count; i++) {
+        const unsigned* const tri = &indices[3*(first + i)];
+        packet.set_triangle(i, vertices.position(tri[0]), vertices.position(tri[1]), vertices.position(tri[2]));
+    }
+    return packet;
+}
 
-		norms.push_back(mesh->mNormals[i].x);
-		norms.push_back(mesh->mNormals[i].y);
-		norms.push_back(mesh->mNormals[i].z);
+template <typename Attributes>
+void basic_triangle_mesh<Attributes>::hit_info(const ray& r, [[maybe_unused]] const double t_min, [[maybe_unused]] const double t_max, hit_record& rec) {
+    rec.mat_ptr = materials[material_ids.empty() ? 0 : material_ids[rec.primitive_id]].get();
+    rec.p = r.at(rec.t);
+
+    //interpolating the uv coords and normals using the barycentric coords
+    //https://computergraphics.stackexchange.com/questions/1866/how-to-map-square-texture-to-triangle
+    const unsigned* const tri = &indices[3*rec.primitive_id];
+    const double bary1 = rec.u, bary2 = rec.v;
+    const double bary0 = 1.0 - bary1 - bary2;
+
+    const vec2 uv0 = vertices.uv(tri[0]), uv1 = vertices.uv(tri[1]), uv2 = vertices.uv(tri[2]);
+    rec.u = bary0*uv0.x() + bary1*uv1.x() + bary2*uv2.x();
+    rec.v = bary0*uv0.y() + bary1*uv1.y() + bary2*uv2.y();
+
+    const vec3 normal = bary0*vertices.normal(tri[0]) + bary1*vertices.normal(tri[1]) + bary2*vertices.normal(tri[2]);
+    rec.set_face_normal(r, normal);
+
+    //how fast the uvs change over the triangle is the square root of the ratio of its area in uv coords to its area
+    rec.uv_footprint = 0;
+    if (r.has_cone()) {
+        const vec3 p0 = vertices.position(tri[0]);
+        const double area = cross(vertices.position(tri[1]) - p0, vertices.position(tri[2]) - p0).length();
+        const double uv_area = std::abs((uv1.x() - uv0.x()) * (uv2.y() - uv0.y()) - (uv2.x() - uv0.x()) * (uv1.y() - uv0.y()));
+        if (area > 0) rec.set_uv_footprint(r, sqrt(uv_area / area));
+    }
+}
 
-		if (mesh->mTextureCoords[0]) {	//does the mesh contain texture coords
-			uvs.push_back(mesh->mTextureCoords[0][i].x);
-			uvs.push_back(mesh->mTextureCoords[0][i].y);
-		} else {
-			uvs.push_back(0.0f);
-			uvs.push_back(0.0f);
-		}
-	}
+template <typename Attributes>
+void basic_triangle_mesh<Attributes>::reorder_primitives(const unsigned first, const std::vector<unsigned>& ids) {
+    const std::vector<unsigned> old(indices.begin() + 3*first, indices.begin() + 3*(first + ids.size()));
+    for (unsigned k = 0; k < ids.size(); k++) {
+        for (unsigned j = 0; j < 3; j++) {
+            indices[3*(first + k) + j] = old[3*(ids[k] - first) + j];
+        }
+    }
 
-	for (unsigned i = 0; i < mesh->mNumFaces; i++) {
-		//assimp defines eah mesh as having an array of faces
-		// - aiProcess_Triangulate means these faces are always triangles
-		//Iterate over all the faces and store the face's indices
+    if (!material_ids.empty()) {
+        const std::vector<unsigned> old_ids(material_ids.begin() + first, material_ids.begin() + first + ids.size());
+        for (unsigned k = 0; k < ids.size(); k++) {
+            material_ids[first + k] = old_ids[ids[k] - first];
+        }
+    }
+}
 
-		const aiFace face = mesh->mFaces[i];
-		for (unsigned j = 0; j < face.mNumIndices; j++) {
-			indices.push_back(face.mIndices[j]);
-		}
+template <typename Attributes>
+aabb basic_triangle_mesh<Attributes>::triangle_box(const vec3& p0, const vec3& p1, const vec3& p2) {
+    vec3 min, max;
+    for (int i = 0; i < 3; i++) {
+        min[i] = std::min({p0[i], p1[i], p2[i]});
+        max[i] = std::max({p0[i], p1[i], p2[i]});
+
+        //padding flat boxes (same as triangle::bounding_box)
+        constexpr double small = 0.0001;
+        constexpr double epsilon = 0.000001;
+        if (std::abs(min[i] - max[i]) < epsilon) {
+            max[i] += small;
+            min[i] -= small;
+        }
+    }
+    return aabb(min, max);
+}
+
+
+//everything read from a model file, before it is made into a triangle mesh
+struct model_data {
+	std::vector<double> vertices;	//3 per vertex
+	std::vector<unsigned> indices;	//3 per triangle
+	std::vector<double> uvs;	//2 per vertex
+	std::vector<double> norms;	//3 per vertex
+	std::vector<unsigned> material_ids;	//1 per triangle, an index into the materials below
+	std::vector<std::string> tex_paths;	//the diffuse texture of each material ("" if it has none) -- relative to the directory of the model
+	std::vector<color> colors;	//the diffuse colour of each material (used when it has no texture)
+};
+
+
+//the meshes of a node and all of its children, in the order their vertices are stored
+inline void collect_meshes(const aiNode *node, const aiScene *scene, std::vector<const aiMesh*> &meshes) {
+	for (unsigned i = 0; i < node->mNumMeshes; i++) {
+		meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
 
-	if (mesh->mMaterialIndex >= 0) {
-		//currently only processes diffuse textures
+	for (unsigned i = 0; i < node->mNumChildren; i++) {
+		collect_meshes(node->mChildren[i], scene, meshes);
+	}
+}
 
-		//retrieve the aiMaterial object from the scene
-		aiMaterial *mat = scene->mMaterials[mesh->mMaterialIndex];
-		//saying that want all diffuse textures
-		const aiTextureType type = aiTextureType_DIFFUSE;
+//copies the vertices [first, last) of a mesh, whose vertices start at first_vertex in data
+inline void copy_vertices(const aiMesh *mesh, const unsigned first, const unsigned last, const size_t first_vertex, model_data &data) {
+	for (unsigned i = first; i < last; i++) {
+		const size_t v = first_vertex + i;
+		data.vertices[3*v] = mesh->mVertices[i].x;
+		data.vertices[3*v + 1] = mesh->mVertices[i].y;
+		data.vertices[3*v + 2] = mesh->mVertices[i].z;
 
-		//actually loading the textures
-		for (unsigned i = 0; i < mat->GetTextureCount(type); i++) {
-			aiString str;
-			mat->GetTexture(type, i , &str);
-			std::string path = str.C_Str();
+		data.norms[3*v] = mesh->mNormals[i].x;
+		data.norms[3*v + 1] = mesh->mNormals[i].y;
+		data.norms[3*v + 2] = mesh->mNormals[i].z;
 
-			bool already_loaded = false;
-			for (auto & tex_path : tex_paths) {
-				if (path == tex_path) {
-					already_loaded = true;
-					break;
-				}
-			}
-			if (!already_loaded) {
-				tex_paths.push_back(path);	
-			}
+		if (mesh->mTextureCoords[0]) {	//does the mesh contain texture coords
+			data.uvs[2*v] = mesh->mTextureCoords[0][i].x;
+			data.uvs[2*v + 1] = mesh->mTextureCoords[0][i].y;
+		} else {
+			data.uvs[2*v] = 0.0;
+			data.uvs[2*v + 1] = 0.0;
+		}
+	}
+}
 
+//copies the indices of the faces [first, last) of a mesh
+// - the indices of a mesh start at 0, but its vertices go after the vertices of the meshes before it (first_vertex)
+inline void copy_faces(const aiMesh *mesh, const unsigned first, const unsigned last, const size_t first_vertex, size_t index, model_data &data) {
+	for (unsigned i = first; i < last; i++) {
+		//aiProcess_Triangulate means these faces are always triangles (or lines and points, which are kept as they are)
+		const aiFace& face = mesh->mFaces[i];
+		for (unsigned j = 0; j < face.mNumIndices; j++) {
+			data.indices[index++] = static_cast<unsigned>(first_vertex + face.mIndices[j]);
 		}
 	}
+}
 
+//adds a material to the model -- currently only its first diffuse texture and its diffuse colour are used
+inline void add_material(const aiMaterial *mat, model_data &data) {
+	std::string path;
+	if (mat->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
+		aiString str;
+		mat->GetTexture(aiTextureType_DIFFUSE, 0, &str);
+		path = str.C_Str();
+	}
+	data.tex_paths.push_back(path);
+
+	aiColor3D diffuse(0.8f, 0.8f, 0.8f);
+	mat->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+	data.colors.emplace_back(diffuse.r, diffuse.g, diffuse.b);
 }
 
+//turns the meshes of an imported scene into a single model
+// - the size of everything is found first, so the arrays are allocated once
+// - the vertices and faces are then copied in ranges of up to range_size in parallel (across meshes and within large meshes)
+inline void process_scene(const aiScene *scene, model_data &data) {
+	constexpr unsigned range_size = 16384;
+
+	std::vector<const aiMesh*> meshes;
+	collect_meshes(scene->mRootNode, scene, meshes);
+
+	//where the vertices and indices of each mesh start
+	std::vector<size_t> first_vertex(meshes.size() + 1, 0), first_index(meshes.size() + 1, 0);
+	std::vector<bool> only_triangles(meshes.size());
+	for (size_t m = 0; m < meshes.size(); m++) {
+		size_t num_indices = 0;
+		for (unsigned i = 0; i < meshes[m]->mNumFaces; i++) {
+			num_indices += meshes[m]->mFaces[i].mNumIndices;
+		}
+		only_triangles[m] = num_indices == 3 * static_cast<size_t>(meshes[m]->mNumFaces);
+		first_vertex[m + 1] = first_vertex[m] + meshes[m]->mNumVertices;
+		first_index[m + 1] = first_index[m] + num_indices;
+	}
 
-void processNode(aiNode *node, const aiScene *scene, std::vector<double> &vertices, std::vector<unsigned> &indices, std::vector<double> &uvs, std::vector<std::string> &tex_paths, std::vector<double> &norms) {
-	//process all the node's meshes
-	for (unsigned i = 0; i < node->mNumMeshes; i++) {
-		aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-		processMesh(mesh, scene, vertices, indices, uvs, tex_paths, norms);
+	data.vertices.resize(3 * first_vertex.back());
+	data.norms.resize(3 * first_vertex.back());
+	data.uvs.resize(2 * first_vertex.back());
+	data.indices.resize(first_index.back());
+	data.material_ids.resize(first_index.back() / 3);
+
+	//each mesh keeps its own material -- meshes with the same assimp material share it
+	std::vector<unsigned> mesh_material(meshes.size());
+	std::unordered_map<unsigned, unsigned> material_index;	//assimp's index -> index in the model
+	for (size_t m = 0; m < meshes.size(); m++) {
+		if (meshes[m]->mNumFaces == 0) continue;	//no triangles use its material
+		const auto [it, is_new] = material_index.try_emplace(meshes[m]->mMaterialIndex, static_cast<unsigned>(data.tex_paths.size()));
+		if (is_new) add_material(scene->mMaterials[meshes[m]->mMaterialIndex], data);
+		mesh_material[m] = it->second;
 	}
 
-	//process the meshes of all the nodes children
-	for (unsigned i = 0; i < node->mNumChildren; i++) {
-		processNode(node->mChildren[i], scene, vertices, indices, uvs, tex_paths, norms);
+	//the ranges of vertices and faces to copy -- (mesh, first, last, is_faces)
+	// - the faces of a mesh with faces that are not triangles are copied in one range, as the index each face starts at is not known
+	struct import_range {
+		size_t mesh;
+		unsigned first, last;
+		bool faces;
+	};
+	std::vector<import_range> ranges;
+	for (size_t m = 0; m < meshes.size(); m++) {
+		for (unsigned first = 0; first < meshes[m]->mNumVertices; first += range_size) {
+			ranges.push_back({m, first, std::min(first + range_size, meshes[m]->mNumVertices), false});
+		}
+		const unsigned face_range = only_triangles[m] ? range_size : meshes[m]->mNumFaces;
+		for (unsigned first = 0; first < meshes[m]->mNumFaces; first += face_range) {
+			ranges.push_back({m, first, std::min(first + face_range, meshes[m]->mNumFaces), true});
+		}
 	}
-}
 
+	#pragma omp parallel for schedule(dynamic) default(none) shared(meshes, ranges, first_vertex, first_index, only_triangles, mesh_material, data)
+	for (size_t k = 0; k < ranges.size(); k++) {
+		const auto& range = ranges[k];
+		const auto mesh = meshes[range.mesh];
+		if (range.faces) {
+			copy_faces(mesh, range.first, range.last, first_vertex[range.mesh], first_index[range.mesh] + 3 * static_cast<size_t>(range.first), data);
 
+			const size_t first_triangle = first_index[range.mesh] / 3 + (only_triangles[range.mesh] ? range.first : 0);
+			const size_t last_triangle = only_triangles[range.mesh] ? first_index[range.mesh] / 3 + range.last : first_index[range.mesh + 1] / 3;
+			std::fill(data.material_ids.begin() + first_triangle, data.material_ids.begin() + last_triangle, mesh_material[range.mesh]);
+		} else {
+			copy_vertices(mesh, range.first, range.last, first_vertex[range.mesh], data);
+		}
+	}
+}
 
-std::shared_ptr<triangle_mesh> generate_model(const std::string& file_name, const bool flip_uvs = false)  {
+//nothing if assimp could not read the file
+inline std::optional<model_data> import_model(const std::string& file_name, const bool flip_uvs = false) {
 	//https://learnopengl.com/Model-Loading/Model	
 
-	std::vector<double> vertices;
-	std::vector<unsigned> indices;
-	std::vector<double> uvs;
-	std::vector<double> norms;
-	std::vector<std::string> tex_paths;
+	model_data data;
 
-	unsigned assimp_settings = aiProcess_Triangulate | aiProcess_GenNormals;
+	unsigned assimp_settings = aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_JoinIdenticalVertices;
 
 
 	if (flip_uvs)
@@ -138,64 +395,56 @@ std::shared_ptr<triangle_mesh> generate_model(const std::string& file_name, cons
 	//aiProcess_Triangulate tells assimp to make the model entirely out of triangles
 	//aiProcess_GenNormals creates normal vectors for each vertex
 	//aiProcess_FlipUVS flips the texture coordinates on the y-axis
+	//aiProcess_JoinIdenticalVertices makes faces that share a vertex use the same index (so the vertex is only stored once)
 
 
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 		std::cerr << "Assimp Error:\n\t" << importer.GetErrorString() << std::endl;
+		return std::nullopt;
 	}
 
-	processNode(scene->mRootNode, scene, vertices, indices, uvs, tex_paths, norms);
-
-
-	//turing the read in data into a triangle mesh
-	hittable_list triangles;	
+	process_scene(scene, data);
+	return data;
+}
 
+//the materials of a model -- a lambertian with the diffuse texture of each material (or its colour when it has none)
+// - the textures come from the texture_cache, so textures used by several materials or models are only loaded once
+inline std::vector<std::shared_ptr<material>> model_materials(const std::string& file_name, const std::vector<std::string>& tex_paths,
+                                                              const std::vector<color>& colors) {
 	std::string file_dir = file_name.substr(0, file_name.find_last_of('/') );
 	file_dir.append("/");
 
-	auto current_material = make_shared<lambertian>(std::make_shared<image_texture>(file_dir.append(tex_paths[0]).c_str()) );
-
-	for (int i = 0; i < indices.size(); i += 3) {
-		triangles.add(make_shared<triangle>(	vec3(vertices[ 3*indices[i] ],		//each element of indices refers to 1 vertex
-							vertices[ 3*indices[i]  + 1],	//each vertex has 3 elements - x,y,z
-							vertices[ 3*indices[i]  + 2]),	
-
-							vec3(vertices[ 3*indices[i+1] ],
-							vertices[ 3*indices[i+1]  + 1],
-							vertices[ 3*indices[i+1]  + 2]),
-
-							vec3(vertices[ 3*indices[i+2] ],
-							vertices[ 3*indices[i+2]  + 1],
-							vertices[ 3*indices[i+2]  + 2]),
-
-							vec3(norms[ 3*indices[i] ],		//each element of indices refers to 1 normal
-							norms[ 3*indices[i]  + 1],		//each normal has 3 elements - x,y,z
-							norms[ 3*indices[i]  + 2]),	
-
-							vec3(norms[ 3*indices[i+1] ],
-							norms[ 3*indices[i+1]  + 1],
-							norms[ 3*indices[i+1]  + 2]),
-
-							vec3(norms[ 3*indices[i+2] ],
-							norms[ 3*indices[i+2]  + 1],
-							norms[ 3*indices[i+2]  + 2]),
-
-
-							uvs[2*indices[i] ],
-							uvs[2*indices[i] +1],
-
-							uvs[2*indices[i+1] ],
-							uvs[2*indices[i+1] +1],
-
-							uvs[2*indices[i+2] ],
-							uvs[2*indices[i+2] +1],
+	std::vector<std::shared_ptr<material>> materials;
+	for (size_t i = 0; i < tex_paths.size(); i++) {
+		if (tex_paths[i].empty()) {
+			materials.push_back(std::make_shared<lambertian>(colors[i]));
+		} else {
+			materials.push_back(std::make_shared<lambertian>(texture_cache::get(file_dir + tex_paths[i])));
+		}
+	}
+	return materials;
+}
 
-							current_material));
 
+//settings controls how the bvh for the mesh is built
+// - for large meshes (where the bvh does not fit in cache) bvh_layout::van_emde_boas, bvh_layout::breadth_first or
+//   bvh_format::compressed should be faster
+// - eager_depth is the number of levels of the mesh's bvh to build before rendering starts. The rest is built as rays reach it,
+//   so huge meshes that are mostly not seen start rendering much sooner
+//Attributes is how the vertices are stored (e.g. generate_model<quantized_vertex_attributes> for huge meshes)
+//models that are loaded often can be converted once to a mesh file, which loads without assimp (see mesh_file.hpp)
+//returns nullptr if the model could not be imported
+template <typename Attributes = vertex_attributes<double>>
+std::shared_ptr<basic_triangle_mesh<Attributes>> generate_model(const std::string& file_name, const bool flip_uvs = false, const bvh_settings& settings = {})  {
+	auto imported = import_model(file_name, flip_uvs);
+	if (!imported) return nullptr;
+	auto& data = *imported;
 
-	}
+	//turing the read in data into a triangle mesh
+	auto materials = model_materials(file_name, data.tex_paths, data.colors);
 
-	return std::make_shared<triangle_mesh>(triangles, 0, 1);
+	//the vertices are shared by the triangles, so only the indices are needed per triangle
+	return std::make_shared<basic_triangle_mesh<Attributes>>(Attributes(data.vertices, data.norms, data.uvs), std::move(data.indices),
+	                                                         std::move(materials), std::move(data.material_ids), settings);
 
 }
-
@@ -0,0 +1,127 @@
+#ifndef RAYTRACER_TRIANGLE_PACKET_HPP
+#define RAYTRACER_TRIANGLE_PACKET_HPP
+
+#include "ray.hpp"
+#include "simd.hpp"
+
+#include <limits>
+
+
+/*=====================================================================================================================
+ A few triangles stored as a structure of arrays so they can all be intersected at once with SIMD
+  - 8 triangles with AVX, 4 with SSE (and the same 4 a triangle at a time otherwise)
+  - the first vertex and the 2 edges of each triangle are precomputed (the quantities Moller-Trumbore needs), in single precision
+  - unused lanes are left as degenerate triangles (edges of 0), which are never hit
+  - the leaves of a mesh's bvh hold 1 packet, so a leaf is tested with 1 kernel instead of a call per triangle
+ ===================================================================================================================*/
+
+struct alignas(32) triangle_packet {
+#if defined(__AVX__) || defined(__SSE2__)
+    static constexpr unsigned width = simd_lanes::width;
+#else
+    static constexpr unsigned width = 4;
+#endif
+
+    float vertex0[3][width]{};  //[axis][triangle]
+    float edge0[3][width]{};    //vertex1 - vertex0
+    float edge1[3][width]{};    //vertex2 - vertex0
+    unsigned first = 0; //the index of the first triangle (the triangles of a packet are next to each other)
+    unsigned count = 0;
+
+    inline void set_triangle(const unsigned lane, const vec3& v0, const vec3& v1, const vec3& v2) {
+        for (unsigned axis = 0; axis < 3; axis++) {
+            vertex0[axis][lane] = static_cast<float>(v0[axis]);
+            edge0[axis][lane] = static_cast<float>(v1[axis] - v0[axis]);
+            edge1[axis][lane] = static_cast<float>(v2[axis] - v0[axis]);
+        }
+    }
+
+    //finds the closest of the triangles hit between t_min and t_max
+    // - returns the lane of the triangle hit (-1 if none were hit)
+    // - sets the hit time and the barycentric coords u and v (the weights of vertex1 and vertex2)
+    inline int hit(const ray& r, double t_min, double t_max, double& t, double& u, double& v) const;
+};
+
+
+inline int triangle_packet::hit(const ray& r, const double t_min, const double t_max, double& t, double& u, double& v) const {
+    //the Moller-Trumbore intersection algorithm (see triangle::hit_time) for every lane at once
+    constexpr float epsilon = 0.0000001f;
+    alignas(32) float t_lanes[width], u_lanes[width], v_lanes[width];
+    unsigned hit_mask;
+
+#if defined(__AVX__) || defined(__SSE2__)
+    using L = simd_lanes;
+    const L::type dx = L::set(static_cast<float>(r.dir.x())), dy = L::set(static_cast<float>(r.dir.y())), dz = L::set(static_cast<float>(r.dir.z()));
+    const L::type e0x = L::load(edge0[0]), e0y = L::load(edge0[1]), e0z = L::load(edge0[2]);
+    const L::type e1x = L::load(edge1[0]), e1y = L::load(edge1[1]), e1z = L::load(edge1[2]);
+
+    //h = cross(dir, edge1)
+    const L::type hx = L::sub(L::mul(dy, e1z), L::mul(dz, e1y));
+    const L::type hy = L::sub(L::mul(dz, e1x), L::mul(dx, e1z));
+    const L::type hz = L::sub(L::mul(dx, e1y), L::mul(dy, e1x));
+    const L::type a = L::add(L::add(L::mul(e0x, hx), L::mul(e0y, hy)), L::mul(e0z, hz));
+    const L::type f = L::div(L::set(1.0f), a);
+
+    //s = origin - vertex0
+    const L::type sx = L::sub(L::set(static_cast<float>(r.orig.x())), L::load(vertex0[0]));
+    const L::type sy = L::sub(L::set(static_cast<float>(r.orig.y())), L::load(vertex0[1]));
+    const L::type sz = L::sub(L::set(static_cast<float>(r.orig.z())), L::load(vertex0[2]));
+    const L::type u_l = L::mul(f, L::add(L::add(L::mul(sx, hx), L::mul(sy, hy)), L::mul(sz, hz)));
+
+    //q = cross(s, edge0)
+    const L::type qx = L::sub(L::mul(sy, e0z), L::mul(sz, e0y));
+    const L::type qy = L::sub(L::mul(sz, e0x), L::mul(sx, e0z));
+    const L::type qz = L::sub(L::mul(sx, e0y), L::mul(sy, e0x));
+    const L::type v_l = L::mul(f, L::add(L::add(L::mul(dx, qx), L::mul(dy, qy)), L::mul(dz, qz)));
+    const L::type t_l = L::mul(f, L::add(L::add(L::mul(e1x, qx), L::mul(e1y, qy)), L::mul(e1z, qz)));
+
+    const L::type zero = L::set(0.0f);
+    L::type valid = L::either(L::greater(a, L::set(epsilon)), L::greater(L::set(-epsilon), a));    //ray is not parallel to triangle
+    valid = L::both(valid, L::both(L::greater_eq(u_l, zero), L::greater_eq(v_l, zero)));
+    valid = L::both(valid, L::greater_eq(L::set(1.0f), L::add(u_l, v_l)));
+    valid = L::both(valid, L::both(L::greater_eq(t_l, L::set(static_cast<float>(t_min))), L::greater_eq(L::set(static_cast<float>(t_max)), t_l)));
+    valid = L::both(valid, L::greater_eq(t_l, L::set(epsilon)));
+    hit_mask = L::mask(valid);
+    if (hit_mask == 0) return -1;
+
+    L::store(t_lanes, t_l);
+    L::store(u_lanes, u_l);
+    L::store(v_lanes, v_l);
+#else
+    hit_mask = 0;
+    for (unsigned i = 0; i < count; i++) {
+        const vec3 e0(edge0[0][i], edge0[1][i], edge0[2][i]), e1(edge1[0][i], edge1[1][i], edge1[2][i]);
+        const vec3 h = cross(r.dir, e1);
+        const float a = static_cast<float>(dot(e0, h));
+        if (a > -epsilon && a < epsilon) continue;
+
+        const float f = 1.0f / a;
+        const vec3 s = r.orig - vec3(vertex0[0][i], vertex0[1][i], vertex0[2][i]);
+        u_lanes[i] = f * static_cast<float>(dot(s, h));
+        const vec3 q = cross(s, e0);
+        v_lanes[i] = f * static_cast<float>(dot(r.dir, q));
+        t_lanes[i] = f * static_cast<float>(dot(e1, q));
+        if (u_lanes[i] < 0.0f || v_lanes[i] < 0.0f || u_lanes[i] + v_lanes[i] > 1.0f) continue;
+        if (t_lanes[i] < t_min || t_lanes[i] > t_max || t_lanes[i] < epsilon) continue;
+        hit_mask |= 1u << i;
+    }
+    if (hit_mask == 0) return -1;
+#endif
+
+    //the closest of the triangles hit
+    int closest = -1;
+    float t_closest = std::numeric_limits<float>::infinity();
+    for (unsigned i = 0; i < width; i++) {
+        if ((hit_mask & (1u << i)) && t_lanes[i] < t_closest) {
+            t_closest = t_lanes[i];
+            closest = static_cast<int>(i);
+        }
+    }
+
+    t = t_lanes[closest];
+    u = u_lanes[closest];
+    v = v_lanes[closest];
+    return closest;
+}
+
+#endif //RAYTRACER_TRIANGLE_PACKET_HPP
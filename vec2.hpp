@@ -30,4 +30,8 @@ inline vec2 operator + (const vec2 &v, const double t) {
     return t + v;
 }
 
+inline vec2 operator + (const vec2 &u, const vec2 &v) {
+    return vec2(u.e[0]+v.e[0], u.e[1]+v.e[1]);
+}
+
 #endif //RAYTRACER_VEC2_HPP
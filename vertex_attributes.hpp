@@ -0,0 +1,176 @@
+#ifndef RAYTRACER_VERTEX_ATTRIBUTES_HPP
+#define RAYTRACER_VERTEX_ATTRIBUTES_HPP
+
+#include "vec3.hpp"
+#include "helpful.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/*=====================================================================================================================
+ How the vertices of a basic_triangle_mesh are stored
+  - both are made from the positions (3 per vertex), normals (3 per vertex) and uvs (2 per vertex) in double precision
+  - both give the attributes of a vertex back in double precision with position, normal and uv
+
+ vertex_attributes<real> stores them as they are in real (double, or float to halve the memory)
+ quantized_vertex_attributes compresses them to 14 bytes per vertex (from 64 for double)
+  - positions are 16 bit fixed point relative to the bounds of the mesh (the error in each axis is at most 1/131070 of the size of the mesh)
+  - normals are octahedron encoded into 2 16 bit numbers (the error is a small fraction of a degree)
+  - uvs are 16 bit fixed point relative to the range of the uvs
+  - the largest error made by the compression is measured when it is made (max_position_error, ...)
+ ===================================================================================================================*/
+
+template <typename real>
+struct vertex_attributes {
+    std::vector<real> positions;    //3 per vertex
+    std::vector<real> normals;      //3 per vertex
+    std::vector<real> uvs;          //2 per vertex
+
+    vertex_attributes() = default;
+    vertex_attributes(const std::vector<double>& _positions, const std::vector<double>& _normals, const std::vector<double>& _uvs)
+            : positions(_positions.begin(), _positions.end()), normals(_normals.begin(), _normals.end()), uvs(_uvs.begin(), _uvs.end()) {}
+
+    [[nodiscard]] inline size_t num_vertices() const {
+        return positions.size() / 3;
+    }
+
+    [[nodiscard]] inline vec3 position(const unsigned vertex) const {
+        return vec3(positions[3*vertex], positions[3*vertex + 1], positions[3*vertex + 2]);
+    }
+
+    [[nodiscard]] inline vec3 normal(const unsigned vertex) const {
+        return vec3(normals[3*vertex], normals[3*vertex + 1], normals[3*vertex + 2]);
+    }
+
+    [[nodiscard]] inline vec2 uv(const unsigned vertex) const {
+        return vec2(uvs[2*vertex], uvs[2*vertex + 1]);
+    }
+
+    [[nodiscard]] inline size_t memory_usage() const {
+        return (positions.size() + normals.size() + uvs.size()) * sizeof(real);
+    }
+};
+
+
+struct quantized_vertex_attributes {
+    std::vector<std::uint16_t> positions;   //3 per vertex
+    std::vector<std::uint32_t> normals;     //1 per vertex
+    std::vector<std::uint16_t> uvs;         //2 per vertex
+
+    //the largest differences between the original and decoded attributes
+    double max_position_error = 0;  //distance
+    double max_normal_error = 0;    //angle in degrees
+    double max_uv_error = 0;
+
+    quantized_vertex_attributes() = default;
+    quantized_vertex_attributes(const std::vector<double>& _positions, const std::vector<double>& _normals, const std::vector<double>& _uvs);
+
+    [[nodiscard]] inline size_t num_vertices() const {
+        return positions.size() / 3;
+    }
+
+    [[nodiscard]] inline vec3 position(const unsigned vertex) const {
+        return vec3(position_origin[0] + position_scale[0] * positions[3*vertex],
+                    position_origin[1] + position_scale[1] * positions[3*vertex + 1],
+                    position_origin[2] + position_scale[2] * positions[3*vertex + 2]);
+    }
+
+    [[nodiscard]] inline vec3 normal(const unsigned vertex) const {
+        //the 2 halves are signed 16 bit numbers
+        const auto x = static_cast<std::int16_t>(normals[vertex] & 0xffffu);
+        const auto y = static_cast<std::int16_t>(normals[vertex] >> 16);
+        return decode_octahedron(x / 32767.0, y / 32767.0);
+    }
+
+    [[nodiscard]] inline vec2 uv(const unsigned vertex) const {
+        return vec2(uv_origin[0] + uv_scale[0] * uvs[2*vertex], uv_origin[1] + uv_scale[1] * uvs[2*vertex + 1]);
+    }
+
+    [[nodiscard]] inline size_t memory_usage() const {
+        return positions.size() * sizeof(std::uint16_t) + normals.size() * sizeof(std::uint32_t) + uvs.size() * sizeof(std::uint16_t);
+    }
+
+private:
+    static constexpr double max_fixed = std::numeric_limits<std::uint16_t>::max();
+
+    double position_origin[3]{}, position_scale[3]{};  //a stored position of q is origin + scale*q
+    double uv_origin[2]{}, uv_scale[2]{};
+
+    //the octahedron encoding of a unit vector -- the vector is projected onto the octahedron |x| + |y| + |z| = 1,
+    //and the lower half (z < 0) is folded over the upper half so the octahedron is flattened to the square [-1,1]^2
+    static inline void encode_octahedron(const vec3& n, double& x, double& y) {
+        const double l1 = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+        x = l1 > 0 ? n.x() / l1 : 0;
+        y = l1 > 0 ? n.y() / l1 : 0;
+        if (n.z() < 0) {
+            const double folded_x = (1 - std::abs(y)) * (x >= 0 ? 1 : -1);
+            y = (1 - std::abs(x)) * (y >= 0 ? 1 : -1);
+            x = folded_x;
+        }
+    }
+
+    static inline vec3 decode_octahedron(double x, double y) {
+        const double z = 1 - std::abs(x) - std::abs(y);
+        if (z < 0) {
+            const double unfolded_x = (1 - std::abs(y)) * (x >= 0 ? 1 : -1);
+            y = (1 - std::abs(x)) * (y >= 0 ? 1 : -1);
+            x = unfolded_x;
+        }
+        return unit_vector(vec3(x, y, z));
+    }
+
+    //finds origin and scale so the values in [min, max] fit in 16 bits
+    static inline void fit_range(const std::vector<double>& values, const unsigned stride, const unsigned component, double& origin, double& scale) {
+        double min = std::numeric_limits<double>::infinity(), max = -std::numeric_limits<double>::infinity();
+        for (size_t i = component; i < values.size(); i += stride) {
+            min = std::min(min, values[i]);
+            max = std::max(max, values[i]);
+        }
+        origin = values.empty() ? 0 : min;
+        scale = values.empty() || max <= min ? 1 : (max - min) / max_fixed;
+    }
+
+    static inline std::uint16_t to_fixed(const double value, const double origin, const double scale) {
+        return static_cast<std::uint16_t>(std::clamp(std::round((value - origin) / scale), 0.0, max_fixed));
+    }
+};
+
+quantized_vertex_attributes::quantized_vertex_attributes(const std::vector<double>& _positions, const std::vector<double>& _normals,
+                                                         const std::vector<double>& _uvs) {
+    const size_t n = _positions.size() / 3;
+    for (unsigned axis = 0; axis < 3; axis++) fit_range(_positions, 3, axis, position_origin[axis], position_scale[axis]);
+    for (unsigned axis = 0; axis < 2; axis++) fit_range(_uvs, 2, axis, uv_origin[axis], uv_scale[axis]);
+
+    positions.resize(3*n);
+    normals.resize(n);
+    uvs.resize(2*n);
+    for (unsigned v = 0; v < n; v++) {
+        for (unsigned axis = 0; axis < 3; axis++) {
+            positions[3*v + axis] = to_fixed(_positions[3*v + axis], position_origin[axis], position_scale[axis]);
+        }
+        for (unsigned axis = 0; axis < 2; axis++) {
+            uvs[2*v + axis] = to_fixed(_uvs[2*v + axis], uv_origin[axis], uv_scale[axis]);
+        }
+
+        double x, y;
+        const vec3 original_normal(_normals[3*v], _normals[3*v + 1], _normals[3*v + 2]);
+        encode_octahedron(original_normal, x, y);
+        const auto qx = static_cast<std::uint16_t>(static_cast<std::int16_t>(std::round(x * 32767.0)));
+        const auto qy = static_cast<std::uint16_t>(static_cast<std::int16_t>(std::round(y * 32767.0)));
+        normals[v] = static_cast<std::uint32_t>(qx) | (static_cast<std::uint32_t>(qy) << 16);
+
+        //measuring the error made
+        const vec3 original_position(_positions[3*v], _positions[3*v + 1], _positions[3*v + 2]);
+        max_position_error = std::max(max_position_error, (position(v) - original_position).length());
+        if (original_normal.length_squared() > 0) {
+            const double cos_angle = std::clamp(dot(normal(v), unit_vector(original_normal)), -1.0, 1.0);
+            max_normal_error = std::max(max_normal_error, acos(cos_angle) * 180.0 / pi);
+        }
+        const vec2 decoded_uv = uv(v);
+        max_uv_error = std::max({max_uv_error, std::abs(decoded_uv.x() - _uvs[2*v]), std::abs(decoded_uv.y() - _uvs[2*v + 1])});
+    }
+}
+
+#endif //RAYTRACER_VERTEX_ATTRIBUTES_HPP